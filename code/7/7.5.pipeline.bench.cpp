@@ -0,0 +1,194 @@
+//
+// 7.5.pipeline.bench.cpp
+// chapter 7 parallelism and concurrency
+// modern c++ tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial
+//
+// Items go through four stages, each on a thread of its own: three that
+// work on the item and one that takes it out. The stages are wired with
+// the SPSCRing of pipeline.hpp, handing items on in batches and one at a
+// time, and with a std::queue behind a mutex and a condition variable as
+// in 7.5.producer.consumer.cpp. Throughput is measured with items pushed
+// as fast as possible, latency, from the push to the last stage, both
+// then and with items pushed at a fixed rate.
+//
+// usage: 7.5.pipeline.bench.out [--operations=N]
+//        items, default: 1000000
+//
+
+#include <queue>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include "pipeline.hpp"
+#include "bench.harness.hpp"
+
+using clock_type = std::chrono::steady_clock;
+
+struct Item {
+    std::uint64_t sequence;
+    std::int64_t sent;      // nanoseconds of clock_type
+    std::uint64_t value;
+};
+
+static std::int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch()).count();
+}
+
+// the work of a stage, a few rounds of a linear congruential generator
+static Item work(Item item) {
+    for (int i = 0; i < 16; ++i)
+        item.value = item.value * 6364136223846793005ULL + 1442695040888963407ULL;
+    return item;
+}
+
+// what the last stage saw
+struct Sink {
+    std::vector<std::int64_t> latencies;
+    std::uint64_t next = 0;
+    bool ordered = true;
+    std::int64_t finished = 0;
+
+    explicit Sink(std::size_t items) { latencies.reserve(items); }
+
+    void operator()(const Item& item) {
+        std::int64_t arrived = now();
+        ordered = ordered && item.sequence == next++;
+        latencies.push_back(arrived - item.sent);
+        finished = arrived;
+    }
+};
+
+// the queue of 7.5, closed by its producer
+template <typename T>
+class LockedQueue {
+public:
+    void push(T item) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            items.push(std::move(item));
+        }
+        cv.notify_all();
+    }
+
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [&] { return !items.empty() || closed; });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+
+private:
+    std::queue<T> items;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool closed = false;
+};
+
+// Pushes `items` items, one every `interval` nanoseconds, as fast as
+// possible for 0; the source is the calling thread.
+template <typename Push>
+static std::int64_t source(Push push, std::size_t items, std::int64_t interval) {
+    std::int64_t start = now(), due = start;
+    for (std::size_t i = 0; i < items; ++i) {
+        if (interval) {
+            due += interval;
+            while (now() < due) std::this_thread::yield();
+        }
+        push(Item{i, now(), i});
+    }
+    return start;
+}
+
+static std::int64_t run_ring(Sink& sink, std::size_t items, std::size_t batch, std::int64_t interval) {
+    Pipeline<Item>::Options options;
+    options.batch = batch;
+    auto pipeline = Pipeline<Item>::build(options)
+        .then(work)
+        .then(work)
+        .then(work)
+        .sink(std::ref(sink));
+    std::int64_t start = source([&](Item item) { pipeline.push(item); }, items, interval);
+    pipeline.close();
+    return start;
+}
+
+static std::int64_t run_locked(Sink& sink, std::size_t items, std::int64_t interval) {
+    LockedQueue<Item> queues[4];
+    std::vector<std::thread> stages;
+    for (int s = 0; s < 3; ++s)
+        stages.emplace_back([&, s] {
+            Item item;
+            while (queues[s].pop(item)) queues[s + 1].push(work(item));
+            queues[s + 1].close();
+        });
+    stages.emplace_back([&] {
+        Item item;
+        while (queues[3].pop(item)) sink(item);
+    });
+    std::int64_t start = source([&](Item item) { queues[0].push(item); }, items, interval);
+    queues[0].close();
+    for (auto& t : stages) t.join();
+    return start;
+}
+
+static void report(const char* name, std::size_t items, std::int64_t interval,
+                   const std::function<std::int64_t(Sink&)>& run) {
+    Sink sink(items);
+    std::int64_t start = run(sink);
+    if (sink.latencies.size() != items || !sink.ordered) {
+        std::cout << name << ": items were lost or reordered" << std::endl;
+        std::exit(1);
+    }
+    double seconds = (sink.finished - start) / 1e9;
+    auto& l = sink.latencies;
+    std::sort(l.begin(), l.end());
+    auto at = [&](double q) { return l[std::min(l.size() - 1, std::size_t(q * l.size()))] / 1e3; };
+    std::cout << std::setw(16) << name
+              << std::setw(12) << (interval ? 1e9 / interval : items / seconds) / 1e6
+              << std::setw(12) << at(0.5) << std::setw(12) << at(0.99) << std::setw(12) << at(0.999) << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions defaults;
+    defaults.operations = 1000000;
+    std::size_t items = BenchOptions::parse(argc, argv, defaults, {"--operations"}).operations;
+    std::cout << "4 stages, " << std::thread::hardware_concurrency() << " hardware threads" << std::endl
+              << std::fixed << std::setprecision(2);
+
+    // a rate the slowest of them keeps up with
+    const std::int64_t interval = 20000;
+    for (std::int64_t rate_interval : {std::int64_t(0), interval}) {
+        std::size_t n = rate_interval ? std::min<std::size_t>(items, 50000) : items;
+        std::cout << std::endl
+                  << (rate_interval ? "an item every 20 us, " : "as fast as possible, ") << n << " items" << std::endl
+                  << std::setw(16) << "" << std::setw(12) << "M items/s" << std::setw(12) << "p50 us"
+                  << std::setw(12) << "p99 us" << std::setw(12) << "p99.9 us" << std::endl;
+        report("ring, batch 64", n, rate_interval, [&](Sink& sink) { return run_ring(sink, n, 64, rate_interval); });
+        report("ring, batch 1", n, rate_interval, [&](Sink& sink) { return run_ring(sink, n, 1, rate_interval); });
+        report("mutex+cv", n, rate_interval, [&](Sink& sink) { return run_locked(sink, n, rate_interval); });
+    }
+    return 0;
+}
@@ -0,0 +1,197 @@
+//
+// 7.5.producer.consumer.bench.cpp
+// chapter 7 parallelism and concurrency
+// modern c++ tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial
+//
+// The producer and consumer model of 7.5.producer.consumer.cpp without
+// the sleeps: producers push numbers as fast as they can, consumers take
+// them, with a std::queue behind a mutex and a condition variable as in
+// 7.5, and with the MPMCQueue of mpmc.queue.hpp, an item at a time and in
+// batches. Prints the median of a few runs in millions of items per
+// second and checks that every item arrived exactly once.
+//
+// usage: 7.5.producer.consumer.bench.out [--operations=N] [--repetitions=N]
+//        items per run, default: 2000000, runs of a median, default: 5
+//
+
+#include <queue>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <limits>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <condition_variable>
+
+#include "mpmc.queue.hpp"
+#include "bench.harness.hpp"
+
+using clock_type = std::chrono::steady_clock;
+
+// the queue of 7.5
+class LockedQueue {
+public:
+    void push(int item) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            produced_nums.push(item);
+        }
+        cv.notify_all();
+    }
+
+    bool pop(int& item) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [&] { return !produced_nums.empty() || closed; });
+        if (produced_nums.empty()) return false;
+        item = produced_nums.front();
+        produced_nums.pop();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+
+private:
+    std::queue<int> produced_nums;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool closed = false;
+};
+
+enum class Mode { locked, single, batch };
+
+constexpr std::size_t batch_size = 32;
+constexpr std::size_t capacity = 4096;
+
+struct alignas(64) Tally {
+    std::uint64_t count = 0;
+    std::uint64_t sum = 0;
+};
+
+// items per second of one run, producers push the numbers 0 to items - 1
+// between them
+double run(Mode mode, int producers, int consumers, int items) {
+    LockedQueue locked;
+    MPMCQueue<int> queue(capacity);
+    std::vector<Tally> tallies(consumers);
+    std::atomic<int> ready = {0}, producing = {producers}, consuming = {consumers};
+    std::atomic<bool> go = {false};
+    clock_type::time_point finished;
+
+    auto start_together = [&] {
+        ready.fetch_add(1);
+        while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+    };
+
+    auto producer = [&](int index) {
+        start_together();
+        int first = static_cast<int>(std::int64_t(items) * index / producers);
+        int last = static_cast<int>(std::int64_t(items) * (index + 1) / producers);
+        if (mode == Mode::locked) {
+            for (int i = first; i < last; ++i) locked.push(i);
+        } else if (mode == Mode::single) {
+            for (int i = first; i < last; ++i) queue.push(i);
+        } else {
+            std::array<int, batch_size> batch;
+            for (int i = first; i < last; ) {
+                std::size_t n = 0;
+                while (n < batch_size && i < last) batch[n++] = i++;
+                queue.push_bulk(batch.begin(), n);
+            }
+        }
+        // the last producer closes the queue
+        if (producing.fetch_sub(1) == 1) {
+            if (mode == Mode::locked) locked.close();
+            else queue.close();
+        }
+    };
+
+    auto consumer = [&](int index) {
+        start_together();
+        Tally& tally = tallies[index];
+        int item;
+        if (mode == Mode::locked) {
+            while (locked.pop(item)) { ++tally.count; tally.sum += item; }
+        } else if (mode == Mode::single) {
+            while (queue.pop(item)) { ++tally.count; tally.sum += item; }
+        } else {
+            std::array<int, batch_size> batch;
+            while (std::size_t n = queue.pop_bulk(batch.begin(), batch_size)) {
+                for (std::size_t i = 0; i < n; ++i) { ++tally.count; tally.sum += batch[i]; }
+            }
+        }
+        // the clock stops with the last item, not with the joins
+        if (consuming.fetch_sub(1) == 1) finished = clock_type::now();
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i) threads.emplace_back(producer, i);
+    for (int i = 0; i < consumers; ++i) threads.emplace_back(consumer, i);
+    while (ready.load() < producers + consumers) std::this_thread::yield();
+    auto start = clock_type::now();
+    go.store(true, std::memory_order_release);
+    for (auto& t : threads) t.join();
+
+    std::uint64_t count = 0, sum = 0;
+    for (auto& tally : tallies) { count += tally.count; sum += tally.sum; }
+    if (count != std::uint64_t(items) || sum != std::uint64_t(items) * (items - 1) / 2) {
+        std::cout << "lost or duplicated items: " << count << " of " << items << std::endl;
+        std::exit(1);
+    }
+    std::chrono::duration<double> elapsed = finished - start;
+    return items / elapsed.count();
+}
+
+double median(Mode mode, int producers, int consumers, int items, int runs) {
+    std::vector<double> rates;
+    for (int i = 0; i < runs; ++i) rates.push_back(run(mode, producers, consumers, items));
+    std::sort(rates.begin(), rates.end());
+    return rates[rates.size() / 2];
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions defaults;
+    defaults.operations = 2000000;
+    defaults.repetitions = 5;
+    BenchOptions options = BenchOptions::parse(argc, argv, defaults, {"--operations", "--repetitions"});
+    // the items are the ints 0 to items - 1
+    if (options.operations > std::numeric_limits<int>::max()) {
+        std::cerr << "--operations: at most " << std::numeric_limits<int>::max() << " items" << std::endl;
+        return 2;
+    }
+    int items = static_cast<int>(options.operations);
+    int runs = options.repetitions;
+
+    std::cout << "million items per second, median of " << runs << " runs of " << items << " items, "
+              << std::thread::hardware_concurrency() << " hardware threads" << std::endl
+              << std::fixed << std::setprecision(2);
+    std::cout << std::setw(22) << "producers/consumers" << std::setw(14) << "mutex+cv"
+              << std::setw(14) << "mpmc" << std::setw(14) << "mpmc batch" << std::endl;
+
+    // warm up
+    run(Mode::single, 1, 1, std::max(1, items / 10));
+
+    const std::pair<int, int> shapes[] = {{1, 1}, {1, 2}, {2, 2}, {4, 4}, {8, 8}};
+    for (auto [producers, consumers] : shapes) {
+        std::cout << std::setw(22) << (std::to_string(producers) + "/" + std::to_string(consumers))
+                  << std::setw(14) << median(Mode::locked, producers, consumers, items, runs) / 1e6
+                  << std::setw(14) << median(Mode::single, producers, consumers, items, runs) / 1e6
+                  << std::setw(14) << median(Mode::batch, producers, consumers, items, runs) / 1e6 << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,182 @@
+//
+// 7.8.memory.order.bench.cpp
+// chapter 7 parallelism and concurrency
+// modern c++ tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial
+//
+// What the atomics of this chapter cost, measured with bench.harness.hpp:
+//
+//   order      load, store and read-modify-write under each memory order
+//              that applies, on one thread and with all threads on one
+//              variable
+//   sharing    every thread increments a counter of its own, the counters
+//              next to each other on one cache line or each on its own
+//   lock_free  atomic<T> of 8, 16 (struct A of 7.7.is.lock.free.cpp) and
+//              32 bytes: what is_lock_free() says, and what a load, a
+//              store and a compare-and-swap cost
+//   cas        a compare-and-swap loop that increments a shared counter,
+//              against fetch_add, from 1 to N threads
+//
+// usage: 7.8.memory.order.bench.out [--csv | --json] [--repetitions=N] [--warmup=N]
+//                                   [--operations=N] [--threads=N] [--no-pin]
+//
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "bench.harness.hpp"
+
+// results go here, so that loads are not thrown away
+static volatile std::uint64_t sink;
+
+static const char* name(std::memory_order order) {
+    switch (order) {
+    case std::memory_order_relaxed: return "relaxed";
+    case std::memory_order_consume: return "consume";
+    case std::memory_order_acquire: return "acquire";
+    case std::memory_order_release: return "release";
+    case std::memory_order_acq_rel: return "acq_rel";
+    case std::memory_order_seq_cst: return "seq_cst";
+    }
+    return "";
+}
+
+template <std::memory_order order>
+void orders(BenchHarness& harness, int threads) {
+    static std::atomic<std::uint64_t> shared = {0};
+    std::string suffix = std::string(" ") + name(order);
+
+    if constexpr (order == std::memory_order_relaxed || order == std::memory_order_acquire
+                  || order == std::memory_order_seq_cst) {
+        harness.run("order", "load" + suffix, threads, [](int, std::int64_t n) {
+            std::uint64_t sum = 0;
+            for (std::int64_t i = 0; i < n; ++i) sum += shared.load(order);
+            sink = sum;
+        });
+    }
+    if constexpr (order == std::memory_order_relaxed || order == std::memory_order_release
+                  || order == std::memory_order_seq_cst) {
+        harness.run("order", "store" + suffix, threads, [](int, std::int64_t n) {
+            for (std::int64_t i = 0; i < n; ++i) shared.store(i, order);
+        });
+    }
+    harness.run("order", "fetch_add" + suffix, threads, [](int, std::int64_t n) {
+        for (std::int64_t i = 0; i < n; ++i) shared.fetch_add(1, order);
+    });
+    harness.run("order", "exchange" + suffix, threads, [](int, std::int64_t n) {
+        std::uint64_t sum = 0;
+        for (std::int64_t i = 0; i < n; ++i) sum += shared.exchange(i, order);
+        sink = sum;
+    });
+}
+
+template <std::size_t stride>
+void sharing(BenchHarness& harness, int threads, const char* layout) {
+    // a counter every `stride` words, 8 of them fill a cache line
+    static std::atomic<std::uint64_t> counters[64 * stride];
+    harness.run("sharing", std::string("fetch_add relaxed, ") + layout, threads, [](int t, std::int64_t n) {
+        auto& counter = counters[(t % 64) * stride];
+        for (std::int64_t i = 0; i < n; ++i) counter.fetch_add(1, std::memory_order_relaxed);
+    });
+    harness.run("sharing", std::string("load+store, ") + layout, threads, [](int t, std::int64_t n) {
+        auto& counter = counters[(t % 64) * stride];
+        for (std::int64_t i = 0; i < n; ++i)
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    });
+}
+
+struct S8 {
+    int x;
+    float y;
+};
+
+// the struct of 7.7.is.lock.free.cpp
+struct A {
+    float x;
+    int y;
+    long long z;
+};
+
+struct S32 {
+    long long x, y, z, w;
+};
+
+template <typename T>
+void lock_free(BenchHarness& harness, int threads, const char* type) {
+    static std::atomic<T> value{T{}};
+    std::string note = std::string(value.is_lock_free() ? "lock free" : "not lock free")
+                     + (std::atomic<T>::is_always_lock_free ? ", always" : "")
+                     + ", " + std::to_string(sizeof(T)) + " bytes";
+    std::string prefix = std::string(type) + " ";
+    harness.run("lock_free", prefix + "load", threads, [](int, std::int64_t n) {
+        std::uint64_t sum = 0;
+        for (std::int64_t i = 0; i < n; ++i) sum += value.load().x > 0;
+        sink = sum;
+    }, note);
+    harness.run("lock_free", prefix + "store", threads, [](int, std::int64_t n) {
+        T item{};
+        for (std::int64_t i = 0; i < n; ++i) {
+            item.x = static_cast<decltype(item.x)>(i);
+            value.store(item);
+        }
+    }, note);
+    harness.run("lock_free", prefix + "compare_exchange", threads, [](int, std::int64_t n) {
+        T expected = value.load();
+        for (std::int64_t i = 0; i < n; ++i) {
+            T desired = expected;
+            desired.x += 1;
+            while (!value.compare_exchange_weak(expected, desired)) {
+                desired = expected;
+                desired.x += 1;
+            }
+            expected = desired;
+        }
+    }, note);
+}
+
+void cas(BenchHarness& harness, int threads) {
+    static std::atomic<std::uint64_t> counter = {0};
+    harness.run("cas", "compare_exchange loop", threads, [](int, std::int64_t n) {
+        for (std::int64_t i = 0; i < n; ++i) {
+            std::uint64_t expected = counter.load(std::memory_order_relaxed);
+            while (!counter.compare_exchange_weak(expected, expected + 1, std::memory_order_relaxed)) {}
+        }
+    });
+    harness.run("cas", "fetch_add", threads, [](int, std::int64_t n) {
+        for (std::int64_t i = 0; i < n; ++i) counter.fetch_add(1, std::memory_order_relaxed);
+    });
+}
+
+int main(int argc, char* argv[]) {
+    BenchHarness harness(BenchOptions::parse(argc, argv));
+    // one thread, and the most threads
+    std::vector<int> ends = {1};
+    if (harness.config().max_threads > 1) ends.push_back(harness.config().max_threads);
+
+    for (int threads : ends) {
+        orders<std::memory_order_relaxed>(harness, threads);
+        orders<std::memory_order_acquire>(harness, threads);
+        orders<std::memory_order_release>(harness, threads);
+        orders<std::memory_order_acq_rel>(harness, threads);
+        orders<std::memory_order_seq_cst>(harness, threads);
+    }
+
+    for (int threads : harness.thread_counts()) {
+        if (threads == 1) continue;
+        sharing<1>(harness, threads, "one cache line");
+        sharing<8>(harness, threads, "padded");
+    }
+
+    for (int threads : ends) {
+        lock_free<S8>(harness, threads, "S8");
+        lock_free<A>(harness, threads, "A");
+        lock_free<S32>(harness, threads, "S32");
+    }
+
+    for (int threads : harness.thread_counts()) cas(harness, threads);
+    return 0;
+}
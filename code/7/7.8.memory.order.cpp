@@ -10,30 +10,50 @@
 #include <atomic>
 #include <thread>
 #include <vector>
+#include <chrono>
+#include <algorithm>
 #include <iostream>
 
 using namespace std;
 using namespace std::chrono;
 
-const int N = 10000;
+const int N = 1000000;
 
-void relaxed_order() {
-    cout << "relaxed_order: " << endl;
-
-    atomic<int> counter = {0};
+// Runs `op` N times on each of a few threads and returns the nanoseconds
+// per call. The clock runs from the moment all threads are up until the
+// last one finished its loop, thread creation and joins are not timed.
+template <typename Op>
+double time_per_op(Op op) {
+    int threads = max(2u, thread::hardware_concurrency());
+    atomic<int> ready = {0}, running = {threads};
+    atomic<bool> go = {false};
+    steady_clock::time_point t2;
     vector<thread> vt;
-    for (int i = 0; i < N; ++i) {
+    for (int i = 0; i < threads; ++i) {
         vt.emplace_back([&](){
-            counter.fetch_add(1, memory_order_relaxed);
+            ready.fetch_add(1);
+            while (!go.load(memory_order_acquire)) this_thread::yield();
+            for (int j = 0; j < N; ++j) op();
+            if (running.fetch_sub(1) == 1) t2 = steady_clock::now();
         });
     }
-    auto t1 = high_resolution_clock::now();
+    while (ready.load() < threads) this_thread::yield();
+    auto t1 = steady_clock::now();
+    go.store(true, memory_order_release);
     for (auto& t : vt) {
         t.join();
     }
-    auto t2 = high_resolution_clock::now();
-    auto duration = ( t2 - t1 ).count();
-    cout << "relaxed order speed: " << duration / N << "ns" << endl;
+    return duration<double, nano>(t2 - t1).count() / (double(threads) * N);
+}
+
+void relaxed_order() {
+    cout << "relaxed_order: " << endl;
+
+    atomic<int> counter = {0};
+    double speed = time_per_op([&](){
+        counter.fetch_add(1, memory_order_relaxed);
+    });
+    cout << "relaxed order speed: " << speed << "ns, counter: " << counter << endl;
 }
 
 void release_consume_order() {
@@ -87,19 +107,10 @@ void sequential_consistent_order() {
     cout << "sequential_consistent_order: " << endl;
 
     atomic<int> counter = {0};
-    vector<thread> vt;
-    for (int i = 0; i < N; ++i) {
-        vt.emplace_back([&](){
-            counter.fetch_add(1, memory_order_seq_cst);
-        });
-    }
-    auto t1 = high_resolution_clock::now();
-    for (auto& t : vt) {
-        t.join();
-    }
-    auto t2 = high_resolution_clock::now();
-    auto duration = ( t2 - t1 ).count();
-    cout << "sequential consistent speed: " << duration / N << "ns" << endl;
+    double speed = time_per_op([&](){
+        counter.fetch_add(1, memory_order_seq_cst);
+    });
+    cout << "sequential consistent speed: " << speed << "ns, counter: " << counter << endl;
 }
 
 int main() {
@@ -0,0 +1,157 @@
+//
+// 7.8.sharded.counter.bench.cpp
+// chapter 7 parallelism and concurrency
+// modern c++ tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial
+//
+// The measurement of 7.8.memory.order.cpp, taken further: 1 to N threads
+// count into one shared atomic (relaxed and seq_cst, as in 7.8), into a
+// ShardedCounter, and into a thread local that is added to the total
+// once at the end. Then values are recorded into a histogram of shared
+// atomic buckets and into a StripedHistogram. Only the loops are timed,
+// from the moment every thread is up until the last one is done; the
+// totals are checked.
+//
+// usage: 7.8.sharded.counter.bench.out [--threads=N] [--operations=N]
+//        most threads, default: hardware threads, at least 2, operations
+//        per thread, default: 2000000
+//
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include "sharded.counter.hpp"
+#include "bench.harness.hpp"
+
+using clock_type = std::chrono::steady_clock;
+
+// per thread, set from the options
+static std::int64_t operations = 2000000;
+
+// nanoseconds per operation and thread, `op(thread, i)` is called
+// `operations` times on each thread, `done(thread)` once after that
+template <typename Op, typename Done>
+double measure(int threads, Op op, Done done) {
+    std::atomic<int> ready = {0}, running = {threads};
+    std::atomic<bool> go = {false};
+    clock_type::time_point finished;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            for (std::int64_t i = 0; i < operations; ++i) op(t, i);
+            done(t);
+            if (running.fetch_sub(1) == 1) finished = clock_type::now();
+        });
+    }
+    while (ready.load() < threads) std::this_thread::yield();
+    auto start = clock_type::now();
+    go.store(true, std::memory_order_release);
+    for (auto& w : workers) w.join();
+    return std::chrono::duration<double, std::nano>(finished - start).count() / operations;
+}
+
+template <typename Op>
+double measure(int threads, Op op) {
+    return measure(threads, op, [](int) {});
+}
+
+void check(bool ok, const char* what) {
+    if (!ok) {
+        std::cout << what << ": the total is wrong" << std::endl;
+        std::exit(1);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions defaults;
+    defaults.operations = operations;
+    BenchOptions options = BenchOptions::parse(argc, argv, defaults, {"--threads", "--operations"});
+    operations = options.operations;
+    int max_threads = options.max_threads;
+    std::vector<int> thread_counts;
+    for (int threads = 1; threads < max_threads; threads *= 2) thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+
+    std::cout << "nanoseconds per operation and thread, " << operations << " operations per thread, "
+              << std::thread::hardware_concurrency() << " hardware threads" << std::endl
+              << std::fixed << std::setprecision(2) << std::setw(20) << "threads";
+    for (int threads : thread_counts) std::cout << std::setw(10) << threads;
+    std::cout << std::endl;
+
+    auto row = [&](const char* name, auto run) {
+        std::cout << std::setw(20) << name;
+        for (int threads : thread_counts) std::cout << std::setw(10) << run(threads);
+        std::cout << std::endl;
+    };
+
+    row("atomic relaxed", [](int threads) {
+        std::atomic<std::int64_t> counter = {0};
+        double ns = measure(threads, [&](int, std::int64_t) { counter.fetch_add(1, std::memory_order_relaxed); });
+        check(counter.load() == std::int64_t(threads) * operations, "atomic relaxed");
+        return ns;
+    });
+    row("atomic seq_cst", [](int threads) {
+        std::atomic<std::int64_t> counter = {0};
+        double ns = measure(threads, [&](int, std::int64_t) { counter.fetch_add(1, std::memory_order_seq_cst); });
+        check(counter.load() == std::int64_t(threads) * operations, "atomic seq_cst");
+        return ns;
+    });
+    row("sharded", [](int threads) {
+        ShardedCounter counter;
+        double ns = measure(threads, [&](int, std::int64_t) { ++counter; });
+        check(counter.load() == std::int64_t(threads) * operations, "sharded");
+        return ns;
+    });
+    row("thread local", [](int threads) {
+        // a plain variable of each thread, added to the shared counter once
+        struct alignas(64) Local { std::int64_t value = 0; };
+        std::vector<Local> locals(threads);
+        std::atomic<std::int64_t> counter = {0};
+        double ns = measure(threads,
+            [&](int t, std::int64_t) {
+                ++locals[t].value;
+                // keeps the compiler from folding the loop into one addition
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+            },
+            [&](int t) { counter.fetch_add(locals[t].value, std::memory_order_relaxed); });
+        check(counter.load() == std::int64_t(threads) * operations, "thread local");
+        return ns;
+    });
+
+    std::cout << std::endl << std::setw(20) << "histogram";
+    for (int threads : thread_counts) std::cout << std::setw(10) << threads;
+    std::cout << std::endl;
+
+    row("shared buckets", [](int threads) {
+        // and a sum, as a StripedHistogram keeps
+        std::array<std::atomic<std::uint64_t>, StripedHistogram::bucket_count> buckets{};
+        std::atomic<std::uint64_t> sum = {0};
+        double ns = measure(threads, [&](int, std::int64_t i) {
+            buckets[StripedHistogram::bucket(i & 1023)].fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add(i & 1023, std::memory_order_relaxed);
+        });
+        std::uint64_t count = 0;
+        for (auto& b : buckets) count += b.load();
+        check(count == std::uint64_t(threads) * operations, "shared buckets");
+        return ns;
+    });
+    row("striped", [](int threads) {
+        StripedHistogram histogram;
+        double ns = measure(threads, [&](int, std::int64_t i) { histogram.record(i & 1023); });
+        check(histogram.snapshot().count == std::uint64_t(threads) * operations, "striped");
+        return ns;
+    });
+    return 0;
+}
@@ -0,0 +1,300 @@
+//
+// bench.harness.hpp
+// chapter 7 parallelism and concurrency
+// modern c++ tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial
+//
+
+#ifndef BENCH_HARNESS_HPP
+#define BENCH_HARNESS_HPP
+
+#include <cmath>
+#include <cerrno>
+#include <limits>
+#include <string>
+#include <vector>
+#include <initializer_list>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Microbenchmarks of the primitives of this chapter. A case runs a body
+// on a number of threads that are created once, pinned to CPUs, and
+// released together for every repetition; a repetition is timed from the
+// release until the last thread is done, so thread creation and joins
+// are not in the numbers, and is reported in nanoseconds per operation
+// of a thread. Warmup repetitions are run first and thrown away. The
+// repetitions of a case are summed up as median, p99, mean, standard
+// deviation and minimum, printed as a table, CSV or JSON; the latter two
+// name the compiler, for tracking results across compilers and versions.
+//
+// options: --csv, --json, --repetitions=N, --warmup=N, --operations=N
+//          (per thread and repetition), --threads=N (most threads of a
+//          case), --no-pin
+struct BenchOptions {
+    enum class Format { table, csv, json };
+
+    Format format = Format::table;
+    int repetitions = 21;
+    int warmup = 2;
+    std::int64_t operations = 1 << 20;
+    int max_threads = std::max(2u, std::thread::hardware_concurrency());
+    bool pin = true;
+
+    // all options, with the defaults above
+    static BenchOptions parse(int argc, char* argv[]) { return parse(argc, argv, BenchOptions(), {}); }
+
+    // Options that are not given keep their value in `defaults`. A program
+    // that reports results of its own names the options it reads in
+    // `accepted`, all others are refused; an empty list accepts all. A
+    // malformed or out of range value, or an unknown option, prints the
+    // usage and exits with 2.
+    static BenchOptions parse(int argc, char* argv[], BenchOptions defaults,
+                              std::initializer_list<const char*> accepted) {
+        struct Option { const char* name; const char* usage; };
+        static const Option all[] = {
+            {"--csv", "--csv"}, {"--json", "--json"}, {"--repetitions", "--repetitions=N"},
+            {"--warmup", "--warmup=N"}, {"--operations", "--operations=N"},
+            {"--threads", "--threads=N"}, {"--no-pin", "--no-pin"},
+        };
+        auto takes = [&](const std::string& name) {
+            if (accepted.size() == 0) return true;
+            for (const char* a : accepted)
+                if (name == a) return true;
+            return false;
+        };
+        auto fail = [&](const std::string& message) {
+            std::cerr << message << std::endl << "usage: " << argv[0];
+            for (const Option& option : all)
+                if (takes(option.name)) std::cerr << " [" << option.usage << "]";
+            std::cerr << std::endl;
+            std::exit(2);
+        };
+        // a whole number from `least` to `most` and nothing else
+        auto number = [&](const char* arg, const char* text, std::int64_t least, std::int64_t most) {
+            char* end = nullptr;
+            errno = 0;
+            long long n = std::strtoll(text, &end, 10);
+            if (end == text || *end != '\0' || errno == ERANGE || n < least || n > most)
+                fail(std::string(arg) + ": expected a whole number from " + std::to_string(least)
+                     + " to " + std::to_string(most));
+            return static_cast<std::int64_t>(n);
+        };
+        constexpr std::int64_t int_max = std::numeric_limits<int>::max();
+
+        BenchOptions options = defaults;
+        for (int i = 1; i < argc; ++i) {
+            const char* arg = argv[i];
+            const char* equals = std::strchr(arg, '=');
+            std::string name = equals ? std::string(arg, equals) : std::string(arg);
+            const char* v = equals ? equals + 1 : "";
+            if (!takes(name)) fail(std::string("unknown option ") + arg);
+
+            if (name == "--csv" && !equals) options.format = Format::csv;
+            else if (name == "--json" && !equals) options.format = Format::json;
+            else if (name == "--no-pin" && !equals) options.pin = false;
+            else if (name == "--repetitions") options.repetitions = int(number(arg, v, 1, int_max));
+            else if (name == "--warmup") options.warmup = int(number(arg, v, 0, int_max));
+            else if (name == "--operations")
+                options.operations = number(arg, v, 1, std::numeric_limits<std::int64_t>::max());
+            else if (name == "--threads") options.max_threads = int(number(arg, v, 1, int_max));
+            else fail(std::string("unknown option ") + arg);
+        }
+        return options;
+    }
+};
+
+class BenchHarness {
+public:
+    struct Result {
+        std::string group, name, note;
+        int threads;
+        double median, p99, mean, stddev, min;
+    };
+
+    explicit BenchHarness(BenchOptions options) : options(options) {}
+
+    const BenchOptions& config() const { return options; }
+
+    // 1, 2, 4, ... up to the most threads of a case
+    std::vector<int> thread_counts() const {
+        std::vector<int> counts;
+        for (int threads = 1; threads < options.max_threads; threads *= 2) counts.push_back(threads);
+        counts.push_back(options.max_threads);
+        return counts;
+    }
+
+    // Runs `body(thread, operations)` on `threads` threads, it is to do
+    // `operations` operations. `note` goes with the result, e.g. whether
+    // an atomic is lock free.
+    template <typename Body>
+    const Result& run(const std::string& group, const std::string& name, int threads, Body body,
+                      const std::string& note = "") {
+        std::atomic<int> round = {0}, finished = {0};
+        std::atomic<bool> quit = {false};
+        std::atomic<std::int64_t> last = {0};
+        const int rounds = options.warmup + options.repetitions;
+
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                pin(t);
+                for (int r = 1; r <= rounds; ++r) {
+                    while (round.load(std::memory_order_acquire) < r) {
+                        if (quit.load(std::memory_order_relaxed)) return;
+                        std::this_thread::yield();
+                    }
+                    body(t, options.operations);
+                    // every thread raises `last` to its end before it counts
+                    // itself finished, so the round's latest end is in place
+                    // once all have; the clock is monotonic, an earlier
+                    // round's value is always lower
+                    std::int64_t end = now();
+                    std::int64_t seen = last.load(std::memory_order_relaxed);
+                    while (seen < end && !last.compare_exchange_weak(seen, end, std::memory_order_relaxed)) {}
+                    finished.fetch_add(1, std::memory_order_release);
+                }
+            });
+        }
+
+        std::vector<double> samples;
+        for (int r = 1; r <= rounds; ++r) {
+            // let the threads of the last round get to the wait
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            std::int64_t start = now();
+            round.store(r, std::memory_order_release);
+            while (finished.load(std::memory_order_acquire) < threads * r) std::this_thread::yield();
+            if (r > options.warmup)
+                samples.push_back(double(last.load(std::memory_order_relaxed) - start) / options.operations);
+        }
+        quit.store(true);
+        for (auto& w : workers) w.join();
+
+        results.push_back(summarize(group, name, note, threads, samples));
+        print(results.back(), results.size() == 1);
+        return results.back();
+    }
+
+    // closes the JSON document
+    ~BenchHarness() {
+        if (options.format == BenchOptions::Format::json) std::cout << (results.empty() ? "" : "\n  ]\n}") << std::endl;
+    }
+
+private:
+    static std::int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // thread t to the t-th CPU the process may run on, round robin
+    void pin(int t) const {
+#if defined(__linux__)
+        if (!options.pin) return;
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+        if (cpus.empty()) return;
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpus[t % cpus.size()], &one);
+        pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+#else
+        (void)t;
+#endif
+    }
+
+    static Result summarize(const std::string& group, const std::string& name, const std::string& note,
+                            int threads, std::vector<double> samples) {
+        std::sort(samples.begin(), samples.end());
+        auto at = [&](double q) {
+            // nearest rank
+            std::size_t rank = static_cast<std::size_t>(std::ceil(q * samples.size()));
+            return samples[std::min(samples.size() - 1, rank ? rank - 1 : 0)];
+        };
+        double mean = 0;
+        for (double s : samples) mean += s;
+        mean /= samples.size();
+        double variance = 0;
+        for (double s : samples) variance += (s - mean) * (s - mean);
+        variance = samples.size() > 1 ? variance / (samples.size() - 1) : 0;
+        return Result{group, name, note, threads, at(0.5), at(0.99), mean, std::sqrt(variance), samples.front()};
+    }
+
+    static std::string compiler() {
+#if defined(__clang__)
+        return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+        return std::string("gcc ") + __VERSION__;
+#else
+        return "unknown";
+#endif
+    }
+
+    // strings of this program only, no escapes needed but quotes
+    static std::string quoted(const std::string& s) {
+        std::string out = "\"";
+        for (char c : s) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        return out + "\"";
+    }
+
+    void print(const Result& r, bool first) const {
+        std::ostream& out = std::cout;
+        out << std::fixed << std::setprecision(3);
+        switch (options.format) {
+        case BenchOptions::Format::table:
+            if (first)
+                out << "nanoseconds per operation and thread, " << options.repetitions << " repetitions of "
+                    << options.operations << " operations, " << compiler() << std::endl
+                    << std::left << std::setw(16) << "group" << std::setw(36) << "case" << std::right
+                    << std::setw(8) << "threads" << std::setw(10) << "median" << std::setw(10) << "p99"
+                    << std::setw(10) << "stddev" << "  note" << std::endl;
+            out << std::left << std::setw(16) << r.group << std::setw(36) << r.name << std::right
+                << std::setw(8) << r.threads << std::setw(10) << r.median << std::setw(10) << r.p99
+                << std::setw(10) << r.stddev << "  " << r.note << std::endl;
+            break;
+        case BenchOptions::Format::csv:
+            if (first)
+                out << "compiler,group,case,threads,repetitions,operations,median_ns,p99_ns,mean_ns,stddev_ns,min_ns,note\n";
+            out << quoted(compiler()) << ',' << r.group << ',' << quoted(r.name) << ',' << r.threads << ','
+                << options.repetitions << ',' << options.operations << ',' << r.median << ',' << r.p99 << ','
+                << r.mean << ',' << r.stddev << ',' << r.min << ',' << quoted(r.note) << std::endl;
+            break;
+        case BenchOptions::Format::json:
+            if (first)
+                out << "{\n  \"compiler\": " << quoted(compiler())
+                    << ",\n  \"hardware_threads\": " << std::thread::hardware_concurrency()
+                    << ",\n  \"repetitions\": " << options.repetitions
+                    << ",\n  \"operations\": " << options.operations << ",\n  \"results\": [\n";
+            else
+                out << ",\n";
+            out << "    {\"group\": " << quoted(r.group) << ", \"case\": " << quoted(r.name)
+                << ", \"threads\": " << r.threads << ", \"median_ns\": " << r.median << ", \"p99_ns\": " << r.p99
+                << ", \"mean_ns\": " << r.mean << ", \"stddev_ns\": " << r.stddev << ", \"min_ns\": " << r.min
+                << ", \"note\": " << quoted(r.note) << "}" << std::flush;
+            break;
+        }
+    }
+
+    BenchOptions options;
+    std::vector<Result> results;
+};
+
+#endif
@@ -0,0 +1,306 @@
+//
+// mpmc.queue.hpp
+// chapter 7 parallelism and concurrency
+// modern c++ tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial
+//
+
+#ifndef MPMC_QUEUE_HPP
+#define MPMC_QUEUE_HPP
+
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <new>
+#include <iterator>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// A bounded multi-producer multi-consumer queue after Dmitry Vyukov's
+// design. Every slot carries a sequence number that tells whose turn it
+// is: a producer may fill slot `pos % capacity` when its sequence is
+// `pos`, a consumer may empty it when it is `pos + 1`, and afterwards
+// sets it to `pos + capacity` for the producer of the next lap. Producers
+// and consumers only meet on the slot they hand over, a push or a pop is
+// one compare-and-swap on the tail or the head, which sit on cache lines
+// of their own, as every slot does.
+//
+// try_push/try_pop return at once, push/pop spin for a while and then
+// sleep in atomic::wait until the queue has room or items. The bulk
+// variants claim several consecutive slots with a single compare-and-swap.
+// close() wakes all sleepers, pop returns false once the queue is closed
+// and drained; nothing may be pushed after close().
+template <typename T>
+class MPMCQueue {
+    static_assert(std::is_nothrow_move_constructible_v<T> && std::is_nothrow_destructible_v<T>,
+                  "items are moved into and out of slots that must not be left half done");
+
+public:
+    static constexpr std::size_t cache_line = 64;
+
+    // capacity is rounded up to a power of two, at least 2
+    explicit MPMCQueue(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) size *= 2;
+        mask = size - 1;
+        slots = std::make_unique<Slot[]>(size);
+        for (std::size_t i = 0; i < size; ++i)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+    ~MPMCQueue() {
+        std::size_t tail = enqueue.position.load(std::memory_order_relaxed);
+        for (std::size_t pos = dequeue.position.load(std::memory_order_relaxed); pos != tail; ++pos)
+            std::launder(reinterpret_cast<T*>(slots[pos & mask].storage))->~T();
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+
+    // items in the queue a moment ago
+    std::size_t size() const {
+        std::size_t head = dequeue.position.load(std::memory_order_relaxed);
+        std::size_t tail = enqueue.position.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    template <typename... Args>
+    bool try_emplace(Args&&... args) {
+        std::size_t pos;
+        Slot* slot = claim(enqueue.position, 0, pos);
+        if (!slot) return false;
+        new (slot->storage) T(std::forward<Args>(args)...);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        not_empty.notify();
+        return true;
+    }
+
+    bool try_push(const T& item) { return try_emplace(item); }
+    bool try_push(T&& item) { return try_emplace(std::move(item)); }
+
+    bool try_pop(T& item) {
+        std::size_t pos;
+        Slot* slot = claim(dequeue.position, 1, pos);
+        if (!slot) return false;
+        take(*slot, item, pos);
+        not_full.notify();
+        return true;
+    }
+
+    // Moves up to `count` items from `first` and returns how many, these
+    // are consecutive in the queue.
+    template <typename Iterator>
+    std::size_t try_push_bulk(Iterator first, std::size_t count) {
+        std::size_t pos;
+        std::size_t claimed = claim_bulk(enqueue.position, 0, count, pos);
+        for (std::size_t i = 0; i < claimed; ++i, ++first) {
+            Slot& slot = slots[(pos + i) & mask];
+            new (slot.storage) T(std::move(*first));
+            slot.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        if (claimed) not_empty.notify();
+        return claimed;
+    }
+
+    // Takes up to `count` items to `out` and returns how many.
+    template <typename OutputIterator>
+    std::size_t try_pop_bulk(OutputIterator out, std::size_t count) {
+        std::size_t pos;
+        std::size_t claimed = claim_bulk(dequeue.position, 1, count, pos);
+        for (std::size_t i = 0; i < claimed; ++i, ++out)
+            take(slots[(pos + i) & mask], *out, pos + i);
+        if (claimed) not_full.notify();
+        return claimed;
+    }
+
+    void push(const T& item) {
+        not_full.wait_until([&] { return try_push(item); }, closed);
+    }
+    void push(T&& item) {
+        not_full.wait_until([&] { return try_push(std::move(item)); }, closed);
+    }
+
+    // false if the queue was closed and is empty
+    bool pop(T& item) {
+        return not_empty.wait_until([&] { return try_pop(item); }, closed) || try_pop(item);
+    }
+
+    template <typename Iterator>
+    void push_bulk(Iterator first, std::size_t count) {
+        while (count > 0) {
+            std::size_t pushed = 0;
+            not_full.wait_until([&] { return (pushed = try_push_bulk(first, count)) > 0; }, closed);
+            std::advance(first, pushed);
+            count -= pushed;
+        }
+    }
+
+    // waits for at least one item, 0 if the queue was closed and is empty
+    template <typename OutputIterator>
+    std::size_t pop_bulk(OutputIterator out, std::size_t count) {
+        std::size_t popped = 0;
+        if (not_empty.wait_until([&] { return (popped = try_pop_bulk(out, count)) > 0; }, closed))
+            return popped;
+        return try_pop_bulk(out, count);
+    }
+
+    void close() {
+        closed.store(true, std::memory_order_seq_cst);
+        not_empty.wake_all();
+        not_full.wake_all();
+    }
+
+private:
+    struct alignas(cache_line) Slot {
+        std::atomic<std::size_t> sequence{0};
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    struct alignas(cache_line) Position {
+        std::atomic<std::size_t> position{0};
+    };
+
+    // Sleeping producers or consumers. The other side bumps the epoch
+    // after an operation if somebody sleeps; the fence orders the slot that
+    // was handed over before the look at `sleepers`, and a sleeper counts
+    // itself before it tries once more, so either the sleeper sees the slot
+    // or the other side sees the sleeper. `woken` makes that one system
+    // call per round of sleep, not one per operation until the sleepers
+    // got to run, which on a busy machine takes thousands of them.
+    //
+    // A sleeper reads the epoch before it clears `woken`. A notify that
+    // finds `woken` set after that was preceded by one that set it and
+    // bumps the epoch past the value read, so the sleeper's wait returns;
+    // a notify that found it set before has published its slot in time for
+    // the attempt. Clearing first would let a sleeper read the epoch that an
+    // earlier wakeup left behind, lose the item of that wakeup to another
+    // thread and sleep on, while `woken` still swallows the next notify.
+    struct alignas(cache_line) Parking {
+        std::atomic<std::uint32_t> epoch{0};
+        std::atomic<std::uint32_t> sleepers{0};
+        std::atomic<bool> woken{false};
+
+        static void pause() {
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#elif defined(__aarch64__)
+            asm volatile("yield");
+#endif
+        }
+
+        // true once `attempt` succeeded, false if it did not and the queue is closed
+        template <typename Attempt>
+        bool wait_until(Attempt attempt, const std::atomic<bool>& closed) {
+            for (unsigned pauses = 1; pauses <= 256; pauses *= 2) {
+                if (attempt()) return true;
+                for (unsigned i = 0; i < pauses; ++i) pause();
+            }
+            // the other side may need this cpu to make progress
+            for (int i = 0; i < 4; ++i) {
+                if (attempt()) return true;
+                std::this_thread::yield();
+            }
+            sleepers.fetch_add(1, std::memory_order_seq_cst);
+            bool done;
+            for (;;) {
+                std::uint32_t current = epoch.load(std::memory_order_seq_cst);
+                woken.store(false, std::memory_order_seq_cst);
+                // pairs with the fence in notify, the attempt must not look
+                // at the slots before `woken` is cleared
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if ((done = attempt()) || closed.load(std::memory_order_seq_cst)) break;
+                epoch.wait(current, std::memory_order_seq_cst);
+            }
+            sleepers.fetch_sub(1, std::memory_order_relaxed);
+            return done;
+        }
+
+        void notify() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleepers.load(std::memory_order_relaxed) == 0) return;
+            if (woken.exchange(true, std::memory_order_seq_cst)) return;
+            wake_all();
+        }
+
+        void wake_all() {
+            epoch.fetch_add(1, std::memory_order_seq_cst);
+            epoch.notify_all();
+        }
+    };
+
+    // The slot at the position if it is ready for this side, whose turn
+    // is at sequence `pos + offset`, null if the queue is full or empty.
+    Slot* claim(std::atomic<std::size_t>& position, std::size_t offset, std::size_t& pos) {
+        pos = position.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[pos & mask];
+            std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::intptr_t>(sequence - (pos + offset));
+            if (difference == 0) {
+                if (position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    return &slot;
+            } else if (difference < 0) {
+                return nullptr;
+            } else {
+                // another thread took this position
+                pos = position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Like claim, for as many consecutive slots as are ready, up to `count`.
+    // A slot that is ready stays so until its position is claimed, the
+    // tail or head cannot move past it without the compare-and-swap failing.
+    std::size_t claim_bulk(std::atomic<std::size_t>& position, std::size_t offset,
+                           std::size_t count, std::size_t& pos) {
+        if (count == 0) return 0;
+        pos = position.load(std::memory_order_relaxed);
+        for (;;) {
+            std::size_t ready = 0;
+            std::intptr_t difference = 0;
+            while (ready < count) {
+                std::size_t sequence = slots[(pos + ready) & mask].sequence.load(std::memory_order_acquire);
+                difference = static_cast<std::intptr_t>(sequence - (pos + ready + offset));
+                if (difference != 0) break;
+                ++ready;
+            }
+            if (ready > 0) {
+                if (position.compare_exchange_weak(pos, pos + ready, std::memory_order_relaxed))
+                    return ready;
+            } else if (difference < 0) {
+                return 0;
+            } else {
+                pos = position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    template <typename Item>
+    void take(Slot& slot, Item&& item, std::size_t pos) {
+        T* stored = std::launder(reinterpret_cast<T*>(slot.storage));
+        item = std::move(*stored);
+        stored->~T();
+        slot.sequence.store(pos + mask + 1, std::memory_order_release);
+    }
+
+    std::unique_ptr<Slot[]> slots;
+    std::size_t mask;
+
+    Position enqueue;
+    Position dequeue;
+    Parking not_empty;
+    Parking not_full;
+    std::atomic<bool> closed{false};
+};
+
+#endif
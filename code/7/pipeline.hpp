@@ -0,0 +1,147 @@
+//
+// pipeline.hpp
+// chapter 7 parallelism and concurrency
+// modern c++ tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial
+//
+
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <memory>
+#include <vector>
+#include <thread>
+#include <utility>
+#include <iterator>
+#include <functional>
+#include <type_traits>
+
+#include "spsc.ring.hpp"
+
+// Stages that each run on a thread of their own, wired by SPSCRings:
+//
+//     auto pipeline = Pipeline<int>::build()
+//         .then([](int x) { return x * 2; })
+//         .then([](int x) { return std::to_string(x); })
+//         .sink([](std::string s) { std::cout << s << std::endl; });
+//     for (int i = 0; i < 10; ++i) pipeline.push(i);
+//     pipeline.close();   // waits until every item went through
+//
+// A stage takes whatever items are waiting, up to `batch`, transforms all
+// of them and hands them on at once, so the rings are touched once per
+// batch when the pipeline is busy, and items are not held back to fill
+// a batch when it is not. Items are pushed from one thread. A stage must
+// not throw, its thread would end the program.
+template <typename In>
+class Pipeline {
+    struct State;
+
+public:
+    struct Options {
+        // items each ring between two stages holds
+        std::size_t capacity = 1024;
+        // items a stage takes from its ring at most
+        std::size_t batch = 64;
+    };
+
+    template <typename Last>
+    class Builder {
+    public:
+        // a stage that turns every item into the result of `f`
+        template <typename F>
+        auto then(F f) && {
+            using Out = std::invoke_result_t<F&, Last>;
+            static_assert(!std::is_void_v<Out>, "the last stage is added with sink()");
+            auto out = std::make_shared<SPSCRing<Out>>(state->options.capacity);
+            state->stages.emplace_back([in = last, out, f = std::move(f), batch = state->options.batch]() mutable {
+                std::vector<Last> inputs;
+                std::vector<Out> outputs;
+                inputs.reserve(batch);
+                outputs.reserve(batch);
+                for (;;) {
+                    inputs.clear();
+                    if (in->pop_bulk(std::back_inserter(inputs), batch) == 0) break;
+                    outputs.clear();
+                    for (auto& item : inputs) outputs.push_back(f(std::move(item)));
+                    out->push_bulk(outputs.begin(), outputs.size());
+                }
+                out->close();
+            });
+            state->rings.push_back(out);
+            return Builder<Out>(std::move(state), std::move(out));
+        }
+
+        // the last stage, `f` takes every item; starts the threads
+        template <typename F>
+        Pipeline sink(F f) && {
+            state->stages.emplace_back([in = last, f = std::move(f), batch = state->options.batch]() mutable {
+                std::vector<Last> inputs;
+                inputs.reserve(batch);
+                for (;;) {
+                    inputs.clear();
+                    if (in->pop_bulk(std::back_inserter(inputs), batch) == 0) break;
+                    for (auto& item : inputs) f(std::move(item));
+                }
+            });
+            for (auto& stage : state->stages) state->threads.emplace_back(std::move(stage));
+            state->stages.clear();
+            return Pipeline(std::move(state));
+        }
+
+    private:
+        friend class Pipeline;
+        template <typename> friend class Builder;
+
+        Builder(std::unique_ptr<State> state, std::shared_ptr<SPSCRing<Last>> last)
+            : state(std::move(state)), last(std::move(last)) {}
+
+        std::unique_ptr<State> state;
+        std::shared_ptr<SPSCRing<Last>> last;
+    };
+
+    static Builder<In> build(Options options = Options()) {
+        auto state = std::make_unique<State>();
+        state->options = options;
+        state->input = std::make_shared<SPSCRing<In>>(options.capacity);
+        auto input = state->input;
+        return Builder<In>(std::move(state), std::move(input));
+    }
+
+    Pipeline(Pipeline&&) = default;
+    Pipeline& operator=(Pipeline&&) = delete;
+
+    ~Pipeline() {
+        if (state) close();
+    }
+
+    void push(In item) { state->input->push(std::move(item)); }
+
+    template <typename Iterator>
+    void push_bulk(Iterator first, std::size_t count) { state->input->push_bulk(first, count); }
+
+    // no more items, returns when every stage is done
+    void close() {
+        if (state->threads.empty()) return;
+        state->input->close();
+        for (auto& thread : state->threads) thread.join();
+        state->threads.clear();
+    }
+
+private:
+    struct State {
+        Options options;
+        std::shared_ptr<SPSCRing<In>> input;
+        // the rings after the first, type erased
+        std::vector<std::shared_ptr<void>> rings;
+        std::vector<std::function<void()>> stages;
+        std::vector<std::thread> threads;
+    };
+
+    explicit Pipeline(std::unique_ptr<State> state) : state(std::move(state)) {}
+
+    std::unique_ptr<State> state;
+};
+
+#endif
@@ -0,0 +1,176 @@
+//
+// sharded.counter.hpp
+// chapter 7 parallelism and concurrency
+// modern c++ tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial
+//
+
+#ifndef SHARDED_COUNTER_HPP
+#define SHARDED_COUNTER_HPP
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// A thread that touches a counter takes the lowest index no live thread
+// holds and gives it back when it exits. A thread with index k started
+// while k others were alive, so as long as no more threads than there are
+// shards run at once, no two of them share one, however many came and
+// went before. The lock is only taken when a thread starts and exits.
+inline std::size_t acquire_thread_index() {
+    struct Indices {
+        std::mutex mutex;
+        std::size_t next = 0;
+        // given back, the lowest on top
+        std::priority_queue<std::size_t, std::vector<std::size_t>, std::greater<std::size_t>> free;
+    };
+    // never destroyed, threads may exit after the static objects are gone
+    static Indices* indices = new Indices;
+
+    struct Holder {
+        std::size_t index;
+        Holder() {
+            std::lock_guard<std::mutex> lock(indices->mutex);
+            if (indices->free.empty()) {
+                index = indices->next++;
+            } else {
+                index = indices->free.top();
+                indices->free.pop();
+            }
+        }
+        ~Holder() {
+            std::lock_guard<std::mutex> lock(indices->mutex);
+            indices->free.push(index);
+        }
+    };
+    thread_local Holder holder;
+    return holder.index;
+}
+
+inline std::size_t thread_index() {
+    // constant initialized, unlike the holder it is read without a guard
+    thread_local std::size_t index = ~std::size_t(0);
+    if (index == ~std::size_t(0)) index = acquire_thread_index();
+    return index;
+}
+
+inline std::size_t round_up_power_of_two(std::size_t n) {
+    std::size_t power = 1;
+    while (power < n) power *= 2;
+    return power;
+}
+
+// shards for as many threads as the hardware runs at once
+inline std::size_t default_shards() {
+    return round_up_power_of_two(std::thread::hardware_concurrency());
+}
+
+// A counter for statistics that many threads bump and few read, as the
+// fetch_add of 7.8.memory.order.cpp on one shared atomic<int> is: there
+// every increment takes the cache line from the core that did the last
+// one. Here a thread adds to a slot of its own, on a cache line of its
+// own, which stays in its core's cache; a read adds the slots up and may
+// miss increments that are under way, as any read of a counter that is
+// being counted is.
+class ShardedCounter {
+public:
+    // shards are rounded up to a power of two
+    explicit ShardedCounter(std::size_t shards = default_shards())
+        : mask(round_up_power_of_two(shards) - 1), slots(std::make_unique<Slot[]>(mask + 1)) {}
+
+    void add(std::int64_t n = 1) {
+        // still atomic, threads beyond the number of shards share slots
+        slots[thread_index() & mask].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    ShardedCounter& operator++() { add(1); return *this; }
+    ShardedCounter& operator+=(std::int64_t n) { add(n); return *this; }
+
+    std::int64_t load() const {
+        std::int64_t sum = 0;
+        for (std::size_t i = 0; i <= mask; ++i) sum += slots[i].value.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    std::size_t shards() const { return mask + 1; }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<std::int64_t> value{0};
+    };
+
+    std::size_t mask;
+    std::unique_ptr<Slot[]> slots;
+};
+
+// A histogram with a bucket for each power of two, bucket b holds the
+// values below 2^b that are not in a lower one, the last also those
+// beyond. Like ShardedCounter it keeps a stripe of buckets for each
+// thread, on cache lines of its own; a snapshot adds them up.
+class StripedHistogram {
+public:
+    static constexpr std::size_t bucket_count = 48;
+
+    static std::size_t bucket(std::uint64_t value) {
+        std::size_t b = value ? 64 - __builtin_clzll(value) : 0;
+        return b < bucket_count ? b : bucket_count - 1;
+    }
+
+    // stripes are rounded up to a power of two
+    explicit StripedHistogram(std::size_t stripes = default_shards())
+        : mask(round_up_power_of_two(stripes) - 1), stripes(std::make_unique<Stripe[]>(mask + 1)) {}
+
+    void record(std::uint64_t value) {
+        Stripe& stripe = stripes[thread_index() & mask];
+        stripe.counts[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+        stripe.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    struct Snapshot {
+        std::array<std::uint64_t, bucket_count> counts{};
+        std::uint64_t count = 0, sum = 0;
+
+        // the upper bound of the bucket below which a fraction `q` of the values lie
+        std::uint64_t percentile(double q) const {
+            std::uint64_t rank = static_cast<std::uint64_t>(q * count), seen = 0;
+            for (std::size_t b = 0; b < bucket_count; ++b) {
+                seen += counts[b];
+                if (seen > rank) return b + 1 < bucket_count ? (std::uint64_t(1) << b) - 1 : ~std::uint64_t(0);
+            }
+            return 0;
+        }
+    };
+
+    Snapshot snapshot() const {
+        Snapshot total;
+        for (std::size_t s = 0; s <= mask; ++s) {
+            for (std::size_t b = 0; b < bucket_count; ++b) {
+                std::uint64_t n = stripes[s].counts[b].load(std::memory_order_relaxed);
+                total.counts[b] += n;
+                total.count += n;
+            }
+            total.sum += stripes[s].sum.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    struct alignas(64) Stripe {
+        std::array<std::atomic<std::uint64_t>, bucket_count> counts{};
+        std::atomic<std::uint64_t> sum{0};
+    };
+
+    std::size_t mask;
+    std::unique_ptr<Stripe[]> stripes;
+};
+
+#endif
@@ -0,0 +1,251 @@
+//
+// spsc.ring.hpp
+// chapter 7 parallelism and concurrency
+// modern c++ tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial
+//
+
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <new>
+#include <utility>
+#include <iterator>
+#include <cstddef>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// A ring buffer for exactly one producer and one consumer thread. The
+// producer alone writes the tail and the consumer alone the head, so a
+// push or a pop is a load and a store, no read-modify-write, and never
+// waits for the other side: the ring is wait-free.
+//
+// Each side also keeps a copy of the other side's index on its own cache
+// line and only reads the shared index when the copy says the ring is
+// full or empty. While the ring is neither, the producer does not touch
+// the consumer's line and the other way round, that is what keeps a
+// push or a pop at a few nanoseconds across cores.
+//
+// The try_ functions return at once. push/pop and their bulk variants
+// spin, yield and at last sleep in atomic::wait; a side that may sleep
+// has to be woken by the blocking functions of the other side, which
+// check for sleepers after they published, the try_ functions do not.
+template <typename T>
+class SPSCRing {
+    static_assert(std::is_nothrow_move_constructible_v<T> && std::is_nothrow_destructible_v<T>,
+                  "items are moved into and out of slots that must not be left half done");
+
+public:
+    static constexpr std::size_t cache_line = 64;
+
+    // capacity is rounded up to a power of two, at least 2
+    explicit SPSCRing(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) size *= 2;
+        mask = size - 1;
+        slots.reset(static_cast<Storage*>(::operator new(size * sizeof(Storage), std::align_val_t(alignof(Storage)))));
+    }
+
+    SPSCRing(const SPSCRing&) = delete;
+    SPSCRing& operator=(const SPSCRing&) = delete;
+
+    ~SPSCRing() {
+        std::size_t tail = producer.tail.load(std::memory_order_relaxed);
+        for (std::size_t pos = consumer.head.load(std::memory_order_relaxed); pos != tail; ++pos)
+            item(pos)->~T();
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+
+    // producer side
+
+    template <typename... Args>
+    bool try_emplace(Args&&... args) {
+        std::size_t tail = producer.tail.load(std::memory_order_relaxed);
+        if (tail - producer.head == capacity()) {
+            producer.head = consumer.head.load(std::memory_order_acquire);
+            if (tail - producer.head == capacity()) return false;
+        }
+        new (slot(tail)) T(std::forward<Args>(args)...);
+        producer.tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_push(const T& value) { return try_emplace(value); }
+    bool try_push(T&& value) { return try_emplace(std::move(value)); }
+
+    // Moves up to `count` items from `first`, published at once, and
+    // returns how many.
+    template <typename Iterator>
+    std::size_t try_push_bulk(Iterator first, std::size_t count) {
+        std::size_t tail = producer.tail.load(std::memory_order_relaxed);
+        std::size_t space = capacity() - (tail - producer.head);
+        if (space < count) {
+            producer.head = consumer.head.load(std::memory_order_acquire);
+            space = capacity() - (tail - producer.head);
+        }
+        if (count > space) count = space;
+        for (std::size_t i = 0; i < count; ++i, ++first)
+            new (slot(tail + i)) T(std::move(*first));
+        if (count) producer.tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    void push(T value) {
+        wait(producer_waits, [&] { return try_push(std::move(value)); });
+        wake(consumer_waits);
+    }
+
+    template <typename Iterator>
+    void push_bulk(Iterator first, std::size_t count) {
+        while (count > 0) {
+            std::size_t pushed = 0;
+            wait(producer_waits, [&] { return (pushed = try_push_bulk(first, count)) > 0; });
+            wake(consumer_waits);
+            std::advance(first, pushed);
+            count -= pushed;
+        }
+    }
+
+    // nothing is pushed after this, pop returns false once the ring is drained
+    void close() {
+        closed.store(true, std::memory_order_seq_cst);
+        wake(consumer_waits);
+    }
+
+    // consumer side
+
+    bool try_pop(T& value) {
+        std::size_t head = consumer.head.load(std::memory_order_relaxed);
+        if (head == consumer.tail) {
+            consumer.tail = producer.tail.load(std::memory_order_acquire);
+            if (head == consumer.tail) return false;
+        }
+        T* stored = item(head);
+        value = std::move(*stored);
+        stored->~T();
+        consumer.head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Takes up to `count` items to `out`, released at once, and returns how many.
+    template <typename OutputIterator>
+    std::size_t try_pop_bulk(OutputIterator out, std::size_t count) {
+        std::size_t head = consumer.head.load(std::memory_order_relaxed);
+        std::size_t available = consumer.tail - head;
+        if (available < count) {
+            consumer.tail = producer.tail.load(std::memory_order_acquire);
+            available = consumer.tail - head;
+        }
+        if (count > available) count = available;
+        for (std::size_t i = 0; i < count; ++i, ++out) {
+            T* stored = item(head + i);
+            *out = std::move(*stored);
+            stored->~T();
+        }
+        if (count) consumer.head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // false if the ring was closed and is empty
+    bool pop(T& value) {
+        bool popped = false;
+        wait(consumer_waits, [&] { return (popped = try_pop(value)) || drained(); });
+        if (popped) wake(producer_waits);
+        return popped;
+    }
+
+    // waits for at least one item, 0 if the ring was closed and is empty
+    template <typename OutputIterator>
+    std::size_t pop_bulk(OutputIterator out, std::size_t count) {
+        std::size_t popped = 0;
+        wait(consumer_waits, [&] { return (popped = try_pop_bulk(out, count)) > 0 || drained(); });
+        if (popped) wake(producer_waits);
+        return popped;
+    }
+
+private:
+    struct alignas(alignof(T)) Storage {
+        unsigned char bytes[sizeof(T)];
+    };
+
+    struct Delete {
+        void operator()(Storage* p) const { ::operator delete(p, std::align_val_t(alignof(Storage))); }
+    };
+
+    // the index a side writes, and its copy of the other side's
+    struct alignas(cache_line) Producer {
+        std::atomic<std::size_t> tail{0};
+        std::size_t head = 0;
+    };
+    struct alignas(cache_line) Consumer {
+        std::atomic<std::size_t> head{0};
+        std::size_t tail = 0;
+    };
+
+    static void pause() {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    void* slot(std::size_t pos) { return slots.get() + (pos & mask); }
+    T* item(std::size_t pos) { return std::launder(reinterpret_cast<T*>(slot(pos))); }
+
+    bool drained() {
+        return closed.load(std::memory_order_acquire)
+            && consumer.head.load(std::memory_order_relaxed) == producer.tail.load(std::memory_order_acquire);
+    }
+
+    // Retries `attempt` until it succeeds, sleeping on the flag of this
+    // side. The flag is raised before the last attempt and the other side
+    // looks at it after it moved its index, with a full fence in between
+    // on both sides, so one of them sees the other. The waker lowers the
+    // flag, which is what atomic::wait waits for.
+    template <typename Attempt>
+    void wait(std::atomic<bool>& sleeping, Attempt attempt) {
+        for (unsigned pauses = 1; pauses <= 256; pauses *= 2) {
+            if (attempt()) return;
+            for (unsigned i = 0; i < pauses; ++i) pause();
+        }
+        for (int i = 0; i < 4; ++i) {
+            if (attempt()) return;
+            std::this_thread::yield();
+        }
+        for (;;) {
+            sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (attempt()) break;
+            sleeping.wait(true, std::memory_order_acquire);
+        }
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    void wake(std::atomic<bool>& sleeping) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed) && sleeping.exchange(false, std::memory_order_release))
+            sleeping.notify_one();
+    }
+
+    std::unique_ptr<Storage[], Delete> slots;
+    std::size_t mask;
+
+    Producer producer;
+    Consumer consumer;
+    // raised by a producer waiting for space, by a consumer waiting for items
+    alignas(cache_line) std::atomic<bool> producer_waits{false};
+    alignas(cache_line) std::atomic<bool> consumer_waits{false};
+    std::atomic<bool> closed{false};
+};
+
+#endif
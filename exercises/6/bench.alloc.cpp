@@ -0,0 +1,122 @@
+//
+// bench_alloc.cpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// heap allocations per request made by the server, counted by replacing
+// the global allocation functions. Only the thread that runs the server
+// counts, the client is excluded. Requests go over one keep-alive
+// connection to a handler with a fixed response, a regex route and a
+// cached file.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+
+#include <unistd.h>
+
+#include "server.http.hpp"
+#include "static.files.hpp"
+#include "bench.client.hpp"
+
+static std::atomic<size_t> allocations{0};
+static thread_local bool counting = false;
+
+// every allocation function is replaced, so array and over-aligned
+// allocations count too; the nothrow forms call these ones
+static void* counted_alloc(std::size_t size, std::size_t align = 0) {
+    if(counting)
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    size = size ? size : 1;
+    // aligned_alloc wants the size to be a multiple of the alignment
+    void* p = align ? std::aligned_alloc(align, (size + align - 1) / align * align) : std::malloc(size);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void* operator new(std::size_t size, std::align_val_t align) { return counted_alloc(size, std::size_t(align)); }
+void* operator new[](std::size_t size, std::align_val_t align) { return counted_alloc(size, std::size_t(align)); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+using namespace Web;
+
+// allocations per request after `warmup` requests
+double measure(unsigned short port, const std::string& path, int requests, int warmup = 100) {
+    int fd = bench::connect_to(port);
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\nUser-Agent: bench\r\nAccept: */*\r\n\r\n";
+    std::string buffer;
+    bench::Reply reply;
+
+    size_t before = 0;
+    for(int i = 0; i < warmup + requests; ++i) {
+        if(i == warmup)
+            before = allocations.load();
+        if(!bench::send_all(fd, request) || !bench::read_reply(fd, buffer, reply) || reply.status != 200) {
+            std::cout << "request for " << path << " failed" << std::endl;
+            std::exit(1);
+        }
+    }
+    ::close(fd);
+    return double(allocations.load() - before) / requests;
+}
+
+int main() {
+    char directory[] = "/tmp/bench.alloc.XXXXXX";
+    if(!::mkdtemp(directory)) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    std::string root = directory;
+    std::ofstream(root + "/index.html") << "<html><body>Hello world in index.html.</body></html>\n";
+
+    Server<HTTP> server(0, 1);
+    StaticFiles files(server.compression, 1024, std::chrono::seconds(1), std::make_shared<ResponseCache>());
+
+    server.resource["^/fixed/?$"]["GET"] = [](std::ostream& response, Request& request) {
+        response << "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello";
+    };
+    server.resource["^/match/([0-9a-zA-Z]+)/?$"]["GET"] = [](std::ostream& response, Request& request) {
+        std::string_view number = request.path_match[1];
+        response << "HTTP/1.1 200 OK\r\nContent-Length: " << number.length() << "\r\n\r\n" << number;
+    };
+    server.default_resource["^/?(.*)$"]["GET"] = [&](Response& response, Request& request) {
+        if(!files.serve(response, request, root + "/" + request.path_match.str(1)))
+            response << "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    };
+
+    std::thread thread([&] {
+        counting = true;
+        server.start();
+    });
+
+    const int requests = 20000;
+    std::cout << std::fixed << std::setprecision(2);
+    for(const char* path: {"/fixed", "/match/abc123", "/index.html"})
+        std::cout << std::setw(16) << path << std::setw(10) << measure(server.port(), path, requests)
+                  << " allocations per request" << std::endl;
+
+    server.stop();
+    thread.join();
+    std::remove((root + "/index.html").c_str());
+    ::rmdir(directory);
+    return 0;
+}
@@ -0,0 +1,112 @@
+//
+// bench_client.hpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// a minimal blocking HTTP/1.1 client over POSIX sockets for the benchmarks
+//
+
+#ifndef BENCH_CLIENT_HPP
+#define BENCH_CLIENT_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <cstdlib>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+namespace bench {
+    // a connection to 127.0.0.1:port, -1 on failure
+    inline int connect_to(unsigned short port) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if(fd < 0)
+            return -1;
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    inline bool send_all(int fd, std::string_view data) {
+        while(!data.empty()) {
+            ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if(n <= 0)
+                return false;
+            data.remove_prefix(n);
+        }
+        return true;
+    }
+
+    struct Reply {
+        int status = 0;
+        uint64_t length = 0;
+        // status line and header
+        std::string head;
+        // the body, if it was asked for
+        std::string body;
+
+        // value of a header field, names as sent by our server
+        std::string_view header(std::string_view name) const {
+            size_t pos = head.find(std::string("\r\n").append(name).append(": "));
+            if(pos == std::string::npos)
+                return {};
+            pos += name.size() + 4;
+            return std::string_view(head).substr(pos, head.find("\r\n", pos) - pos);
+        }
+    };
+
+    // Read one response with a Content-Length. `buffer` holds bytes that
+    // were received but not consumed yet, e.g. of pipelined responses.
+    // The body is kept in reply.body if `keep_body` is set, else only counted.
+    inline bool read_reply(int fd, std::string& buffer, Reply& reply, bool keep_body = false) {
+        static thread_local std::vector<char> scratch(256 * 1024);
+
+        size_t end;
+        while((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = ::recv(fd, scratch.data(), scratch.size(), 0);
+            if(n <= 0)
+                return false;
+            buffer.append(scratch.data(), n);
+        }
+        reply.head.assign(buffer, 0, end + 2);
+        buffer.erase(0, end + 4);
+        reply.status = std::atoi(reply.head.c_str() + 9);
+        reply.length = std::strtoull(std::string(reply.header("Content-Length")).c_str(), nullptr, 10);
+        reply.body.clear();
+
+        uint64_t remaining = reply.length;
+        size_t available = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+        if(keep_body)
+            reply.body.append(buffer, 0, available);
+        buffer.erase(0, available);
+        remaining -= available;
+
+        while(remaining > 0) {
+            ssize_t n = ::recv(fd, scratch.data(), std::min<uint64_t>(scratch.size(), remaining), 0);
+            if(n <= 0)
+                return false;
+            if(keep_body)
+                reply.body.append(scratch.data(), n);
+            remaining -= n;
+        }
+        return true;
+    }
+}
+#endif /* BENCH_CLIENT_HPP */
@@ -0,0 +1,212 @@
+//
+// bench_compression.cpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// requests per second and bytes on the wire for a set of typical assets,
+// the book's chapters as HTML pages, the website's stylesheets and
+// scripts, and a few files below the minimum size. Static files are
+// served from the response cache as they are, gzip compressed once in
+// the cache, and from precompressed .gz siblings with sendfile(2); a
+// dynamic resource writes the same contents to the stream, compressed
+// for every request at levels 1, 6 and 9. Every compressed response is
+// checked to inflate to the file.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+
+#include <unistd.h>
+#include <zlib.h>
+
+#include "server.http.hpp"
+#include "static.files.hpp"
+#include "bench.client.hpp"
+
+using namespace Web;
+
+struct Asset {
+    std::string name, content;
+};
+
+std::string read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+// the assets, taken from the repository
+std::vector<Asset> make_assets() {
+    const std::string book = "../../book/en-us/", theme = "../../website/themes/moderncpp/source/modern-cpp/";
+    std::vector<Asset> assets;
+    for(const char* chapter: {"02-usability", "03-runtime", "07-thread", "10-cpp20"}) {
+        std::string text = read_file(book + chapter + ".md");
+        assets.push_back({std::string(chapter) + ".html",
+                          "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><link rel=\"stylesheet\" href=\"style.css\">"
+                          "</head>\n<body><article>\n" + text + "</article><script src=\"common.js\"></script></body></html>\n"});
+    }
+    std::string css;
+    for(const char* sheet: {"_settings", "_syntax", "_sidebar", "_header", "_common", "index", "page"})
+        css += read_file(theme + "css/" + sheet + ".styl");
+    assets.push_back({"style.css", css});
+    assets.push_back({"common.js", read_file(theme + "js/common.js")});
+    assets.push_back({"install.js", read_file("../../website/install.js")});
+    assets.push_back({"en.svg", read_file("../../website/src/modern-cpp/assets/lang/en.svg")});
+    for(auto& asset: assets) {
+        if(asset.content.empty()) {
+            std::cout << "missing the content of " << asset.name << std::endl;
+            std::exit(1);
+        }
+    }
+    return assets;
+}
+
+bool inflate_gzip(const std::string& data, std::string& out) {
+    z_stream stream{};
+    if(inflateInit2(&stream, 15 + 16) != Z_OK)
+        return false;
+    out.resize(data.size() * 20 + 1024);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = static_cast<uInt>(out.size());
+    int result = inflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    inflateEnd(&stream);
+    return result == Z_STREAM_END;
+}
+
+void measure(const char* name, Server<HTTP>& server, const std::vector<Asset>& assets,
+             const std::string& prefix, bool accept_gzip, double seconds) {
+    std::thread thread([&] { server.start(); });
+    int fd = bench::connect_to(server.port());
+    std::string buffer, inflated;
+    bench::Reply reply;
+
+    std::vector<std::string> requests;
+    for(auto& asset: assets)
+        requests.push_back("GET " + prefix + asset.name + " HTTP/1.1\r\nHost: localhost\r\n"
+                           + (accept_gzip ? "Accept-Encoding: gzip, deflate, br\r\n" : "") + "\r\n");
+
+    uint64_t done = 0, wire = 0, content = 0, passes = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+    while(elapsed.count() < seconds) {
+        for(size_t i = 0; i < assets.size(); ++i) {
+            // the first pass checks the contents
+            bool check = passes == 0;
+            if(!bench::send_all(fd, requests[i]) || !bench::read_reply(fd, buffer, reply, check) || reply.status != 200) {
+                std::cout << name << ": request for " << assets[i].name << " failed" << std::endl;
+                std::exit(1);
+            }
+            bool gzipped = reply.header("Content-Encoding") == "gzip";
+            if(check && (gzipped ? !inflate_gzip(reply.body, inflated) || inflated != assets[i].content
+                                 : reply.body != assets[i].content)) {
+                std::cout << name << ": " << assets[i].name << " differs" << std::endl;
+                std::exit(1);
+            }
+            wire += reply.head.size() + 2 + reply.length;
+            content += assets[i].content.size();
+            ++done;
+        }
+        ++passes;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    ::close(fd);
+    server.stop();
+    thread.join();
+
+    std::cout << std::setw(30) << name << std::setw(10) << done / elapsed.count() << " req/s"
+              << std::setw(10) << content / elapsed.count() / (1 << 20) << " MB/s of content"
+              << std::setw(10) << wire / passes << " bytes per set"
+              << std::setw(8) << std::setprecision(2) << double(content) / wire << std::setprecision(0) << "x smaller"
+              << std::endl;
+}
+
+int main() {
+    auto assets = make_assets();
+    char directory[] = "/tmp/bench.compression.XXXXXX";
+    if(!::mkdtemp(directory)) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    const std::string root = std::string(directory) + "/";
+    uint64_t total = 0;
+    for(auto& asset: assets) {
+        std::ofstream(root + asset.name, std::ios::binary) << asset.content;
+        total += asset.content.size();
+    }
+    std::cout << assets.size() << " assets, " << total << " bytes" << std::endl << std::fixed << std::setprecision(0);
+
+    const double seconds = 2;
+    auto static_server = [&](Server<HTTP>& server) {
+        auto files = std::make_shared<StaticFiles>(server.compression, 1024, std::chrono::seconds(1), std::make_shared<ResponseCache>());
+        server.default_resource["^/(.*)$"]["GET"] = [files, root](Response& response, Request& request) {
+            if(!files->serve(response, request, root + request.path_match.str(1)))
+                response << "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        };
+    };
+    auto dynamic_server = [&](Server<HTTP>& server, int level) {
+        server.compression.level = level;
+        std::map<std::string, std::string> contents;
+        for(auto& asset: assets)
+            contents[asset.name] = asset.content;
+        server.resource["^/dynamic/(.*)$"]["GET"] = [contents](Response& response, Request& request) {
+            auto& content = contents.at(request.path_match.str(1));
+            response << "HTTP/1.1 200 OK\r\nContent-Length: " << content.size() << "\r\n\r\n" << content;
+        };
+    };
+
+    {
+        Server<HTTP> server(0, 1);
+        static_server(server);
+        measure("static, identity", server, assets, "/", false, seconds);
+    }
+    {
+        Server<HTTP> server(0, 1);
+        static_server(server);
+        measure("static, gzip in the cache", server, assets, "/", true, seconds);
+    }
+
+    // siblings at level 9, written before the server sees the files
+    for(auto& asset: assets) {
+        std::string compressed;
+        if(asset.content.size() >= Compression().min_size && gzip(asset.content, compressed, 9))
+            std::ofstream(root + asset.name + ".gz", std::ios::binary) << compressed;
+    }
+    {
+        Server<HTTP> server(0, 1);
+        static_server(server);
+        measure("static, precompressed .gz", server, assets, "/", true, seconds);
+    }
+
+    {
+        Server<HTTP> server(0, 1);
+        dynamic_server(server, 0);
+        measure("dynamic, identity", server, assets, "/dynamic/", true, seconds);
+    }
+    for(int level: {1, 6, 9}) {
+        Server<HTTP> server(0, 1);
+        dynamic_server(server, level);
+        std::string name = "dynamic, gzip level " + std::to_string(level);
+        measure(name.c_str(), server, assets, "/dynamic/", true, seconds);
+    }
+
+    for(auto& asset: assets) {
+        std::remove((root + asset.name).c_str());
+        std::remove((root + asset.name + ".gz").c_str());
+    }
+    ::rmdir(directory);
+    return 0;
+}
@@ -0,0 +1,88 @@
+//
+// bench_coroutine.cpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// handlers that take 10 ms, e.g. waiting for a backend, on a server with
+// 2 threads and 64 connections with a request in flight each. A callback
+// handler blocks its thread while it waits, no more than 2 requests are
+// served at a time; a coroutine handler waits on a timer and leaves the
+// thread to the other connections. The concurrency is the number of
+// requests being served at once, requests/s times 10 ms.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "server.http.hpp"
+#include "coroutine.handler.hpp"
+#include "bench.client.hpp"
+
+using namespace Web;
+
+const auto delay = std::chrono::milliseconds(10);
+
+void measure(const char* name, const std::string& path, size_t threads, int connections, double seconds) {
+    Server<HTTP> server(0, threads);
+    server.resource["^/blocking$"]["GET"] = [](Response& response, Request& request) {
+        std::this_thread::sleep_for(delay);
+        response << "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+    };
+    server.resource["^/coroutine$"]["GET"] = coroutine([](Response& response, Request& request) -> boost::asio::awaitable<void> {
+        boost::asio::steady_timer timer(response.get_executor(), delay);
+        co_await timer.async_wait(boost::asio::use_awaitable);
+        response << "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+    });
+    std::thread thread([&] { server.start(); });
+
+    std::vector<int> fds;
+    std::vector<std::string> buffers(connections);
+    for(int i = 0; i < connections; ++i)
+        fds.push_back(bench::connect_to(server.port()));
+    const std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    bench::Reply reply;
+
+    uint64_t done = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+    while(elapsed.count() < seconds) {
+        // one request in flight on every connection
+        for(int fd: fds) {
+            if(fd < 0 || !bench::send_all(fd, request)) {
+                std::cout << name << ": send failed" << std::endl;
+                std::exit(1);
+            }
+        }
+        for(int i = 0; i < connections; ++i) {
+            if(!bench::read_reply(fds[i], buffers[i], reply) || reply.status != 200) {
+                std::cout << name << ": request failed" << std::endl;
+                std::exit(1);
+            }
+        }
+        done += connections;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    for(int fd: fds)
+        ::close(fd);
+    server.stop();
+    thread.join();
+
+    double rate = done / elapsed.count();
+    std::cout << std::setw(12) << name << std::setw(12) << rate << " req/s"
+              << std::setw(10) << rate * std::chrono::duration<double>(delay).count() << " concurrent" << std::endl;
+}
+
+int main() {
+    std::cout << std::fixed << std::setprecision(1);
+    measure("callback", "/blocking", 2, 64, 3);
+    measure("coroutine", "/coroutine", 2, 64, 3);
+    return 0;
+}
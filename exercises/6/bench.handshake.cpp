@@ -0,0 +1,257 @@
+//
+// bench_handshake.cpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// TLS handshakes per second of Server<HTTPS>, every connection sends one
+// request, for full handshakes and for sessions resumed with a ticket or
+// from the session cache, with TLS 1.3 and 1.2. Then the latency of
+// requests on a keep-alive connection while other clients keep opening
+// connections, with the handshakes on the io thread and on a pool.
+// A self-signed RSA 2048 certificate is generated in a temporary directory.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/rsa.h>
+
+#include "server.https.hpp"
+#include "bench.client.hpp"
+
+using namespace Web;
+
+// write a key and a self-signed certificate for localhost
+bool make_certificate(const std::string& cert_file, const std::string& key_file) {
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+    bool ok = kctx && EVP_PKEY_keygen_init(kctx) > 0 && EVP_PKEY_CTX_set_rsa_keygen_bits(kctx, 2048) > 0
+              && EVP_PKEY_keygen(kctx, &key) > 0;
+    EVP_PKEY_CTX_free(kctx);
+
+    X509* cert = X509_new();
+    if(ok) {
+        X509_set_version(cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+        X509_set_pubkey(cert, key);
+        X509_NAME* name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+        ok = X509_sign(cert, key, EVP_sha256()) > 0;
+    }
+
+    FILE* f;
+    if(ok && (ok = (f = std::fopen(key_file.c_str(), "w")) != nullptr)) {
+        ok = PEM_write_PrivateKey(f, key, nullptr, nullptr, 0, nullptr, nullptr) > 0;
+        std::fclose(f);
+    }
+    if(ok && (ok = (f = std::fopen(cert_file.c_str(), "w")) != nullptr)) {
+        ok = PEM_write_X509(f, cert) > 0;
+        std::fclose(f);
+    }
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ok;
+}
+
+// a TLS client connection with one request, `session` is resumed if given and replaced by the new one
+bool request(SSL_CTX* ctx, unsigned short port, SSL_SESSION** session, bool& resumed) {
+    int fd = bench::connect_to(port);
+    if(fd < 0)
+        return false;
+    SSL* ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    if(session && *session)
+        SSL_set_session(ssl, *session);
+
+    static const char get[] = "GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    bool ok = SSL_connect(ssl) == 1 && SSL_write(ssl, get, sizeof(get) - 1) == sizeof(get) - 1;
+    std::string reply;
+    char buffer[1024];
+    while(ok && (reply.size() < 4 || reply.compare(reply.size() - 4, 4, "\r\nok") != 0)) {
+        int n = SSL_read(ssl, buffer, sizeof(buffer));
+        ok = n > 0;
+        if(ok)
+            reply.append(buffer, n);
+    }
+    resumed = SSL_session_reused(ssl);
+    // a TLS 1.3 ticket arrives after the handshake, it has been read with the response
+    if(ok && session) {
+        if(*session)
+            SSL_SESSION_free(*session);
+        *session = SSL_get1_session(ssl);
+    }
+    // without close_notify the client would not resume the session
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    ::close(fd);
+    return ok;
+}
+
+SSL_CTX* client_context(int version, bool tickets) {
+    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_min_proto_version(ctx, version);
+    SSL_CTX_set_max_proto_version(ctx, version);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT);
+    if(!tickets)
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    return ctx;
+}
+
+void add_resource(Server<HTTPS>& server) {
+    server.resource["^/hello$"]["GET"] = [](Response& response, Request& request) {
+        response << "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+    };
+}
+
+void handshake_rate(const std::string& cert, const std::string& key, const char* name,
+                    int version, bool resume, bool tickets, double seconds) {
+    Server<HTTPS> server(0, 1, cert, key);
+    add_resource(server);
+    std::thread thread([&] { server.start(); });
+
+    SSL_CTX* ctx = client_context(version, tickets);
+    const int clients = 2;
+    std::atomic<bool> running{true};
+    std::atomic<uint64_t> total{0}, reused{0}, failed{0};
+    std::vector<std::thread> threads;
+    for(int t = 0; t < clients; ++t) {
+        threads.emplace_back([&] {
+            SSL_SESSION* session = nullptr;
+            uint64_t done = 0, resumed_count = 0;
+            while(running.load(std::memory_order_relaxed)) {
+                bool resumed = false;
+                if(!request(ctx, server.port(), resume ? &session : nullptr, resumed)) {
+                    failed.fetch_add(1);
+                    break;
+                }
+                ++done;
+                resumed_count += resumed;
+            }
+            if(session)
+                SSL_SESSION_free(session);
+            total.fetch_add(done);
+            reused.fetch_add(resumed_count);
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    running = false;
+    for(auto& t: threads)
+        t.join();
+    SSL_CTX_free(ctx);
+    server.stop();
+    thread.join();
+
+    std::cout << std::setw(28) << name << std::setw(10) << total.load() / seconds << " handshakes/s"
+              << std::setw(8) << 100.0 * reused.load() / std::max<uint64_t>(total.load(), 1) << "% resumed"
+              << (failed.load() ? "  failed" : "") << std::endl;
+}
+
+// p50 and p99 of requests on a keep-alive connection while 4 clients make full handshakes
+void offload(const std::string& cert, const std::string& key, size_t handshake_threads, double seconds) {
+    Server<HTTPS> server(0, 1, cert, key);
+    server.handshake_threads = handshake_threads;
+    add_resource(server);
+    std::thread thread([&] { server.start(); });
+
+    SSL_CTX* ctx = client_context(TLS1_3_VERSION, false);
+    std::atomic<bool> running{true};
+    std::atomic<uint64_t> handshakes{0};
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            bool resumed;
+            while(running.load(std::memory_order_relaxed) && request(ctx, server.port(), nullptr, resumed))
+                handshakes.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    // the keep-alive connection
+    int fd = bench::connect_to(server.port());
+    SSL* ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    std::vector<double> latencies;
+    if(SSL_connect(ssl) == 1) {
+        static const char get[] = "GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        char buffer[1024];
+        auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+        while(std::chrono::steady_clock::now() < end) {
+            auto start = std::chrono::steady_clock::now();
+            if(SSL_write(ssl, get, sizeof(get) - 1) <= 0)
+                break;
+            std::string reply;
+            while(reply.size() < 4 || reply.compare(reply.size() - 4, 4, "\r\nok") != 0) {
+                int n = SSL_read(ssl, buffer, sizeof(buffer));
+                if(n <= 0)
+                    break;
+                reply.append(buffer, n);
+            }
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    SSL_free(ssl);
+    ::close(fd);
+
+    running = false;
+    for(auto& t: threads)
+        t.join();
+    SSL_CTX_free(ctx);
+    server.stop();
+    thread.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))];
+    };
+    std::cout << std::setw(28) << (handshake_threads ? "handshakes on a pool of 2" : "handshakes on the io thread")
+              << std::setw(10) << handshakes.load() / seconds << " handshakes/s"
+              << std::setw(10) << percentile(0.5) << " us p50" << std::setw(10) << percentile(0.99) << " us p99"
+              << std::endl;
+}
+
+int main() {
+    char directory[] = "/tmp/bench.handshake.XXXXXX";
+    if(!::mkdtemp(directory)) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    std::string cert = std::string(directory) + "/server.crt", key = std::string(directory) + "/server.key";
+    if(!make_certificate(cert, key)) {
+        ERR_print_errors_fp(stderr);
+        return 1;
+    }
+
+    const double seconds = 2;
+    std::cout << std::thread::hardware_concurrency() << " cores" << std::endl << std::fixed << std::setprecision(0);
+    handshake_rate(cert, key, "TLS 1.3 full", TLS1_3_VERSION, false, true, seconds);
+    handshake_rate(cert, key, "TLS 1.3 resumed, ticket", TLS1_3_VERSION, true, true, seconds);
+    handshake_rate(cert, key, "TLS 1.2 full", TLS1_2_VERSION, false, true, seconds);
+    handshake_rate(cert, key, "TLS 1.2 resumed, ticket", TLS1_2_VERSION, true, true, seconds);
+    handshake_rate(cert, key, "TLS 1.2 resumed, cache", TLS1_2_VERSION, true, false, seconds);
+
+    offload(cert, key, 0, seconds);
+    offload(cert, key, 2, seconds);
+
+    std::remove(cert.c_str());
+    std::remove(key.c_str());
+    ::rmdir(directory);
+    return 0;
+}
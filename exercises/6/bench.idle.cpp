@@ -0,0 +1,262 @@
+//
+// bench_idle.cpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// the memory a connection costs while it is idle, for thousands of open
+// connections, before and after they sent a request. Then the limits:
+// idle keep-alive connections and clients that dribble a header byte by
+// byte are closed after their timeout, a server at max_connections does
+// not accept more until a connection closed, and a too large head is
+// answered with 431. Exits with 1 if a check fails.
+//
+// usage: bench.idle [connections, default: 10000, fewer if descriptors are short]
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+
+#include <poll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "server.http.hpp"
+#include "bench.client.hpp"
+
+using namespace Web;
+
+static const std::string get = "GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+// resident memory now in bytes
+uint64_t rss() {
+    long pages = 0, resident = 0;
+    if(FILE* f = std::fopen("/proc/self/statm", "r")) {
+        if(std::fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        std::fclose(f);
+    }
+    return static_cast<uint64_t>(resident) * ::sysconf(_SC_PAGESIZE);
+}
+
+// as many descriptors as allowed, client and server end of a connection need one each
+size_t raise_fd_limit() {
+    rlimit limit;
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    return limit.rlim_cur;
+}
+
+void fail(const std::string& message) {
+    std::cout << "failed: " << message << std::endl;
+    std::exit(1);
+}
+
+void run(Server<HTTP>& server, std::thread& thread) {
+    server.resource["^/hello$"]["GET"] = [](Response& response, Request& request) {
+        response << "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+    };
+    thread = std::thread([&] { server.start(); });
+}
+
+void finish(Server<HTTP>& server, std::thread& thread, std::vector<int>& fds) {
+    for(int fd: fds)
+        ::close(fd);
+    fds.clear();
+    server.stop();
+    thread.join();
+}
+
+std::vector<int> connect_all(unsigned short port, size_t count) {
+    std::vector<int> fds;
+    for(size_t i = 0; i < count; ++i) {
+        int fd = bench::connect_to(port);
+        if(fd < 0)
+            fail("connect");
+        fds.push_back(fd);
+    }
+    return fds;
+}
+
+// wait until the server sees `count` connections
+void wait_for(Server<HTTP>& server, uint64_t count) {
+    for(int i = 0; i < 1000 && server.stats().connections != count; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if(server.stats().connections != count)
+        fail("the server has " + std::to_string(server.stats().connections) + " connections, not " + std::to_string(count));
+}
+
+// Seconds until the server closed every connection, a byte is sent on
+// each open one every 100 ms if `dribble` is set; -1 after `limit` seconds.
+double until_closed(std::vector<int>& fds, bool dribble, double limit) {
+    std::vector<pollfd> polls;
+    for(int fd: fds)
+        polls.push_back(pollfd{fd, POLLIN, 0});
+    size_t open = fds.size();
+    char buffer[4096];
+    auto start = std::chrono::steady_clock::now(), sent = start;
+    std::chrono::duration<double> elapsed(0);
+    while(open > 0 && elapsed.count() < limit) {
+        ::poll(polls.data(), polls.size(), 10);
+        for(auto& p: polls) {
+            if(p.fd >= 0 && p.revents && ::recv(p.fd, buffer, sizeof(buffer), MSG_DONTWAIT) <= 0) {
+                // the descriptor is closed with the vector
+                p.fd = -p.fd - 1;
+                --open;
+            }
+        }
+        auto now = std::chrono::steady_clock::now();
+        if(dribble && now - sent >= std::chrono::milliseconds(100)) {
+            for(auto& p: polls)
+                if(p.fd >= 0)
+                    ::send(p.fd, "x", 1, MSG_NOSIGNAL);
+            sent = now;
+        }
+        elapsed = now - start;
+    }
+    return open == 0 ? elapsed.count() : -1;
+}
+
+// replies that arrived on `fds` within `wait`
+size_t replies(const std::vector<int>& fds, std::chrono::milliseconds wait) {
+    std::this_thread::sleep_for(wait);
+    size_t count = 0;
+    char buffer[256];
+    for(int fd: fds)
+        count += ::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0;
+    return count;
+}
+
+void memory(size_t connections) {
+    Server<HTTP> server(0, 1);
+    server.max_connections = 0;
+    std::thread thread;
+    run(server, thread);
+
+    // let the server thread and the allocator settle
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    uint64_t before = rss();
+    auto fds = connect_all(server.port(), connections);
+    wait_for(server, connections);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    uint64_t connected = rss();
+
+    std::string buffer;
+    bench::Reply reply;
+    for(int fd: fds) {
+        buffer.clear();
+        if(!bench::send_all(fd, get) || !bench::read_reply(fd, buffer, reply) || reply.status != 200)
+            fail("request");
+    }
+    uint64_t served = rss();
+
+    std::cout << connections << " idle connections, user space memory of the server per connection" << std::endl
+              << std::setw(32) << "connected" << std::setw(10) << double(connected - before) / connections << " bytes" << std::endl
+              << std::setw(32) << "after a keep-alive request" << std::setw(10) << double(served - before) / connections << " bytes" << std::endl;
+    finish(server, thread, fds);
+}
+
+void timeouts(size_t connections) {
+    Server<HTTP> server(0, 1);
+    server.idle_timeout = std::chrono::seconds(1);
+    server.header_timeout = std::chrono::seconds(1);
+    std::thread thread;
+    run(server, thread);
+
+    // keep-alive connections after a request
+    auto fds = connect_all(server.port(), connections);
+    std::string buffer;
+    bench::Reply reply;
+    for(int fd: fds) {
+        buffer.clear();
+        if(!bench::send_all(fd, get) || !bench::read_reply(fd, buffer, reply))
+            fail("request");
+    }
+    double idle = until_closed(fds, false, 5);
+    finish(server, thread, fds);
+    if(idle < 0)
+        fail("idle connections were not closed");
+
+    // a head that never ends, each connection makes progress every 100 ms
+    Server<HTTP> slow(0, 1);
+    slow.idle_timeout = std::chrono::seconds(1);
+    slow.header_timeout = std::chrono::seconds(1);
+    run(slow, thread);
+    fds = connect_all(slow.port(), connections);
+    for(int fd: fds)
+        bench::send_all(fd, "GET /hello HTTP/1.1\r\nX-Slow: ");
+    double dribbling = until_closed(fds, true, 5);
+    auto stats = slow.stats();
+    finish(slow, thread, fds);
+    if(dribbling < 0)
+        fail("dribbling clients were not closed");
+
+    std::cout << "timeouts of 1 s" << std::endl
+              << std::setw(32) << "idle closed after" << std::setw(10) << idle << " s, "
+              << server.stats().idle_timeouts << " idle timeouts" << std::endl
+              << std::setw(32) << "dribbling closed after" << std::setw(10) << dribbling << " s, "
+              << stats.header_timeouts << " header timeouts" << std::endl;
+    if(server.stats().idle_timeouts != connections || stats.header_timeouts != connections)
+        fail("timeouts were not counted");
+}
+
+void limits() {
+    Server<HTTP> server(0, 1);
+    server.max_connections = 100;
+    std::thread thread;
+    run(server, thread);
+
+    // the others wait in the listen backlog, their requests are not read
+    auto fds = connect_all(server.port(), 200);
+    for(int fd: fds)
+        bench::send_all(fd, get);
+    size_t first = replies(fds, std::chrono::milliseconds(300));
+    uint64_t open = server.stats().connections;
+
+    // half of those served go away, as many more are accepted
+    for(size_t i = 0; i < 50; ++i)
+        ::close(fds[i]);
+    fds.erase(fds.begin(), fds.begin() + 50);
+    size_t second = replies(fds, std::chrono::milliseconds(300));
+
+    for(int fd: fds)
+        ::close(fd);
+    fds.clear();
+
+    std::string head = "GET /hello HTTP/1.1\r\nX-Large: " + std::string(32 << 10, 'x') + "\r\n\r\n";
+    int fd = bench::connect_to(server.port());
+    fds.push_back(fd);
+    std::string buffer;
+    bench::Reply reply;
+    bool refused = bench::send_all(fd, head) && bench::read_reply(fd, buffer, reply) && reply.status == 431;
+
+    std::cout << "max_connections = 100, 200 clients" << std::endl
+              << std::setw(32) << "answered" << std::setw(10) << first << ", " << open << " open" << std::endl
+              << std::setw(32) << "after 50 closed, answered" << std::setw(10) << second << std::endl
+              << std::setw(32) << "32 KB head" << std::setw(10) << reply.status << std::endl;
+    finish(server, thread, fds);
+    if(first != 100 || open != 100 || second != 50 || !refused)
+        fail("limits");
+}
+
+int main(int argc, char* argv[]) {
+    size_t connections = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    // both ends of every connection, and some to spare
+    size_t limit = raise_fd_limit();
+    connections = std::min(connections, limit > 256 ? (limit - 256) / 2 : 64);
+
+    std::cout << std::fixed << std::setprecision(0);
+    memory(connections);
+    std::cout << std::setprecision(2);
+    timeouts(std::min<size_t>(connections, 1000));
+    limits();
+    return 0;
+}
@@ -0,0 +1,153 @@
+//
+// bench_metrics.cpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// what recording the metrics costs. The requests per second over one
+// keep-alive connection are measured with record_metrics on and off,
+// alternately, without pipelining and with 16 requests pipelined. Their
+// difference is within the noise of loopback runs, so the recording a
+// request does (clock readings, histogram buckets, counters) is timed on
+// its own as well, for both cases, and set against the time of a request
+// of that case. Exits with 1 if either is more than 1% of it.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "server.http.hpp"
+#include "bench.client.hpp"
+
+using namespace Web;
+
+// requests per second
+double measure(bool record_metrics, int depth, int requests) {
+    Server<HTTP> server(0, 1);
+    server.record_metrics = record_metrics;
+    server.resource["^/hello$"]["GET"] = [](Response& response, Request& request) {
+        response << "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello";
+    };
+    std::thread thread([&] { server.start(); });
+
+    int fd = bench::connect_to(server.port());
+    std::string buffer, batch;
+    for(int i = 0; i < depth; ++i)
+        batch += "GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    bench::Reply reply;
+
+    auto start = std::chrono::steady_clock::now();
+    for(int sent = 0; sent < requests; sent += depth) {
+        if(!bench::send_all(fd, batch)) {
+            std::cout << "send failed" << std::endl;
+            std::exit(1);
+        }
+        for(int i = 0; i < depth; ++i) {
+            if(!bench::read_reply(fd, buffer, reply) || reply.status != 200) {
+                std::cout << "request failed" << std::endl;
+                std::exit(1);
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    ::close(fd);
+    server.stop();
+    thread.join();
+
+    if(record_metrics && server.metrics.totals().requests != static_cast<uint64_t>(requests)) {
+        std::cout << "requests were not counted" << std::endl;
+        std::exit(1);
+    }
+    return requests / elapsed.count();
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// nanoseconds per request of what the server records for reads of
+// `depth` pipelined requests, after read_request, write_responses and
+// keep_alive
+double recording_cost(int depth) {
+    Metrics metrics;
+    const int iterations = 2000000 / depth;
+    std::vector<uint64_t> started(depth);
+    TickClock::nanoseconds(0);
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; ++i) {
+        // read_request: a reading on entry; in a sampled read, after the
+        // parse and after the handler of the first request as well
+        Metrics::Shard& shard = metrics.local();
+        bool sampled = shard.reads++ % Metrics::sample_every == 0;
+        uint64_t begin = TickClock::now(), mark = begin;
+        for(int r = 0; r < depth; ++r) {
+            shard.requests.add();
+            started[r] = begin;
+            if(sampled && r == 0) {
+                uint64_t parsed = TickClock::now();
+                shard.timers[Metrics::parse].record(TickClock::nanoseconds(parsed - mark));
+                uint64_t handled = TickClock::now();
+                shard.timers[Metrics::handle].record(TickClock::nanoseconds(handled - parsed));
+                mark = handled;
+            } else {
+                mark = 0;
+            }
+        }
+        // the write is issued, and completed
+        uint64_t issued = sampled && mark == 0 ? TickClock::now() : mark;
+        uint64_t sent = TickClock::now();
+        if(sampled)
+            metrics.local().timers[Metrics::write].record(TickClock::nanoseconds(sent - issued));
+        // keep_alive
+        Metrics::Shard& done = metrics.local();
+        for(int r = 0, same = 1; r < depth; r += same) {
+            for(same = 1; r + same < depth && started[r + same] == started[r]; ++same) {}
+            done.timers[Metrics::request].record(TickClock::nanoseconds(sent - started[r]), same);
+        }
+        for(int r = 0; r < depth; ++r)
+            done.status[2].add();
+        done.responses.add(depth);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (double(iterations) * depth);
+}
+
+int main() {
+    const int runs = 5;
+    std::vector<double> off, on, pipelined_off, pipelined_on;
+    for(int run = 0; run < runs; ++run) {
+        off.push_back(measure(false, 1, 50000));
+        on.push_back(measure(true, 1, 50000));
+        pipelined_off.push_back(measure(false, 16, 400000));
+        pipelined_on.push_back(measure(true, 16, 400000));
+    }
+
+    std::cout << std::fixed << std::setprecision(0) << "median of " << runs << " runs" << std::endl;
+    auto print = [](const char* name, double rate_off, double rate_on) {
+        std::cout << std::setw(20) << name << std::setw(12) << rate_off << " req/s off" << std::setw(12) << rate_on
+                  << " req/s on" << std::setw(10) << std::setprecision(2) << 100 * (rate_off - rate_on) / rate_off
+                  << "% slower" << std::setprecision(0) << std::endl;
+    };
+    print("no pipelining", median(off), median(on));
+    print("depth 16", median(pipelined_off), median(pipelined_on));
+
+    double cost = recording_cost(1), pipelined_cost = recording_cost(16);
+    double request = 1e9 / median(off), pipelined_request = 1e9 / median(pipelined_off);
+    auto share = [](const char* name, double cost, double request) {
+        std::cout << std::setprecision(1) << std::setw(20) << name << std::setw(12) << cost << " ns per request, "
+                  << std::setprecision(2) << 100 * cost / request << "% of a request (" << std::setprecision(0)
+                  << request << " ns)" << std::endl;
+    };
+    share("recording", cost, request);
+    share("recording, depth 16", pipelined_cost, pipelined_request);
+    return cost / request > 0.01 || pipelined_cost / pipelined_request > 0.01;
+}
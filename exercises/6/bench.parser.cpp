@@ -0,0 +1,173 @@
+//
+// bench_parser.cpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// parse rate of the incremental parser of http.parser.hpp compared to the
+// regular expression based parse_request() it replaced, for a minimal
+// request and a typical browser request. The incremental parser is also
+// fed in small pieces to show the cost of split reads.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+#include "http.parser.hpp"
+
+using namespace Web;
+
+// the former ServerBase::parse_request()
+struct RegexRequest {
+    std::string method, path, http_version;
+    std::unordered_map<std::string, std::string> header;
+};
+
+RegexRequest regex_parse(std::istream& stream) {
+    RegexRequest request;
+
+    std::regex e("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
+    std::smatch sub_match;
+
+    std::string line;
+    getline(stream, line);
+    line.pop_back();
+    if(std::regex_match(line, sub_match, e)) {
+        request.method       = sub_match[1];
+        request.path         = sub_match[2];
+        request.http_version = sub_match[3];
+
+        bool matched;
+        e="^([^:]*): ?(.*)$";
+        do {
+            getline(stream, line);
+            line.pop_back();
+            matched=std::regex_match(line, sub_match, e);
+            if(matched) {
+                request.header[sub_match[1]] = sub_match[2];
+            }
+        } while(matched==true);
+    }
+    return request;
+}
+
+const std::string small_request =
+    "GET /info HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "\r\n";
+
+const std::string browser_request =
+    "GET /match/abc123?lang=en HTTP/1.1\r\n"
+    "Host: localhost:12345\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: en-US,en;q=0.9,de;q=0.8\r\n"
+    "Cookie: session=4f1c2b9e8d7a6f5e4d3c2b1a; theme=dark\r\n"
+    "\r\n";
+
+template<class F>
+double ns_per_call(size_t iterations, F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < iterations; ++i)
+        f();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+// keeps the optimizer from dropping the work
+volatile size_t sink;
+
+void run(const char* name, const std::string& text) {
+    const size_t iterations = 200000;
+
+    double regex = ns_per_call(iterations / 10, [&] {
+        std::istringstream stream(text);
+        RegexRequest request = regex_parse(stream);
+        sink = request.header.size();
+    });
+
+    RequestParser parser;
+    double whole = ns_per_call(iterations, [&] {
+        parser.reset();
+        if(parser.parse(text.data(), text.size()) != RequestParser::Result::complete)
+            std::abort();
+        sink = parser.headers.size();
+    });
+
+    // as if every read returned 16 bytes
+    double split = ns_per_call(iterations, [&] {
+        parser.reset();
+        RequestParser::Result result = RequestParser::Result::incomplete;
+        for(size_t n = 16; result == RequestParser::Result::incomplete; n += 16)
+            result = parser.parse(text.data(), std::min(n, text.size()));
+        if(result != RequestParser::Result::complete)
+            std::abort();
+        sink = parser.headers.size();
+    });
+
+    std::cout << std::setw(8) << name << " (" << std::setw(3) << text.size() << " bytes)"
+              << "  regex: " << std::setw(9) << regex << " ns"
+              << "  incremental: " << std::setw(7) << whole << " ns"
+              << "  16 byte reads: " << std::setw(7) << split << " ns"
+              << "  speedup: " << regex / whole << "x" << std::endl;
+}
+
+// both parsers must agree on the result
+bool check(const std::string& text) {
+    std::istringstream stream(text);
+    RegexRequest expected = regex_parse(stream);
+
+    RequestParser parser;
+    if(parser.parse(text.data(), text.size()) != RequestParser::Result::complete)
+        return false;
+    if(parser.method.in(text.data()) != expected.method || parser.path.in(text.data()) != expected.path
+       || parser.version.in(text.data()) != expected.http_version
+       || parser.headers.size() != expected.header.size())
+        return false;
+    for(auto& field: parser.headers)
+        if(expected.header[std::string(field.first.in(text.data()))] != field.second.in(text.data()))
+            return false;
+    return true;
+}
+
+int main() {
+    if(!check(small_request) || !check(browser_request)) {
+        std::cout << "parsers disagree" << std::endl;
+        return 1;
+    }
+
+    // malformed input has to be rejected
+    const char* malformed[] = {
+        "GET /\r\n\r\n",
+        "GET / HTTP/1.1\nHost: x\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost x\r\n\r\n",
+        "GET / HTTP/1.1\r\n folded: x\r\n\r\n",
+        "G(T / HTTP/1.1\r\n\r\n",
+        "GET / HTTP/11\r\n\r\n",
+    };
+    for(const char* text: malformed) {
+        RequestParser parser;
+        if(parser.parse(text, std::char_traits<char>::length(text)) != RequestParser::Result::error) {
+            std::cout << "accepted malformed request: " << text << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    run("small", small_request);
+    run("browser", browser_request);
+    return 0;
+}
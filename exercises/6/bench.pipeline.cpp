@@ -0,0 +1,75 @@
+//
+// bench_pipeline.cpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// requests per second over one keep-alive connection when the client
+// pipelines 16 requests at a time. The server answers them with one
+// gathered write each (pipeline_depth 16), or one write per response
+// (pipeline_depth 1, how requests were answered before). A client that
+// waits for every response is the baseline. The responses of pipelined
+// requests are checked to arrive in order. With one write per response,
+// Nagle's algorithm holds back each small response until the previous
+// one is acknowledged, and the client delays its ACKs.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "server.http.hpp"
+#include "bench.client.hpp"
+
+using namespace Web;
+
+void measure(const char* name, size_t pipeline_depth, int depth, int requests) {
+    Server<HTTP> server(0, 1);
+    server.pipeline_depth = pipeline_depth;
+    server.resource["^/echo/([0-9]+)$"]["GET"] = [](Response& response, Request& request) {
+        std::string_view number = request.path_match[1];
+        response << "HTTP/1.1 200 OK\r\nContent-Length: " << number.length() << "\r\n\r\n" << number;
+    };
+    std::thread thread([&] { server.start(); });
+
+    int fd = bench::connect_to(server.port());
+    std::string buffer, batch;
+    bench::Reply reply;
+
+    auto start = std::chrono::steady_clock::now();
+    for(int sent = 0; sent < requests; sent += depth) {
+        batch.clear();
+        for(int i = 0; i < depth; ++i)
+            batch += "GET /echo/" + std::to_string(sent + i) + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        if(!bench::send_all(fd, batch)) {
+            std::cout << "send failed" << std::endl;
+            std::exit(1);
+        }
+        for(int i = 0; i < depth; ++i) {
+            if(!bench::read_reply(fd, buffer, reply, true) || reply.body != std::to_string(sent + i)) {
+                std::cout << name << ": response " << sent + i << " missing or out of order" << std::endl;
+                std::exit(1);
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    ::close(fd);
+    server.stop();
+    thread.join();
+
+    std::cout << std::setw(36) << name << std::setw(12) << requests / elapsed.count() << " req/s" << std::endl;
+}
+
+int main() {
+    std::cout << std::fixed << std::setprecision(0);
+    measure("no pipelining", 16, 1, 200000);
+    // fewer requests, every batch waits for a delayed ACK
+    measure("depth 16, one write per response", 1, 16, 3200);
+    measure("depth 16, gathered writes", 16, 16, 200000);
+    return 0;
+}
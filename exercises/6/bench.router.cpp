@@ -0,0 +1,123 @@
+//
+// bench_router.cpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// time to find the handler of a request with 10, 100 and 1000 routes,
+// for the former ServerBase::respond(), which constructs a std::regex for
+// every route it tries, and for the precompiled RouteTable. Half of the
+// routes are plain paths, a quarter are prefixes and a quarter need a
+// regex, plus the catch-all default route of handler.hpp.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <regex>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+
+#include "route.table.hpp"
+
+using namespace Web;
+
+typedef int handler_type;
+typedef std::map<std::string, std::unordered_map<std::string, handler_type>> resource_type;
+
+// keeps the optimizer from dropping the work
+volatile int sink;
+
+// the former loop of ServerBase::respond()
+const handler_type* regex_find(const std::vector<resource_type::const_iterator>& all_resources,
+                               const std::string& method, const std::string& path) {
+    for(auto res_it: all_resources) {
+        std::regex e(res_it->first);
+        std::smatch sm_res;
+        if(std::regex_match(path, sm_res, e)) {
+            if(res_it->second.count(method)>0) {
+                return &res_it->second.at(method);
+            }
+        }
+    }
+    return nullptr;
+}
+
+template<class F>
+double ns_per_call(size_t iterations, F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < iterations; ++i)
+        f(i);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+void run(size_t count) {
+    resource_type resource, default_resource;
+    std::vector<std::string> paths;
+    int id = 0;
+    for(size_t i = 0; i < count; ++i) {
+        std::string n = std::to_string(i);
+        switch(i % 4) {
+        case 0: case 1:
+            resource["^/api/v1/resource" + n + "/?$"]["GET"] = id++;
+            paths.push_back("/api/v1/resource" + n);
+            break;
+        case 2:
+            resource["^/static" + n + "/(.*)$"]["GET"] = id++;
+            paths.push_back("/static" + n + "/css/site.css");
+            break;
+        case 3:
+            resource["^/users/" + n + "/([0-9]+)/?$"]["GET"] = id++;
+            paths.push_back("/users/" + n + "/42");
+            break;
+        }
+    }
+    default_resource["^/?(.*)$"]["GET"] = id++;
+    paths.push_back("/index.html");
+
+    std::vector<resource_type::const_iterator> all_resources;
+    RouteTable<handler_type> routes;
+    for(auto it = resource.cbegin(); it != resource.cend(); it++) {
+        all_resources.push_back(it);
+        routes.add(it->first, it->second);
+    }
+    for(auto it = default_resource.cbegin(); it != default_resource.cend(); it++) {
+        all_resources.push_back(it);
+        routes.add(it->first, it->second);
+    }
+
+    // both must pick the same handler
+    const std::string method = "GET";
+    PathMatch match;
+    for(auto& path: paths) {
+        if(regex_find(all_resources, method, path) != routes.find(method, path, match)) {
+            std::cout << "routes disagree on " << path << std::endl;
+            std::exit(1);
+        }
+    }
+
+    size_t regex_iterations = std::max<size_t>(20, 20000 / count);
+    double regex = ns_per_call(regex_iterations, [&](size_t i) {
+        sink = *regex_find(all_resources, method, paths[(i * 7919) % paths.size()]);
+    });
+    double table = ns_per_call(1000000, [&](size_t i) {
+        sink = *routes.find(method, paths[(i * 7919) % paths.size()], match);
+    });
+
+    std::cout << std::setw(5) << count << " routes"
+              << "  regex per request: " << std::setw(12) << regex / 1000 << " us"
+              << "  route table: " << std::setw(8) << table / 1000 << " us"
+              << "  speedup: " << std::setw(8) << regex / table << "x" << std::endl;
+}
+
+int main() {
+    std::cout << std::fixed << std::setprecision(3);
+    for(size_t count: {10, 100, 1000})
+        run(count);
+    return 0;
+}
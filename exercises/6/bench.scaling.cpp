@@ -0,0 +1,98 @@
+//
+// bench_scaling.cpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// a loopback load generator, requests per second of a small response
+// with 1, 2, 4, ... up to N server threads, for one io_service shared by
+// all threads and for an io_context per thread with SO_REUSEPORT. The
+// load comes from as many client threads as the server has, each keeps
+// 8 connections busy. Clients share the cores with the server, numbers
+// measure the whole machine rather than the server alone.
+//
+// usage: bench.scaling [max threads, default: cores] [seconds per run, default: 2]
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "server.http.hpp"
+#include "bench.client.hpp"
+
+using namespace Web;
+
+double measure(size_t threads, bool reuse_port, double seconds) {
+    Server<HTTP> server(0, threads);
+    server.reuse_port = reuse_port;
+    server.resource["^/hello$"]["GET"] = [](Response& response, Request& request) {
+        response << "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello";
+    };
+    std::thread thread([&] { server.start(); });
+
+    const int connections = 8;
+    const std::string request = "GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    std::atomic<bool> running{true};
+    std::atomic<uint64_t> total{0};
+
+    std::vector<std::thread> clients;
+    for(size_t t = 0; t < threads; ++t) {
+        clients.emplace_back([&] {
+            std::vector<int> fds;
+            std::vector<std::string> buffers(connections);
+            for(int i = 0; i < connections; ++i)
+                fds.push_back(bench::connect_to(server.port()));
+            bench::Reply reply;
+            uint64_t done = 0;
+            while(running.load(std::memory_order_relaxed)) {
+                // one request in flight on every connection
+                for(int fd: fds)
+                    if(fd < 0 || !bench::send_all(fd, request))
+                        return;
+                for(int i = 0; i < connections; ++i)
+                    if(!bench::read_reply(fds[i], buffers[i], reply))
+                        return;
+                done += connections;
+            }
+            total.fetch_add(done);
+            for(int fd: fds)
+                ::close(fd);
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    running = false;
+    for(auto& client: clients)
+        client.join();
+    server.stop();
+    thread.join();
+    return total.load() / seconds;
+}
+
+int main(int argc, char* argv[]) {
+    size_t max_threads = argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+    double seconds = argc > 2 ? std::atof(argv[2]) : 2.0;
+    max_threads = std::max<size_t>(max_threads, 1);
+
+    std::cout << std::thread::hardware_concurrency() << " cores" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(22) << "shared io_service"
+              << std::setw(22) << "io_context/thread" << std::endl;
+    std::cout << std::fixed << std::setprecision(0);
+    for(size_t threads = 1;; threads *= 2) {
+        threads = std::min(threads, max_threads);
+        std::cout << std::setw(8) << threads
+                  << std::setw(16) << measure(threads, false, seconds) << " req/s"
+                  << std::setw(16) << measure(threads, true, seconds) << " req/s" << std::endl;
+        if(threads == max_threads)
+            break;
+    }
+    return 0;
+}
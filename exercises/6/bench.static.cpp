@@ -0,0 +1,150 @@
+//
+// bench_static.cpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// throughput of static files of 1 KB, 1 MB and 1 GB over one keep-alive
+// connection, served by StaticFiles with sendfile(2), from the response
+// cache, and by the former default resource, which copies the file into
+// the response stream. The copying handler is skipped for 1 GB, it would
+// hold the whole file in memory, the cache only takes files up to 1 MB.
+// The files are created in a temporary directory and removed.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "server.http.hpp"
+#include "static.files.hpp"
+#include "bench.client.hpp"
+
+using namespace Web;
+
+// the former default resource of handler.hpp
+void copy_file(std::ostream& response, const std::string& filename) {
+    std::ifstream ifs(filename, std::ifstream::in);
+    ifs.seekg(0, std::ios::end);
+    size_t length=ifs.tellg();
+    ifs.seekg(0, std::ios::beg);
+    response << "HTTP/1.1 200 OK\r\nContent-Length: " << length << "\r\n\r\n" << ifs.rdbuf();
+}
+
+void measure(unsigned short port, const std::string& path, uint64_t size, int requests) {
+    int fd = bench::connect_to(port);
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    std::string buffer;
+    bench::Reply reply;
+
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < requests; ++i) {
+        if(!bench::send_all(fd, request) || !bench::read_reply(fd, buffer, reply) || reply.length != size) {
+            std::cout << "request for " << path << " failed" << std::endl;
+            std::exit(1);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    ::close(fd);
+
+    std::cout << std::setw(28) << path
+              << std::setw(12) << requests / elapsed.count() << " req/s"
+              << std::setw(12) << size * requests / elapsed.count() / (1 << 20) << " MB/s" << std::endl;
+}
+
+int main() {
+    char directory[] = "/tmp/bench.static.XXXXXX";
+    if(!::mkdtemp(directory)) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    std::string root = directory;
+
+    struct Size { const char* name; uint64_t bytes; int requests; bool copy; };
+    const Size sizes[] = {
+        {"1k", 1 << 10, 20000, true},
+        {"1m", 1 << 20, 1000, true},
+        {"1g", uint64_t(1) << 30, 3, false},
+    };
+
+    // random content for the small files, a sparse file for 1 GB
+    std::mt19937 random(42);
+    for(auto& size: sizes) {
+        std::string filename = root + "/" + size.name + ".bin";
+        if(size.bytes <= (1 << 20)) {
+            std::string content(size.bytes, '\0');
+            for(auto& c: content)
+                c = static_cast<char>(random());
+            std::ofstream(filename, std::ios::binary) << content;
+        } else {
+            int fd = ::open(filename.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+            if(fd < 0 || ::ftruncate(fd, size.bytes) != 0) {
+                std::perror("create 1 GB file");
+                return 1;
+            }
+            ::close(fd);
+        }
+    }
+
+    Server<HTTP> server(0, 1);
+    StaticFiles files(server.compression);
+    StaticFiles cached_files(server.compression, 1024, std::chrono::seconds(1), std::make_shared<ResponseCache>(64 << 20, 1 << 20));
+    server.resource["^/sendfile/(.*)$"]["GET"] = [&](Response& response, Request& request) {
+        if(!files.serve(response, request, root + "/" + request.path_match.str(1)))
+            response << "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    };
+    server.resource["^/cached/(.*)$"]["GET"] = [&](Response& response, Request& request) {
+        if(!cached_files.serve(response, request, root + "/" + request.path_match.str(1)))
+            response << "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    };
+    server.resource["^/copy/(.*)$"]["GET"] = [&](std::ostream& response, Request& request) {
+        copy_file(response, root + "/" + request.path_match.str(1));
+    };
+    std::thread thread([&] { server.start(); });
+
+    // a range of the 1 KB file must be the same bytes as in the file
+    {
+        int fd = bench::connect_to(server.port());
+        std::string buffer;
+        bench::Reply reply;
+        bench::send_all(fd, "GET /sendfile/1k.bin HTTP/1.1\r\nRange: bytes=100-199\r\n\r\n");
+        bool ok = bench::read_reply(fd, buffer, reply, true) && reply.status == 206 && reply.body.size() == 100;
+        std::ifstream ifs(root + "/1k.bin", std::ios::binary);
+        std::string expected(100, '\0');
+        ifs.seekg(100);
+        ifs.read(&expected[0], 100);
+        ::close(fd);
+        if(!ok || reply.body != expected) {
+            std::cout << "range request failed" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    for(auto& size: sizes) {
+        std::string file = std::string(size.name) + ".bin";
+        measure(server.port(), "/sendfile/" + file, size.bytes, size.requests);
+        measure(server.port(), "/cached/" + file, size.bytes, size.requests);
+        if(size.copy)
+            measure(server.port(), "/copy/" + file, size.bytes, size.requests);
+        else
+            std::cout << std::setw(28) << "/copy/" + file << "  skipped, would buffer the whole file" << std::endl;
+    }
+
+    server.stop();
+    thread.join();
+    for(auto& size: sizes)
+        std::remove((root + "/" + size.name + ".bin").c_str());
+    ::rmdir(directory);
+    return 0;
+}
@@ -0,0 +1,172 @@
+//
+// bench_upload.cpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// uploads 1 GB to a streaming resource, once with a Content-Length and
+// once in chunked transfer coding, and downloads 1 GB produced by a
+// response source. The content is checked by its byte sum, and the peak
+// resident memory of the process must not grow by more than 32 MB.
+// Finally a smaller upload to a buffered resource shows what streaming
+// saves. Exits with 1 if a check fails.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "server.http.hpp"
+#include "bench.client.hpp"
+
+using namespace Web;
+
+// peak resident memory in MB
+double peak_rss() {
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+uint64_t byte_sum(std::string_view data, uint64_t sum = 0) {
+    for(unsigned char c: data)
+        sum += c;
+    return sum;
+}
+
+// content of `size` bytes made of a repeated block
+struct Content {
+    std::string block;
+    uint64_t size, sum = 0;
+
+    explicit Content(uint64_t size) : block(1 << 20, '\0'), size(size) {
+        for(size_t i = 0; i < block.size(); ++i)
+            block[i] = static_cast<char>(i * 7 + i / 251);
+        for(uint64_t sent = 0; sent < size; sent += block.size())
+            sum = byte_sum(std::string_view(block).substr(0, std::min<uint64_t>(block.size(), size - sent)), sum);
+    }
+};
+
+bool upload(unsigned short port, const std::string& path, const Content& content, bool chunked, std::string& reply_body) {
+    int fd = bench::connect_to(port);
+    std::string head = "POST " + path + " HTTP/1.1\r\nHost: localhost\r\n";
+    head += chunked ? "Transfer-Encoding: chunked\r\n\r\n" : "Content-Length: " + std::to_string(content.size) + "\r\n\r\n";
+    bool ok = bench::send_all(fd, head);
+
+    char line[32];
+    for(uint64_t sent = 0; ok && sent < content.size; sent += content.block.size()) {
+        std::string_view part = std::string_view(content.block).substr(0, std::min<uint64_t>(content.block.size(), content.size - sent));
+        if(chunked)
+            ok = bench::send_all(fd, std::string_view(line, std::snprintf(line, sizeof(line), "%zx\r\n", part.size())));
+        ok = ok && bench::send_all(fd, part) && (!chunked || bench::send_all(fd, "\r\n"));
+    }
+    if(chunked)
+        ok = ok && bench::send_all(fd, "0\r\n\r\n");
+
+    std::string buffer;
+    bench::Reply reply;
+    ok = ok && bench::read_reply(fd, buffer, reply, true) && reply.status == 200;
+    reply_body = reply.body;
+    ::close(fd);
+    return ok;
+}
+
+int main() {
+    const uint64_t gigabyte = uint64_t(1) << 30;
+    const Content large(gigabyte), small(256 << 20);
+
+    Server<HTTP> server(0, 1);
+    server.max_content_length = small.size;
+    // answers with the byte count and sum of the content, seen a chunk at a time
+    server.stream_resource["^/stream$"]["POST"] = [](Response& response, Request& request) {
+        auto sum = std::make_shared<uint64_t>(0);
+        auto body = request.body;
+        body->read([sum](std::string_view chunk) {
+            *sum = byte_sum(chunk, *sum);
+        }, [&response, body, sum] {
+            std::string content = std::to_string(body->size()) + " " + std::to_string(*sum);
+            response << "HTTP/1.1 200 OK\r\nContent-Length: " << content.size() << "\r\n\r\n" << content;
+        });
+    };
+    // the same, for a content buffered in full
+    server.resource["^/buffered$"]["POST"] = [](Response& response, Request& request) {
+        uint64_t size = 0, sum = 0;
+        std::vector<char> chunk(1 << 16);
+        while(request.content && request.content->read(chunk.data(), chunk.size()).gcount() > 0) {
+            std::string_view part(chunk.data(), request.content->gcount());
+            size += part.size();
+            sum = byte_sum(part, sum);
+        }
+        std::string content = std::to_string(size) + " " + std::to_string(sum);
+        response << "HTTP/1.1 200 OK\r\nContent-Length: " << content.size() << "\r\n\r\n" << content;
+    };
+    // 1 GB produced while it is sent
+    server.resource["^/download$"]["GET"] = [&large](Response& response, Request& request) {
+        response << "HTTP/1.1 200 OK\r\nContent-Length: " << large.size << "\r\n\r\n";
+        response.send_source([&large, sent = uint64_t(0)](char* buffer, size_t size) mutable {
+            size_t offset = static_cast<size_t>(sent % large.block.size());
+            size_t n = static_cast<size_t>(std::min<uint64_t>({size, large.size - sent, large.block.size() - offset}));
+            std::memcpy(buffer, large.block.data() + offset, n);
+            sent += n;
+            return n;
+        }, false);
+    };
+    std::thread thread([&] { server.start(); });
+
+    bool ok = true;
+    auto check = [&](const char* name, bool done, const std::string& body, const std::string& expected,
+                     std::chrono::steady_clock::time_point start, uint64_t size, double before) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        bool right = done && body == expected;
+        ok = ok && right;
+        std::cout << std::setw(28) << name << std::setw(10) << size / elapsed.count() / (1 << 20) << " MB/s"
+                  << std::setw(10) << peak_rss() - before << " MB peak memory growth"
+                  << (right ? "" : "  wrong content") << std::endl;
+    };
+    std::string expected = std::to_string(large.size) + " " + std::to_string(large.sum), body;
+    std::cout << std::fixed << std::setprecision(1);
+
+    double before = peak_rss();
+    auto start = std::chrono::steady_clock::now();
+    bool done = upload(server.port(), "/stream", large, false, body);
+    check("1 GB, Content-Length", done, body, expected, start, large.size, before);
+
+    start = std::chrono::steady_clock::now();
+    done = upload(server.port(), "/stream", large, true, body);
+    check("1 GB, chunked", done, body, expected, start, large.size, before);
+
+    start = std::chrono::steady_clock::now();
+    {
+        int fd = bench::connect_to(server.port());
+        std::string buffer;
+        bench::Reply reply;
+        done = bench::send_all(fd, "GET /download HTTP/1.1\r\n\r\n") && bench::read_reply(fd, buffer, reply)
+               && reply.length == large.size;
+        ::close(fd);
+    }
+    check("1 GB download from a source", done, expected, expected, start, large.size, before);
+
+    if(peak_rss() - before > 32) {
+        std::cout << "memory grew with the content" << std::endl;
+        ok = false;
+    }
+
+    // a buffered content is held in full
+    before = peak_rss();
+    start = std::chrono::steady_clock::now();
+    done = upload(server.port(), "/buffered", small, false, body);
+    check("256 MB, buffered", done, body, std::to_string(small.size) + " " + std::to_string(small.sum),
+          start, small.size, before);
+
+    server.stop();
+    thread.join();
+    return ok ? 0 : 1;
+}
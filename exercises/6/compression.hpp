@@ -0,0 +1,125 @@
+//
+// compression.hpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <string>
+#include <string_view>
+#include <charconv>
+
+#include <zlib.h>
+
+#include "http.parser.hpp"
+
+namespace Web {
+    // gzip settings of a server or of static files
+    struct Compression {
+        // zlib level, 1 is fastest, 9 smallest, 0 turns compression off
+        int level = 6;
+        // smaller contents are sent as they are, the gzip framing and the
+        // work would hardly pay off
+        size_t min_size = 1024;
+    };
+
+    // Whether an Accept-Encoding value takes gzip, e.g. "gzip, deflate, br"
+    // or "*;q=0.5"; a coding with q=0 is refused.
+    inline bool accepts_gzip(std::string_view accept_encoding) {
+        bool any = false, gzip = false, refused = false;
+        while(!accept_encoding.empty()) {
+            size_t comma = accept_encoding.find(',');
+            std::string_view item = accept_encoding.substr(0, comma);
+            accept_encoding.remove_prefix(comma == std::string_view::npos ? accept_encoding.size() : comma + 1);
+
+            size_t semicolon = item.find(';');
+            std::string_view coding = item.substr(0, semicolon);
+            while(!coding.empty() && (coding.front() == ' ' || coding.front() == '\t'))
+                coding.remove_prefix(1);
+            while(!coding.empty() && (coding.back() == ' ' || coding.back() == '\t'))
+                coding.remove_suffix(1);
+
+            // "q=0", "q=0.0" and so on refuse the coding
+            bool zero = false;
+            if(semicolon != std::string_view::npos) {
+                std::string_view parameter = item.substr(semicolon + 1);
+                size_t q = parameter.find("q=");
+                double value = 1;
+                if(q != std::string_view::npos)
+                    std::from_chars(parameter.data() + q + 2, parameter.data() + parameter.size(), value);
+                zero = value <= 0;
+            }
+
+            if(Headers::equals(coding, "gzip") || Headers::equals(coding, "x-gzip")) {
+                gzip = !zero;
+                refused = zero;
+            } else if(coding == "*") {
+                any = !zero;
+            }
+        }
+        return gzip || (any && !refused);
+    }
+
+    // A zlib stream in gzip format, reset for every content instead of being
+    // set up again, which allocates some 256 KB.
+    class Deflater {
+    public:
+        Deflater() = default;
+        Deflater(const Deflater&) = delete;
+        Deflater& operator=(const Deflater&) = delete;
+        ~Deflater() {
+            if(ready)
+                deflateEnd(&stream);
+        }
+
+        // `data` compressed into `out`, false if zlib failed
+        bool compress(std::string_view data, std::string& out, int level) {
+            if(!ready) {
+                // 15 bits of window, +16 for the gzip header and trailer
+                if(deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                    return false;
+                ready = true;
+                current_level = level;
+            } else {
+                deflateReset(&stream);
+                if(level != current_level && deflateParams(&stream, level, Z_DEFAULT_STRATEGY) != Z_OK)
+                    return false;
+                current_level = level;
+            }
+
+            out.resize(deflateBound(&stream, static_cast<uLong>(data.size())));
+            stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+            stream.avail_in = static_cast<uInt>(data.size());
+            stream.next_out = reinterpret_cast<Bytef*>(out.data());
+            stream.avail_out = static_cast<uInt>(out.size());
+            if(deflate(&stream, Z_FINISH) != Z_STREAM_END)
+                return false;
+            out.resize(stream.total_out);
+            return true;
+        }
+
+    private:
+        z_stream stream{};
+        bool ready = false;
+        int current_level = 0;
+    };
+
+    // gzip with a deflater of the calling thread
+    inline bool gzip(std::string_view data, std::string& out, int level) {
+        thread_local Deflater deflater;
+        return deflater.compress(data, out, level);
+    }
+
+    // content types that are compressed already
+    inline bool compressed_type(std::string_view type) {
+        auto starts = [type](std::string_view prefix) {
+            return type.size() >= prefix.size() && Headers::equals(type.substr(0, prefix.size()), prefix);
+        };
+        return (starts("image/") && !starts("image/svg")) || starts("video/") || starts("audio/") || starts("font/woff")
+               || starts("application/zip") || starts("application/gzip") || starts("application/x-gzip");
+    }
+}
+#endif /* COMPRESSION_HPP */
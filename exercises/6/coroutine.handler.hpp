@@ -0,0 +1,51 @@
+//
+// coroutine_handler.hpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef COROUTINE_HANDLER_HPP
+#define COROUTINE_HANDLER_HPP
+
+#include "server.base.hpp"
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#if !defined(BOOST_ASIO_HAS_CO_AWAIT)
+#error "coroutine handlers require C++20 coroutines"
+#endif
+
+namespace Web {
+    // a handler that is a C++20 coroutine, it may co_await timers, reads
+    // and writes with boost::asio::use_awaitable instead of blocking the
+    // io thread, other connections are served in the meantime
+    typedef std::function<boost::asio::awaitable<void>(Response&, Request&)> coroutine_handler_type;
+
+    // Turn a coroutine handler into a resource handler:
+    //
+    //     server.resource["^/slow$"]["GET"] = coroutine(
+    //         [](Response& response, Request& request) -> boost::asio::awaitable<void> {
+    //             boost::asio::steady_timer timer(response.get_executor(), std::chrono::milliseconds(10));
+    //             co_await timer.async_wait(boost::asio::use_awaitable);
+    //             response << "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    //         });
+    //
+    // The coroutine runs on the executor of the connection, the response
+    // is sent when it returns. A coroutine that throws before it wrote
+    // anything is answered with 500.
+    inline handler_type coroutine(coroutine_handler_type handler) {
+        return [handler = std::move(handler)](Response& response, Request& request) {
+            auto done = response.defer();
+            boost::asio::co_spawn(response.get_executor(), handler(response, request),
+            [&response, done](std::exception_ptr error) {
+                if(error && response.size() == 0)
+                    response << "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+                done();
+            });
+        };
+    }
+}
+#endif /* COROUTINE_HANDLER_HPP */
@@ -6,7 +6,9 @@
 //
 
 #include "server.base.hpp"
-#include <fstream>
+#include "static.files.hpp"
+#include "coroutine.handler.hpp"
+#include <sstream>
 
 using namespace std;
 using namespace Web;
@@ -43,17 +45,80 @@ void start_server(SERVER_TYPE &server) {
 
     // process GET request for /match/[digit+numbers], e.g. GET request is /match/abc123, will return abc123
     server.resource["^/match/([0-9a-zA-Z]+)/?$"]["GET"] = [](ostream& response, Request& request) {
-        string number=request.path_match[1];
+        string number=request.path_match.str(1);
         response << "HTTP/1.1 200 OK\r\nContent-Length: " << number.length() << "\r\n\r\n" << number;
     };
 
+    // processing POST /upload, the content is counted as it arrives and never held in memory
+    server.stream_resource["^/upload/?$"]["POST"] = [](Response& response, Request& request) {
+        auto body = request.body;
+        body->read([](string_view chunk) {}, [&response, body] {
+            string content = to_string(body->size());
+            response << "HTTP/1.1 200 OK\r\nContent-Length: " << content.length() << "\r\n\r\n" << content;
+        });
+    };
+
+    // process GET request for /count/[digits], return the numbers up to it, one per line,
+    // produced while they are sent in chunks
+    server.resource["^/count/([0-9]{1,9})/?$"]["GET"] = [](Response& response, Request& request) {
+        auto last = stoul(request.path_match.str(1));
+        response << "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nTransfer-Encoding: chunked\r\n\r\n";
+        response.send_source([next = 1ul, last](char* buffer, size_t size) mutable {
+            size_t length = 0;
+            // a number needs at most 10 bytes with the new line
+            while(next <= last && size - length >= 10) {
+                length = to_chars(buffer + length, buffer + size, next++).ptr - buffer;
+                buffer[length++] = '\n';
+            }
+            return length;
+        });
+    };
+
+    // process GET request for /delay/[milliseconds], answer after waiting, the coroutine
+    // is suspended meanwhile and the thread serves other connections
+    server.resource["^/delay/([0-9]{1,4})/?$"]["GET"] = coroutine([](Response& response, Request& request) -> boost::asio::awaitable<void> {
+        string milliseconds = request.path_match.str(1);
+        boost::asio::steady_timer timer(response.get_executor(), chrono::milliseconds(stoi(milliseconds)));
+        co_await timer.async_wait(boost::asio::use_awaitable);
+        response << "HTTP/1.1 200 OK\r\nContent-Length: " << milliseconds.length() << "\r\n\r\n" << milliseconds;
+    });
+
+    // small files are kept as complete responses in memory, 64 MB in total
+    auto cache = make_shared<ResponseCache>(64 << 20);
+
+    // process GET request for /cache/stats, report how well the file cache works
+    server.resource["^/cache/stats/?$"]["GET"] = [cache](ostream& response, Request& request) {
+        ResponseCache::Stats stats = cache->stats();
+        stringstream content_stream;
+        content_stream << "{\"hits\": " << stats.hits << ", \"misses\": " << stats.misses
+                       << ", \"hit_ratio\": " << stats.hit_ratio() << ", \"bytes_served\": " << stats.bytes_served
+                       << ", \"entries\": " << stats.entries << ", \"bytes\": " << stats.bytes
+                       << ", \"evictions\": " << stats.evictions << "}";
+        string content = content_stream.str();
+        response << "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " << content.length()
+                 << "\r\n\r\n" << content;
+    };
+
+    // process GET request for /metrics, counters and latency histograms of the server
+    // in the Prometheus text format
+    server.resource["^/metrics$"]["GET"] = [&server](ostream& response, Request& request) {
+        stringstream content_stream;
+        server.write_metrics(content_stream);
+        string content = content_stream.str();
+        response << "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " << content.length()
+                 << "\r\n\r\n" << content;
+    };
+
     // peocess default GET request; anonymous function will be called if no other matches
     // response files in folder web/
     // default: index.html
-    server.default_resource["^/?(.*)$"]["GET"] = [](ostream& response, Request& request) {
+    // small files come from `cache`, others are sent with sendfile(2),
+    // text files gzip compressed if the client accepts it
+    auto files = make_shared<StaticFiles>(server.compression, 1024, chrono::seconds(1), cache);
+    server.default_resource["^/?(.*)$"]["GET"] = [files](Response& response, Request& request) {
         string filename = "www/";
 
-        string path = request.path_match[1];
+        string path = request.path_match.str(1);
 
         // forbidden use `..` access content outside folder web/
         size_t last_pos = path.rfind(".");
@@ -66,26 +131,16 @@ void start_server(SERVER_TYPE &server) {
         }
 
         filename += path;
-        ifstream ifs;
         // folder inspection across platform
         if(filename.find('.') == string::npos) {
             if(filename[filename.length()-1]!='/')
                 filename+='/';
             filename += "index.html";
         }
-        ifs.open(filename, ifstream::in);
-
-        if(ifs) {
-            ifs.seekg(0, ios::end);
-            size_t length=ifs.tellg();
-
-            ifs.seekg(0, ios::beg);
-
-            // copy file to response-stream , shouldn't use for large files
-            response << "HTTP/1.1 200 OK\r\nContent-Length: " << length << "\r\n\r\n" << ifs.rdbuf();
 
-            ifs.close();
-        } else {
+        // the file is not copied into the response stream, large files are fine,
+        // a Range header is honored
+        if(!files->serve(response, request, filename)) {
             // return unable to open if file doesn't exists
             string content="Could not open file "+filename;
             response << "HTTP/1.1 400 Bad Request\r\nContent-Length: " << content.length() << "\r\n\r\n" << content;
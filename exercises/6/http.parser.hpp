@@ -0,0 +1,382 @@
+//
+// http_parser.hpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef HTTP_PARSER_HPP
+#define HTTP_PARSER_HPP
+
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <memory_resource>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace Web {
+    // one header line, `name: value`, both refer to the request buffer
+    typedef std::pair<std::string_view, std::string_view> Header;
+
+    // header fields in the order of the request, lookup ignores case
+    // since HTTP field names are case-insensitive
+    class Headers {
+    public:
+        typedef std::pmr::vector<Header>::const_iterator const_iterator;
+
+        explicit Headers(std::pmr::memory_resource* memory = std::pmr::get_default_resource()) :
+            fields(memory) {}
+
+        const_iterator begin() const { return fields.begin(); }
+        const_iterator end() const { return fields.end(); }
+        size_t size() const { return fields.size(); }
+        bool empty() const { return fields.empty(); }
+
+        void clear() { fields.clear(); }
+        void reserve(size_t n) { fields.reserve(n); }
+        void push_back(const Header& header) { fields.push_back(header); }
+
+        const_iterator find(std::string_view name) const {
+            for(auto it = fields.begin(); it != fields.end(); ++it)
+                if(equals(it->first, name))
+                    return it;
+            return fields.end();
+        }
+        size_t count(std::string_view name) const {
+            return find(name) != end() ? 1 : 0;
+        }
+        // value of the first field with this name, or `fallback`
+        std::string_view get(std::string_view name, std::string_view fallback = {}) const {
+            auto it = find(name);
+            return it != end() ? it->second : fallback;
+        }
+
+        static bool equals(std::string_view a, std::string_view b) {
+            if(a.size() != b.size())
+                return false;
+            for(size_t i = 0; i < a.size(); ++i)
+                if(lower(a[i]) != lower(b[i]))
+                    return false;
+            return true;
+        }
+
+    private:
+        static char lower(char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+
+        std::pmr::vector<Header> fields;
+    };
+
+    // Incremental HTTP/1.1 request head parser.
+    //
+    // parse() is called with all bytes received so far, whenever more
+    // arrive, and continues where it stopped last time, so a request that
+    // is split across several reads is scanned only once. The buffer may
+    // be moved between two calls as long as its contents are preserved,
+    // therefore the result is stored as offsets, and turned into
+    // string_views with the buffer that finally holds the request head.
+    // Nothing is copied or allocated per header.
+    class RequestParser {
+    public:
+        enum class Result { complete, incomplete, error };
+
+        // limits against malicious or broken clients
+        static constexpr size_t max_head_size = 64 * 1024;
+        static constexpr size_t max_headers = 100;
+
+        // position of a token in the buffer
+        struct Span {
+            uint32_t offset = 0, length = 0;
+            std::string_view in(const char* base) const { return {base + offset, length}; }
+        };
+
+        Span method, path, version;
+        std::vector< std::pair<Span, Span> > headers;
+
+        RequestParser() { headers.reserve(16); }
+
+        void reset() {
+            state = State::method;
+            pos = token = 0;
+            head_size = 0;
+            headers.clear();
+        }
+
+        // size of the request line and the header, including the empty line
+        size_t size() const { return head_size; }
+
+        Result parse(const char* data, size_t size) {
+            if(state == State::done)
+                return Result::complete;
+            if(state == State::failed)
+                return Result::error;
+
+            for(; pos < size; ++pos) {
+                unsigned char c = static_cast<unsigned char>(data[pos]);
+                switch(state) {
+                case State::method:
+                    if(c == ' ' && pos > token) {
+                        method = span(pos);
+                        state = State::path;
+                        token = pos + 1;
+                    } else if(!is_tchar(c)) {
+                        return fail();
+                    }
+                    break;
+                case State::path:
+                    if(c == ' ' && pos > token) {
+                        path = span(pos);
+                        state = State::version;
+                        token = pos + 1;
+                    } else if(c <= ' ' || c == 0x7f) {
+                        return fail();
+                    }
+                    break;
+                case State::version:
+                    if(c == '\r') {
+                        // HTTP/x.y, only the x.y part is kept
+                        std::string_view v(data + token, pos - token);
+                        if(v.size() != 8 || v.compare(0, 5, "HTTP/") != 0 || !is_digit(v[5])
+                           || v[6] != '.' || !is_digit(v[7]))
+                            return fail();
+                        version = Span{static_cast<uint32_t>(token + 5), 3};
+                        state = State::request_line_lf;
+                    } else if(pos - token >= 8) {
+                        return fail();
+                    }
+                    break;
+                case State::request_line_lf:
+                    if(c != '\n')
+                        return fail();
+                    state = State::header_start;
+                    break;
+                case State::header_start:
+                    if(c == '\r') {
+                        state = State::final_lf;
+                    } else if(is_tchar(c)) {
+                        if(headers.size() == max_headers)
+                            return fail();
+                        token = pos;
+                        state = State::header_name;
+                    } else {
+                        // obsolete line folding is rejected, see RFC 7230 3.2.4
+                        return fail();
+                    }
+                    break;
+                case State::header_name:
+                    if(c == ':') {
+                        headers.emplace_back(span(pos), Span());
+                        state = State::header_value_start;
+                    } else if(!is_tchar(c)) {
+                        return fail();
+                    }
+                    break;
+                case State::header_value_start:
+                    if(c == ' ' || c == '\t')
+                        break;
+                    token = pos;
+                    state = State::header_value;
+                    [[fallthrough]];
+                case State::header_value:
+                    if(c == '\r') {
+                        // strip trailing whitespace
+                        size_t end = pos;
+                        while(end > token && (data[end - 1] == ' ' || data[end - 1] == '\t'))
+                            --end;
+                        headers.back().second = span(end);
+                        state = State::header_lf;
+                    } else if((c < ' ' && c != '\t') || c == 0x7f) {
+                        return fail();
+                    }
+                    break;
+                case State::header_lf:
+                    if(c != '\n')
+                        return fail();
+                    state = State::header_start;
+                    break;
+                case State::final_lf:
+                    if(c != '\n')
+                        return fail();
+                    head_size = pos + 1;
+                    state = State::done;
+                    ++pos;
+                    return Result::complete;
+                default:
+                    return fail();
+                }
+            }
+
+            if(pos >= max_head_size)
+                return fail();
+            return Result::incomplete;
+        }
+
+    private:
+        enum class State : uint8_t {
+            method, path, version, request_line_lf,
+            header_start, header_name, header_value_start, header_value, header_lf,
+            final_lf, done, failed
+        };
+
+        Span span(size_t end) const {
+            return Span{static_cast<uint32_t>(token), static_cast<uint32_t>(end - token)};
+        }
+
+        Result fail() {
+            state = State::failed;
+            return Result::error;
+        }
+
+        static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+        // token characters of RFC 7230 3.2.6
+        static bool is_tchar(unsigned char c) {
+            static constexpr auto table = [] {
+                struct { bool v[256] = {}; } t;
+                for(int c = '0'; c <= '9'; ++c) t.v[c] = true;
+                for(int c = 'a'; c <= 'z'; ++c) t.v[c] = true;
+                for(int c = 'A'; c <= 'Z'; ++c) t.v[c] = true;
+                for(char c: std::string_view("!#$%&'*+-.^_`|~")) t.v[static_cast<unsigned char>(c)] = true;
+                return t;
+            }();
+            return table.v[c];
+        }
+
+        State state = State::method;
+        // next byte to look at, and start of the current token
+        size_t pos = 0, token = 0;
+        size_t head_size = 0;
+    };
+
+    // Incremental decoder of a content in chunked transfer coding, see
+    // RFC 7230 4.1. Like the parser, it goes on where it stopped, so the
+    // bytes it has looked at may be dropped between two calls. The data of
+    // the chunks is not copied, decode() points into the input. Chunk
+    // extensions and trailer fields are skipped.
+    class ChunkedDecoder {
+    public:
+        enum class Result { data, incomplete, complete, error };
+
+        // limit of a chunk size line with its extensions, and of the trailer
+        static constexpr size_t max_line = 4096;
+
+        void reset() {
+            state = State::size;
+            remaining = 0;
+            digits = 0;
+            line = 0;
+        }
+
+        // Decode the beginning of `data`, `consumed` is the number of bytes
+        // used. data: `chunk` holds the next bytes of the content;
+        // incomplete: the input ended, call again with more; complete: the
+        // last chunk and the trailer ended.
+        Result decode(const char* data, size_t size, size_t& consumed, std::string_view& chunk) {
+            for(size_t i = 0; i < size; ++i) {
+                char c = data[i];
+                if(state != State::data && ++line > max_line)
+                    return fail();
+
+                switch(state) {
+                case State::size:
+                    if(hex(c) >= 0) {
+                        // 15 hex digits keep the size below 2^60
+                        if(++digits > 15)
+                            return fail();
+                        remaining = remaining * 16 + hex(c);
+                    } else if(digits > 0 && (c == ';' || c == ' ' || c == '\t')) {
+                        state = State::extension;
+                    } else if(digits > 0 && c == '\r') {
+                        state = State::size_lf;
+                    } else {
+                        return fail();
+                    }
+                    break;
+                case State::extension:
+                    if(c == '\r')
+                        state = State::size_lf;
+                    else if(c == '\n')
+                        return fail();
+                    break;
+                case State::size_lf:
+                    if(c != '\n')
+                        return fail();
+                    state = remaining > 0 ? State::data : State::trailer;
+                    digits = 0;
+                    line = 0;
+                    break;
+                case State::data: {
+                    size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, size - i));
+                    chunk = std::string_view(data + i, n);
+                    remaining -= n;
+                    if(remaining == 0)
+                        state = State::data_cr;
+                    consumed = i + n;
+                    return Result::data;
+                }
+                case State::data_cr:
+                    if(c != '\r')
+                        return fail();
+                    state = State::data_lf;
+                    break;
+                case State::data_lf:
+                    if(c != '\n')
+                        return fail();
+                    state = State::size;
+                    line = 0;
+                    break;
+                case State::trailer:
+                    // an empty line ends the trailer
+                    state = c == '\r' ? State::final_lf : State::trailer_field;
+                    break;
+                case State::trailer_field:
+                    if(c == '\r')
+                        state = State::trailer_lf;
+                    break;
+                case State::trailer_lf:
+                    if(c != '\n')
+                        return fail();
+                    state = State::trailer;
+                    break;
+                case State::final_lf:
+                    if(c != '\n')
+                        return fail();
+                    state = State::done;
+                    consumed = i + 1;
+                    return Result::complete;
+                default:
+                    return fail();
+                }
+            }
+            consumed = size;
+            return state == State::done ? Result::complete : Result::incomplete;
+        }
+
+    private:
+        enum class State : uint8_t {
+            size, extension, size_lf, data, data_cr, data_lf,
+            trailer, trailer_field, trailer_lf, final_lf, done, failed
+        };
+
+        static int hex(char c) {
+            if(c >= '0' && c <= '9') return c - '0';
+            if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
+
+        Result fail() {
+            state = State::failed;
+            return Result::error;
+        }
+
+        State state = State::size;
+        // bytes left of the current chunk
+        uint64_t remaining = 0;
+        size_t digits = 0;
+        // bytes of the current size line or of the trailer
+        size_t line = 0;
+    };
+}
+#endif /* HTTP_PARSER_HPP */
@@ -0,0 +1,271 @@
+//
+// metrics.hpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <array>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <ostream>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace Web {
+    // Timestamps of the measurements, ticks of the time stamp counter on
+    // x86-64, which is read several times faster than steady_clock, much
+    // faster in virtual machines. The counter is assumed to be invariant,
+    // as on CPUs of the last decade; the ticks per nanosecond are measured
+    // against steady_clock once. Elsewhere a tick is a steady_clock nanosecond.
+    class TickClock {
+    public:
+        static uint64_t now() {
+#if defined(__x86_64__)
+            return __rdtsc();
+#else
+            return nanoseconds_now();
+#endif
+        }
+
+        static uint64_t nanoseconds(uint64_t ticks) {
+#if defined(__x86_64__)
+            static const double rate = nanoseconds_per_tick();
+            return static_cast<uint64_t>(ticks * rate);
+#else
+            return ticks;
+#endif
+        }
+
+    private:
+        static uint64_t nanoseconds_now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+#if defined(__x86_64__)
+        // counts ticks for 5 ms, once per process
+        static double nanoseconds_per_tick() {
+            uint64_t start = nanoseconds_now(), ticks = __rdtsc(), elapsed;
+            while((elapsed = nanoseconds_now() - start) < 5000000) {}
+            return double(elapsed) / double(__rdtsc() - ticks);
+        }
+#endif
+    };
+
+    // A counter with one writer, the thread that owns it. An increment is
+    // a plain load and store, no locked instruction, readers on other
+    // threads see a value that was current a moment ago.
+    class Counter {
+    public:
+        void add(uint64_t n = 1) {
+            value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+        uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> value{0};
+    };
+
+    // Latency histogram in the manner of HdrHistogram: values in
+    // nanoseconds go to buckets that are linear within each power of two,
+    // 32 per power, so a bucket is at most 1/32 of its values wide. Values
+    // up to 2^40 ns, about 18 minutes, are kept, larger ones count as that.
+    // Like Counter, a histogram has one writer.
+    class Histogram {
+    public:
+        static constexpr unsigned sub_bits = 5;
+        static constexpr uint64_t sub_count = uint64_t(1) << sub_bits;
+        static constexpr unsigned max_bits = 40;
+        static constexpr size_t bucket_count = (max_bits - sub_bits + 1) * sub_count;
+
+        static size_t bucket(uint64_t value) {
+            if(value >= (uint64_t(1) << max_bits))
+                value = (uint64_t(1) << max_bits) - 1;
+            if(value < sub_count)
+                return static_cast<size_t>(value);
+            unsigned msb = 63 - __builtin_clzll(value);
+            unsigned shift = msb - sub_bits;
+            return static_cast<size_t>((shift + 1) * sub_count + ((value >> shift) - sub_count));
+        }
+
+        // the smallest and the largest value of a bucket
+        static uint64_t lowest(size_t index) {
+            if(index < sub_count)
+                return index;
+            uint64_t shift = index / sub_count - 1;
+            return (index % sub_count + sub_count) << shift;
+        }
+        static uint64_t highest(size_t index) {
+            return index + 1 < bucket_count ? lowest(index + 1) - 1 : lowest(index);
+        }
+
+        // `times` values of `nanoseconds` each
+        void record(uint64_t nanoseconds, uint64_t times = 1) {
+            auto& count = counts[bucket(nanoseconds)];
+            count.store(count.load(std::memory_order_relaxed) + times, std::memory_order_relaxed);
+            total.store(total.load(std::memory_order_relaxed) + nanoseconds * times, std::memory_order_relaxed);
+        }
+
+        // the histograms of all threads added up
+        struct Snapshot {
+            std::array<uint64_t, bucket_count> counts{};
+            uint64_t count = 0, sum = 0;
+
+            void add(const Histogram& histogram) {
+                for(size_t i = 0; i < bucket_count; ++i) {
+                    uint64_t n = histogram.counts[i].load(std::memory_order_relaxed);
+                    counts[i] += n;
+                    count += n;
+                }
+                sum += histogram.total.load(std::memory_order_relaxed);
+            }
+
+            // values up to `nanoseconds`, at the resolution of the buckets
+            uint64_t count_below(uint64_t nanoseconds) const {
+                uint64_t n = 0;
+                for(size_t i = 0; i < bucket_count && highest(i) <= nanoseconds; ++i)
+                    n += counts[i];
+                return n;
+            }
+
+            // the value below which a fraction `q` of the values lie
+            uint64_t percentile(double q) const {
+                uint64_t rank = static_cast<uint64_t>(q * count), seen = 0;
+                for(size_t i = 0; i < bucket_count; ++i) {
+                    seen += counts[i];
+                    if(seen > rank)
+                        return highest(i);
+                }
+                return 0;
+            }
+        };
+
+    private:
+        std::array<std::atomic<uint64_t>, bucket_count> counts{};
+        std::atomic<uint64_t> total{0};
+    };
+
+    // What the server measures. Every thread records into its own shard,
+    // found through a thread local, so recording shares no cache line with
+    // another thread; a reader adds the shards up.
+    class Metrics {
+    public:
+        // the steps are timed for one read in sample_every of each thread,
+        // see ServerBase::read_request
+        static constexpr uint64_t sample_every = 8;
+
+        enum Timer {
+            // parsing a request head and finding its resource, sampled
+            parse,
+            // the resource handler, until it returned or deferred its response, sampled
+            handle,
+            // a gathered write of responses, sampled
+            write,
+            // from the read that brought the head until the response was sent
+            request,
+            timer_count
+        };
+
+        struct alignas(64) Shard {
+            std::thread::id thread;
+            std::array<Histogram, timer_count> timers;
+            // requests parsed, answered, and dropped without an answer
+            Counter requests, responses, aborted;
+            // responses by status class, 1xx to 5xx, others at 0
+            std::array<Counter, 6> status;
+            // reads of requests, only the owning thread looks at it
+            uint64_t reads = 0;
+        };
+
+        Metrics() : id(next_id().fetch_add(1, std::memory_order_relaxed) + 1) {}
+        Metrics(const Metrics&) = delete;
+        Metrics& operator=(const Metrics&) = delete;
+
+        // the shard of the calling thread, created on its first call
+        Shard& local() const {
+            thread_local struct { uint64_t id = 0; Shard* shard = nullptr; } cache;
+            if(cache.id != id) {
+                cache.shard = find(std::this_thread::get_id());
+                cache.id = id;
+            }
+            return *cache.shard;
+        }
+
+        // Histograms of all threads added up, and the counters below;
+        // counters are read one after the other, while requests go on.
+        struct Totals {
+            std::array<Histogram::Snapshot, timer_count> timers;
+            uint64_t requests = 0, responses = 0, aborted = 0;
+            std::array<uint64_t, 6> status{};
+
+            uint64_t in_flight() const {
+                return requests > responses + aborted ? requests - responses - aborted : 0;
+            }
+        };
+
+        Totals totals() const {
+            Totals totals;
+            std::lock_guard<std::mutex> lock(mutex);
+            for(auto& shard: shards) {
+                for(size_t t = 0; t < timer_count; ++t)
+                    totals.timers[t].add(shard->timers[t]);
+                totals.requests += shard->requests.get();
+                totals.responses += shard->responses.get();
+                totals.aborted += shard->aborted.get();
+                for(size_t s = 0; s < shard->status.size(); ++s)
+                    totals.status[s] += shard->status[s].get();
+            }
+            return totals;
+        }
+
+        // Prometheus text format of a histogram in seconds, with fixed
+        // bounds from 100 ns to 10 s
+        static void write_histogram(std::ostream& out, const char* name, const char* help,
+                                    const Histogram::Snapshot& histogram) {
+            out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << " histogram\n";
+            for(uint64_t decade = 100; decade <= 1000000000; decade *= 10) {
+                for(uint64_t step: {1, 2, 5}) {
+                    uint64_t bound = decade * step;
+                    out << name << "_bucket{le=\"" << bound / 1e9 << "\"} " << histogram.count_below(bound) << '\n';
+                }
+            }
+            out << name << "_bucket{le=\"10\"} " << histogram.count_below(10000000000) << '\n'
+                << name << "_bucket{le=\"+Inf\"} " << histogram.count << '\n'
+                << name << "_sum " << histogram.sum / 1e9 << '\n'
+                << name << "_count " << histogram.count << '\n';
+        }
+
+    private:
+        static std::atomic<uint64_t>& next_id() {
+            static std::atomic<uint64_t> id{0};
+            return id;
+        }
+
+        Shard* find(std::thread::id thread) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(auto& shard: shards)
+                if(shard->thread == thread)
+                    return shard.get();
+            shards.push_back(std::make_unique<Shard>());
+            shards.back()->thread = thread;
+            return shards.back().get();
+        }
+
+        // never reused, a thread's cache cannot mistake another instance for this one
+        const uint64_t id;
+        mutable std::mutex mutex;
+        mutable std::vector< std::unique_ptr<Shard> > shards;
+    };
+}
+#endif /* METRICS_HPP */
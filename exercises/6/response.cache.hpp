@@ -0,0 +1,277 @@
+//
+// response_cache.hpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef RESPONSE_CACHE_HPP
+#define RESPONSE_CACHE_HPP
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <functional>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "compression.hpp"
+
+namespace Web {
+    // nanoseconds since the epoch of the last modification
+    inline int64_t modification_time(const struct stat& st) {
+#if defined(__APPLE__)
+        return int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    }
+
+    // In-memory cache of complete "200 OK" responses of small files.
+    //
+    // A hit hands out the serialized header and body, to be written to the
+    // socket as is. The cache is split into shards by path, a hit takes the
+    // shard lock shared, so io threads only contend when a shard is changed.
+    // Every shard keeps its part of the byte budget with CLOCK eviction: a
+    // hit merely sets the referenced bit of the entry, the clock hand clears
+    // the bits and evicts the first entry found without one. Entries are
+    // checked against the file's mtime, inode and size at most every
+    // `revalidate` interval and are reloaded when the file changed. A file
+    // may be kept gzip compressed as well, it is compressed once, when it
+    // is loaded.
+    class ResponseCache {
+    public:
+        struct Stats {
+            uint64_t hits = 0, misses = 0, evictions = 0;
+            // bytes handed out from the cache
+            uint64_t bytes_served = 0;
+            // what the cache holds now
+            uint64_t entries = 0, bytes = 0;
+
+            double hit_ratio() const {
+                return hits + misses ? double(hits) / double(hits + misses) : 0.0;
+            }
+        };
+
+        // `budget` bytes in total, files above `max_file_size` are never cached
+        explicit ResponseCache(uint64_t budget = 64 << 20, uint64_t max_file_size = 1 << 20,
+                               std::chrono::milliseconds revalidate = std::chrono::seconds(1)) :
+            shard_budget(budget / shard_count), max_file_size(std::min(max_file_size, budget / shard_count)),
+            revalidate(std::chrono::duration_cast<std::chrono::nanoseconds>(revalidate).count()) {}
+
+        // the response for `filename`, loaded on a miss, nullptr if the file
+        // cannot be read or is too large for the cache; large files are
+        // remembered without their content, they bypass the cache cheaply.
+        // With `compression` the response depends on Accept-Encoding and
+        // says "Vary: Accept-Encoding", so that a shared cache does not
+        // hand one coding to a client that asked for the other; with `gzip`
+        // the content is compressed, unless it is smaller than
+        // compression->min_size or does not get smaller.
+        std::shared_ptr<const std::string> get(const std::string& filename, const Compression* compression = nullptr,
+                                               bool gzip = false) {
+            // the responses of a negotiated file are kept besides the plain
+            // one, no path contains a NUL
+            thread_local std::string negotiated_key;
+            if(compression)
+                negotiated_key.assign(filename).append(gzip ? "\0gzip" : "\0vary", 5);
+            const std::string& key = compression ? negotiated_key : filename;
+            Shard& shard = shards[std::hash<std::string>()(key) % shard_count];
+            int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+
+            std::shared_ptr<Entry> entry;
+            {
+                std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                auto it = shard.index.find(key);
+                if(it != shard.index.end())
+                    entry = shard.slots[it->second].entry;
+            }
+            if(entry) {
+                entry->referenced.store(true, std::memory_order_relaxed);
+                bool fresh = now - entry->checked.load(std::memory_order_relaxed) < revalidate;
+                if(!fresh) {
+                    struct stat st;
+                    fresh = ::stat(filename.c_str(), &st) == 0 && entry->same_file(st);
+                    if(fresh)
+                        entry->checked.store(now, std::memory_order_relaxed);
+                }
+                if(fresh && !entry->response)
+                    return nullptr;
+                if(fresh) {
+                    shard.hits.fetch_add(1, std::memory_order_relaxed);
+                    shard.bytes_served.fetch_add(entry->response->size(), std::memory_order_relaxed);
+                    return entry->response;
+                }
+            }
+            shard.misses.fetch_add(1, std::memory_order_relaxed);
+
+            // read the file outside of the lock
+            entry = load(filename, now, compression, gzip);
+            if(!entry)
+                return nullptr;
+            insert(shard, key, entry);
+            return entry->response;
+        }
+
+        Stats stats() const {
+            Stats total;
+            for(auto& shard: shards) {
+                total.hits += shard.hits.load(std::memory_order_relaxed);
+                total.misses += shard.misses.load(std::memory_order_relaxed);
+                total.evictions += shard.evictions.load(std::memory_order_relaxed);
+                total.bytes_served += shard.bytes_served.load(std::memory_order_relaxed);
+                std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                total.entries += shard.index.size();
+                total.bytes += shard.bytes;
+            }
+            return total;
+        }
+
+    private:
+        static constexpr size_t shard_count = 16;
+
+        struct Entry {
+            std::shared_ptr<const std::string> response;
+            uint64_t inode = 0, size = 0;
+            int64_t mtime = 0;
+            // steady clock nanoseconds of the last check against the file
+            std::atomic<int64_t> checked{0};
+            std::atomic<bool> referenced{true};
+
+            uint64_t bytes() const { return response ? response->size() : 0; }
+
+            bool same_file(const struct stat& st) const {
+                return uint64_t(st.st_ino) == inode && uint64_t(st.st_size) == size && modification_time(st) == mtime;
+            }
+        };
+
+        struct Slot {
+            std::string key;
+            std::shared_ptr<Entry> entry;
+        };
+
+        struct alignas(64) Shard {
+            mutable std::shared_mutex mutex;
+            std::unordered_map<std::string, size_t> index;
+            // the clock, slots without an entry are reused first
+            std::vector<Slot> slots;
+            std::vector<size_t> free;
+            size_t hand = 0;
+            uint64_t bytes = 0;
+
+            std::atomic<uint64_t> hits{0}, misses{0}, evictions{0}, bytes_served{0};
+        };
+
+        std::shared_ptr<Entry> load(const std::string& filename, int64_t now, const Compression* compression,
+                                    bool gzip) const {
+            int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd < 0)
+                return nullptr;
+            struct stat st;
+            if(::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+                ::close(fd);
+                return nullptr;
+            }
+
+            auto entry = std::make_shared<Entry>();
+            entry->inode = st.st_ino;
+            entry->size = st.st_size;
+            entry->mtime = modification_time(st);
+            entry->checked.store(now, std::memory_order_relaxed);
+            if(uint64_t(st.st_size) > max_file_size) {
+                ::close(fd);
+                return entry;
+            }
+
+            // a small file may still have a precompressed sibling
+            bool negotiated = compression && compression->level > 0;
+            std::string header = std::string("HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\n")
+                                 + (negotiated ? "Vary: Accept-Encoding\r\n" : "")
+                                 + "Content-Length: " + std::to_string(st.st_size) + "\r\n\r\n";
+            auto response = std::make_shared<std::string>();
+            response->reserve(header.size() + st.st_size);
+            *response = header;
+            response->resize(header.size() + st.st_size);
+
+            size_t done = 0;
+            while(done < size_t(st.st_size)) {
+                ssize_t n = ::pread(fd, &(*response)[header.size() + done], st.st_size - done, done);
+                if(n <= 0)
+                    break;
+                done += n;
+            }
+            ::close(fd);
+            // the file was truncated while we read it
+            if(done != size_t(st.st_size))
+                return nullptr;
+
+            std::string compressed;
+            if(negotiated && gzip && done >= compression->min_size
+               && Web::gzip(std::string_view(*response).substr(header.size()), compressed, compression->level)
+               && compressed.size() < done) {
+                header = "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nVary: Accept-Encoding\r\nContent-Length: "
+                         + std::to_string(compressed.size()) + "\r\n\r\n";
+                response->assign(header).append(compressed);
+                response->shrink_to_fit();
+            }
+
+            entry->response = std::move(response);
+            return entry;
+        }
+
+        void insert(Shard& shard, const std::string& filename, std::shared_ptr<Entry> entry) {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            auto it = shard.index.find(filename);
+            if(it != shard.index.end()) {
+                // replace the stale entry in its slot
+                Slot& slot = shard.slots[it->second];
+                shard.bytes -= slot.entry->bytes();
+                slot.entry = std::move(entry);
+                shard.bytes += slot.entry->bytes();
+            } else {
+                size_t index;
+                if(!shard.free.empty()) {
+                    index = shard.free.back();
+                    shard.free.pop_back();
+                } else {
+                    index = shard.slots.size();
+                    shard.slots.emplace_back();
+                }
+                shard.bytes += entry->bytes();
+                shard.slots[index] = Slot{filename, std::move(entry)};
+                it = shard.index.emplace(filename, index).first;
+            }
+            size_t inserted = it->second;
+
+            // the new entry is never evicted right away
+            while(shard.bytes > shard_budget && shard.index.size() > 1) {
+                if(shard.hand >= shard.slots.size())
+                    shard.hand = 0;
+                Slot& slot = shard.slots[shard.hand];
+                if(slot.entry && !slot.entry->referenced.exchange(false, std::memory_order_relaxed)
+                   && shard.hand != inserted) {
+                    shard.bytes -= slot.entry->bytes();
+                    shard.index.erase(slot.key);
+                    slot = Slot();
+                    shard.free.push_back(shard.hand);
+                    shard.evictions.fetch_add(1, std::memory_order_relaxed);
+                }
+                ++shard.hand;
+            }
+        }
+
+        uint64_t shard_budget, max_file_size;
+        int64_t revalidate;
+        Shard shards[shard_count];
+    };
+}
+#endif /* RESPONSE_CACHE_HPP */
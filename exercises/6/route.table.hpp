@@ -0,0 +1,240 @@
+//
+// route_table.hpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef ROUTE_TABLE_HPP
+#define ROUTE_TABLE_HPP
+
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory_resource>
+#include <set>
+#include <unordered_map>
+#include <functional>
+#include <cstddef>
+
+namespace Web {
+    // the matched path at index 0, followed by the captured groups,
+    // all refer to the path of the request
+    class PathMatch {
+    public:
+        explicit PathMatch(std::pmr::memory_resource* memory = std::pmr::get_default_resource()) :
+            groups(memory) {}
+
+        size_t size() const { return groups.size(); }
+        bool empty() const { return groups.empty(); }
+        // empty for a group that does not exist or did not participate
+        std::string_view operator[](size_t i) const {
+            return i < groups.size() ? groups[i] : std::string_view();
+        }
+        std::string str(size_t i = 0) const { return std::string((*this)[i]); }
+
+        void clear() { groups.clear(); }
+        void push_back(std::string_view group) { groups.push_back(group); }
+
+    private:
+        std::pmr::vector<std::string_view> groups;
+    };
+
+    // Routes compiled once, before the server starts.
+    //
+    // A route is a regular expression as used for the resource maps. Most
+    // of them are plain paths like "^/info/?$" or a path prefix followed by
+    // "(.*)", these are recognized and looked up in hash tables without
+    // running a regex at all, only the remaining patterns are matched
+    // by their precompiled std::regex. The first route in the order of
+    // add() that matches the path and has the method wins, as before.
+    template<typename Handler>
+    class RouteTable {
+    public:
+        // `handlers` maps methods to handlers, they must outlive the table
+        template<typename Methods>
+        void add(const std::string& pattern, const Methods& handlers) {
+            Route route;
+            for(auto& method: handlers)
+                route.methods.emplace_back(method.first, &method.second);
+            size_t index = routes.size();
+
+            std::string literal;
+            bool optional_slash = false;
+            std::string_view rest = split_literal(pattern, literal, optional_slash);
+
+            if(rest.empty()) {
+                route.kind = Kind::literal;
+                literals[literal].push_back(index);
+                if(optional_slash)
+                    literals[literal + '/'].push_back(index);
+            } else if(rest == "(.*)" || rest == ".*") {
+                route.kind = Kind::prefix;
+                route.capture = rest.front() == '(';
+                route.optional_slash = optional_slash;
+                route.prefix = literal.size();
+                prefix_lengths.insert(literal.size());
+                prefixes[literal].push_back(index);
+            } else {
+                route.kind = Kind::regex;
+                // a path can only match if it begins with the literal text,
+                // unless an alternative of the pattern begins differently
+                if(pattern.find('|') == std::string::npos)
+                    route.literal = literal;
+                route.regex = std::regex(pattern, std::regex::ECMAScript | std::regex::optimize);
+                regexes.push_back(index);
+            }
+            routes.push_back(std::move(route));
+        }
+
+        void clear() {
+            routes.clear();
+            literals.clear();
+            prefixes.clear();
+            prefix_lengths.clear();
+            regexes.clear();
+        }
+
+        size_t size() const { return routes.size(); }
+
+        // the handler for method and path, nullptr if none matches;
+        // `match` receives the path and the captured groups
+        const Handler* find(std::string_view method, std::string_view path, PathMatch& match) const {
+            const Handler* handler = nullptr;
+            size_t best = routes.size();
+
+            // literal and prefix routes, whichever was added first
+            auto candidates = [&](const std::vector<size_t>& indices) {
+                for(size_t index: indices) {
+                    if(index >= best)
+                        break;
+                    if(auto h = routes[index].handler(method)) {
+                        best = index;
+                        handler = h;
+                        break;
+                    }
+                }
+            };
+            auto literal = literals.find(path);
+            if(literal != literals.end())
+                candidates(literal->second);
+            for(size_t length: prefix_lengths) {
+                if(length > path.size())
+                    break;
+                auto prefix = prefixes.find(path.substr(0, length));
+                if(prefix != prefixes.end())
+                    candidates(prefix->second);
+            }
+
+            // regex routes that were added before the best candidate,
+            // the results keep their memory for the next request of the thread
+            static thread_local std::cmatch groups;
+            for(size_t index: regexes) {
+                if(index >= best)
+                    break;
+                const Route& route = routes[index];
+                auto h = route.handler(method);
+                if(h && path.compare(0, route.literal.size(), route.literal) == 0
+                     && std::regex_match(path.data(), path.data() + path.size(), groups, route.regex)) {
+                    match.clear();
+                    for(auto& group: groups)
+                        match.push_back(group.matched
+                            ? std::string_view(group.first, group.second - group.first) : std::string_view());
+                    return h;
+                }
+            }
+
+            if(handler) {
+                const Route& route = routes[best];
+                match.clear();
+                match.push_back(path);
+                if(route.kind == Kind::prefix && route.capture) {
+                    std::string_view rest = path.substr(route.prefix);
+                    if(route.optional_slash && !rest.empty() && rest.front() == '/')
+                        rest.remove_prefix(1);
+                    match.push_back(rest);
+                }
+            }
+            return handler;
+        }
+
+    private:
+        enum class Kind { literal, prefix, regex };
+
+        struct Route {
+            Kind kind = Kind::regex;
+            // prefix routes: the rest of the path is group 1; "/?" follows the prefix
+            bool capture = false, optional_slash = false;
+            size_t prefix = 0;
+            // regex routes: text every matching path begins with
+            std::string literal;
+            std::regex regex;
+            // few methods per route, a linear search beats hashing
+            std::vector< std::pair<std::string, const Handler*> > methods;
+
+            const Handler* handler(std::string_view method) const {
+                for(auto& m: methods)
+                    if(m.first == method)
+                        return m.second;
+                return nullptr;
+            }
+        };
+
+        // lookup with string_view keys, without building a std::string
+        struct Hash {
+            using is_transparent = void;
+            size_t operator()(std::string_view s) const { return std::hash<std::string_view>()(s); }
+        };
+        typedef std::unordered_map<std::string, std::vector<size_t>, Hash, std::equal_to<>> Index;
+
+        // Split `pattern` into the literal text at its beginning and the
+        // regex that follows, without the anchors. A "/?" right after the
+        // literal is reported in `optional_slash`.
+        static std::string_view split_literal(std::string_view pattern, std::string& literal, bool& optional_slash) {
+            if(!pattern.empty() && pattern.front() == '^')
+                pattern.remove_prefix(1);
+            if(pattern.size() >= 2 && pattern.back() == '$' && pattern[pattern.size() - 2] != '\\')
+                pattern.remove_suffix(1);
+            else if(pattern.size() == 1 && pattern.back() == '$')
+                pattern.remove_suffix(1);
+
+            size_t i = 0;
+            while(i < pattern.size()) {
+                char c = pattern[i];
+                if(c == '\\' && i + 1 < pattern.size() && std::string_view("^$\\.*+?()[]{}|/-").find(pattern[i + 1]) != std::string_view::npos) {
+                    literal += pattern[i + 1];
+                    i += 2;
+                    continue;
+                }
+                if(std::string_view("^$\\.*+?()[]{}|").find(c) != std::string_view::npos)
+                    break;
+                literal += c;
+                ++i;
+            }
+            // a quantifier applies to the last literal character only
+            std::string_view rest = pattern.substr(i);
+            if(!rest.empty() && std::string_view("*+?{").find(rest.front()) != std::string_view::npos) {
+                if(literal.size() >= 1 && literal.back() == '/' && rest.front() == '?' && pattern[i - 1] == '/') {
+                    literal.pop_back();
+                    optional_slash = true;
+                    return rest.substr(1);
+                }
+                // not a form we know, leave the whole pattern to the regex,
+                // the literal without the optional character still begins every match
+                if(!literal.empty())
+                    literal.pop_back();
+                return pattern;
+            }
+            return rest;
+        }
+
+        std::vector<Route> routes;
+        Index literals, prefixes;
+        // distinct lengths of the prefixes, ascending
+        std::set<size_t> prefix_lengths;
+        // indices of the routes that need a regex, ascending
+        std::vector<size_t> regexes;
+    };
+}
+#endif /* ROUTE_TABLE_HPP */
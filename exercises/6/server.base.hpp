@@ -8,27 +8,200 @@
 #ifndef SERVER_BASE_HPP
 #define SERVER_BASE_HPP
 
+// asio of boost 1.7x uses std::exchange without including <utility>
+#include <utility>
 #include <boost/asio.hpp>
 
 #include <regex>
 #include <unordered_map>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <algorithm>
+#include <type_traits>
+#include <array>
+#include <optional>
+#include <memory_resource>
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <netinet/tcp.h>
+#endif
+
+#include "http.parser.hpp"
+#include "route.table.hpp"
+#include "metrics.hpp"
+#include "compression.hpp"
 
 namespace Web {
+    // The content of a request to a streaming resource, handed to the
+    // handler in chunks as it arrives. A chunk refers to the read buffer
+    // and is valid during the call only. The socket is read again after
+    // the call returned, so no more than a chunk is buffered, and a slow
+    // handler slows down the client instead of filling the memory.
+    class RequestBody {
+    public:
+        typedef std::function<void(std::string_view)> chunk_handler;
+        typedef std::function<void()> end_handler;
+
+        // `on_chunk` receives the content, `on_end` is called after the
+        // last chunk, the response must be written by then. Neither is
+        // called once the connection failed. A content nobody reads is
+        // discarded.
+        void read(chunk_handler on_chunk, end_handler on_end) {
+            this->on_chunk = std::move(on_chunk);
+            this->on_end = std::move(on_end);
+        }
+
+        // bytes of the content received so far
+        uint64_t size() const { return received; }
+
+    private:
+        template <typename socket_type> friend class ServerBase;
+
+        chunk_handler on_chunk;
+        end_handler on_end;
+        uint64_t received = 0;
+    };
+
     struct Request {
+        // the header and the captured groups are allocated from `memory`
+        explicit Request(std::pmr::memory_resource* memory = std::pmr::get_default_resource()) :
+            header(memory), path_match(memory), head(memory) {}
+        // method, path and header refer to `head`, a copy would dangle
+        Request(const Request&) = delete;
+        Request& operator=(const Request&) = delete;
+
         // request method, POST, GET; path; HTTP version
-        std::string method, path, http_version;
+        std::string_view method, path, http_version;
         // use smart pointer for reference counting of content
         std::shared_ptr<std::istream> content;
-        // hash container, key-value dict
-        std::unordered_map<std::string, std::string> header;
-        // use regular expression for path match
-        std::smatch path_match;
+        // the content as it arrives, instead of `content`, for streaming resources
+        std::shared_ptr<RequestBody> body;
+        // header fields in order of arrival, lookup ignores case
+        Headers header;
+        // the path and the groups captured by the route
+        PathMatch path_match;
+        // request line and header as received, owns the bytes of the views above
+        std::pmr::string head;
+    };
+
+    // the content of a request, a window of the read buffer, which is
+    // read in place
+    class ContentBuffer : public std::streambuf {
+    public:
+        void assign(const char* data, size_t size) {
+            char* begin = const_cast<char*>(data);
+            setg(begin, begin, begin + size);
+        }
+    };
+
+    // an open file, shared by the file cache and the responses sending it
+    struct OpenFile {
+        OpenFile() = default;
+        OpenFile(const OpenFile&) = delete;
+        OpenFile& operator=(const OpenFile&) = delete;
+        ~OpenFile() { if(fd >= 0) ::close(fd); }
+
+        int fd = -1;
+        uint64_t size = 0;
+        // modification time and inode, to notice that the file was replaced
+        int64_t mtime = 0;
+        uint64_t inode = 0;
+    };
+
+    // What a handler writes is sent as the response. Besides the stream,
+    // a handler may append a shared buffer, e.g. a cached response, or a
+    // region of a file, that is sent from the page cache with sendfile(2)
+    // for HTTP, or through mmap for HTTPS, instead of being copied into the
+    // stream, or a source that produces the content while it is sent.
+    // Handlers taking a std::ostream& still work.
+    class Response : public std::ostream {
+    public:
+        // fills `buffer` with up to `size` bytes and returns their number, 0 at the end
+        typedef std::function<size_t(char* buffer, size_t size)> source_type;
+
+        Response() : std::ostream(nullptr) { rdbuf(&buffer); }
+
+        // send `data` after the stream, it is not copied
+        void send_buffer(std::shared_ptr<const std::string> data) {
+            shared = std::move(data);
+        }
+
+        // send `length` bytes of `file` beginning at `offset` after the stream
+        void send_file(std::shared_ptr<const OpenFile> file, uint64_t offset, uint64_t length) {
+            this->file = std::move(file);
+            file_offset = offset;
+            file_length = length;
+        }
+
+        // Answer later, e.g. after a coroutine waited for something: the
+        // response is sent once the returned function was called, from any
+        // thread. The request stays valid and the connection waits until then.
+        std::function<void()> defer() {
+            deferred = true;
+            return defer_hook(defer_context);
+        }
+
+        // the executor of the connection, handlers may wait on it without blocking
+        const boost::asio::any_io_executor& get_executor() const { return executor; }
+
+        // bytes written to the stream so far
+        size_t size() const { return buffer.size(); }
+
+        // send what `source` produces after the stream, a block whenever the
+        // socket took the one before; `chunked` frames the blocks in chunked
+        // transfer coding, the stream must then say "Transfer-Encoding: chunked",
+        // otherwise it must give the Content-Length
+        void send_source(source_type source, bool chunked = true) {
+            this->source = std::move(source);
+            this->chunked = chunked;
+        }
+
+    private:
+        template <typename socket_type> friend class ServerBase;
+
+        // ready for the next response of the connection, the memory is kept
+        void reset() {
+            buffer.consume(buffer.size());
+            shared.reset();
+            file.reset();
+            file_offset = file_length = 0;
+            source = nullptr;
+            deferred = false;
+            clear();
+        }
+
+        boost::asio::streambuf buffer;
+        std::shared_ptr<const std::string> shared;
+        std::shared_ptr<const OpenFile> file;
+        uint64_t file_offset = 0, file_length = 0;
+        source_type source;
+        bool chunked = false;
+        // when the server began to parse the request, in TickClock ticks
+        uint64_t parse_started = 0;
+
+        // set by the server, defer() asks it for the function resuming the connection
+        bool deferred = false;
+        boost::asio::any_io_executor executor;
+        std::function<void()> (*defer_hook)(void*) = nullptr;
+        void* defer_context = nullptr;
     };
 
     // use typedef simplify resource type
-    typedef std::map<std::string, std::unordered_map<std::string,
-    std::function<void(std::ostream&, Request&)>>> resource_type;
+    typedef std::function<void(Response&, Request&)> handler_type;
+    typedef std::map<std::string, std::unordered_map<std::string, handler_type>> resource_type;
+
+#if defined(SO_REUSEPORT)
+    // lets several sockets listen on the same port
+    typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port_option;
+#endif
 
     // socket_type is HTTP or HTTPS
     template <typename socket_type>
@@ -36,24 +209,109 @@ namespace Web {
     public:
         resource_type resource;
         resource_type default_resource;
+        // resources called as soon as the header arrived, they read the
+        // content through request.body, e.g. large uploads; looked up first
+        resource_type stream_resource;
+
+        // larger contents of other resources are answered with 413
+        uint64_t max_content_length = 64 << 20;
+
+        // responses of pipelined requests sent with one write, 1 answers
+        // the requests of a connection one at a time
+        size_t pipeline_depth = 16;
+
+        // Run an io_context and an acceptor per thread instead of one
+        // io_service for all threads. The acceptors listen on the same port
+        // with SO_REUSEPORT, the kernel spreads the connections across them,
+        // and a connection is served by the thread that accepted it, no
+        // reactor or handler queue is shared. Ignored without SO_REUSEPORT.
+        bool reuse_port = false;
+
+        // Timeouts, 0 disables one. A request head must be complete within
+        // `header_timeout` of its first byte, the first one of a connection
+        // within `header_timeout` of the accept, so a client dribbling a
+        // header is cut off. Every read of a content and every write of a
+        // response must make progress within `body_timeout` and
+        // `send_timeout`, and a keep-alive connection is closed after
+        // `idle_timeout` without a request. A deferred response takes as long
+        // as it needs. Timed out connections are closed without an answer.
+        std::chrono::steady_clock::duration header_timeout = std::chrono::seconds(10);
+        std::chrono::steady_clock::duration body_timeout = std::chrono::seconds(30);
+        std::chrono::steady_clock::duration send_timeout = std::chrono::seconds(30);
+        std::chrono::steady_clock::duration idle_timeout = std::chrono::seconds(60);
+
+        // At most this many connections are open, 0 for no limit. The
+        // acceptors stop accepting while there are as many, new clients wait
+        // in the listen backlog until a connection closed.
+        size_t max_connections = 10000;
+
+        // larger request heads are answered with 431
+        size_t max_header_size = 16 << 10;
+
+        // Responses written to the stream are gzip compressed for clients
+        // that accept it: a "200 OK" with a Content-Length, at least
+        // compression.min_size long and of a type that is not compressed
+        // already. Shared buffers, files and sources are sent as they are.
+        Compression compression;
+
+        // Request counts and latencies, recorded by every io thread into its
+        // own shard, see write_metrics(). Turning it off saves a few clock
+        // readings per request. Set it before start().
+        bool record_metrics = true;
+        Metrics metrics;
+
+        struct Stats {
+            // open now, and accepted since the construction
+            uint64_t connections = 0, accepted = 0;
+            // connections closed because they timed out
+            uint64_t header_timeouts = 0, body_timeouts = 0, send_timeouts = 0, idle_timeouts = 0;
+            // requests refused because their head was larger than max_header_size
+            uint64_t headers_too_large = 0;
+        };
 
         // construct server, initalize port, default: 1 thread
         ServerBase(unsigned short port, size_t num_threads = 1) :
             endpoint(boost::asio::ip::tcp::v4(), port),
             acceptor(m_io_service, endpoint),
-            num_threads(num_threads) {}
+            num_threads(num_threads) {
+            // the port chosen by the system if 0 was given
+            endpoint = acceptor.local_endpoint();
+        }
 
         void start() {
-            // default resource in the end of vector, as response method
+            // compile the routes once, default resource in the end, as response method
+            // resources must not be changed after the server has started
+            routes.clear();
+            stream_routes.clear();
+            for(auto it = stream_resource.begin(); it != stream_resource.end(); it++) {
+                stream_routes.add(it->first, it->second);
+            }
             for(auto it = resource.begin(); it != resource.end(); it++) {
-                all_resources.push_back(it);
+                routes.add(it->first, it->second);
             }
             for(auto it = default_resource.begin(); it != default_resource.end(); it++) {
-                all_resources.push_back(it);
+                routes.add(it->first, it->second);
             }
 
+            // deadlines are checked at least this often, see watch()
+            watch_interval = std::chrono::steady_clock::duration::zero();
+            for(auto timeout: {header_timeout, body_timeout, send_timeout, idle_timeout})
+                if(timeout.count() > 0 && (watch_interval.count() == 0 || timeout < watch_interval))
+                    watch_interval = timeout;
+
+#if defined(SO_REUSEPORT)
+            if(reuse_port && num_threads > 1) {
+                run_per_thread();
+                return;
+            }
+#endif
+
             // socket connection
-            accept();
+            accept(acceptor);
+
+            // an acceptor waiting at max_connections has no operation
+            // pending, run() would return without the guard; stop() ends it
+            auto work = boost::asio::make_work_guard(m_io_service);
 
             // if num_threads>1, then m_io_service.run()
             // it will start (num_threads-1) threads as thread pool
@@ -69,8 +327,88 @@ namespace Web {
             // wait for other threads finish
             for(auto& t: threads)
                 t.join();
+            threads.clear();
+            resume_none();
+        }
+
+        // let start() return, connections are dropped
+        void stop() {
+            std::lock_guard<std::mutex> lock(contexts_mutex);
+            m_io_service.stop();
+            for(auto& context: contexts)
+                context->stop();
+        }
+
+        // the port the server listens on, the one chosen by the system if 0 was given
+        unsigned short port() const {
+            return endpoint.port();
+        }
+
+        Stats stats() const {
+            Stats stats;
+            stats.connections = open_connections.load(std::memory_order_relaxed);
+            stats.accepted = accepted_connections.load(std::memory_order_relaxed);
+            stats.header_timeouts = header_timeouts.load(std::memory_order_relaxed);
+            stats.body_timeouts = body_timeouts.load(std::memory_order_relaxed);
+            stats.send_timeouts = send_timeouts.load(std::memory_order_relaxed);
+            stats.idle_timeouts = idle_timeouts.load(std::memory_order_relaxed);
+            stats.headers_too_large = headers_too_large.load(std::memory_order_relaxed);
+            return stats;
+        }
+
+        // the metrics and the stats in the Prometheus text format
+        void write_metrics(std::ostream& out) const {
+            Stats stats = this->stats();
+            Metrics::Totals totals = metrics.totals();
+            auto counter = [&out](const char* name, const char* type, const char* help) -> std::ostream& {
+                return out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+            };
+
+            counter("http_requests_total", "counter", "Requests received.")
+                << "http_requests_total " << totals.requests << '\n';
+            counter("http_responses_total", "counter", "Responses sent, by status class.");
+            for(size_t s = 1; s < totals.status.size(); ++s)
+                out << "http_responses_total{code=\"" << s << "xx\"} " << totals.status[s] << '\n';
+            out << "http_responses_total{code=\"other\"} " << totals.status[0] << '\n';
+            counter("http_requests_aborted_total", "counter", "Requests dropped without a response.")
+                << "http_requests_aborted_total " << totals.aborted << '\n';
+            counter("http_requests_in_flight", "gauge", "Requests received and not answered yet.")
+                << "http_requests_in_flight " << totals.in_flight() << '\n';
+
+            counter("http_connections", "gauge", "Open connections.")
+                << "http_connections " << stats.connections << '\n';
+            counter("http_connections_accepted_total", "counter", "Connections accepted.")
+                << "http_connections_accepted_total " << stats.accepted << '\n';
+            counter("http_timeouts_total", "counter", "Connections closed because they timed out, by what they waited for.")
+                << "http_timeouts_total{wait=\"header\"} " << stats.header_timeouts << '\n'
+                << "http_timeouts_total{wait=\"body\"} " << stats.body_timeouts << '\n'
+                << "http_timeouts_total{wait=\"send\"} " << stats.send_timeouts << '\n'
+                << "http_timeouts_total{wait=\"idle\"} " << stats.idle_timeouts << '\n';
+            counter("http_headers_too_large_total", "counter", "Requests refused because of the size of their head.")
+                << "http_headers_too_large_total " << stats.headers_too_large << '\n';
+
+            Metrics::write_histogram(out, "http_request_duration_seconds",
+                "Time from parsing the request head until the response was sent, pipelined ones from the read they came with.", totals.timers[Metrics::request]);
+            Metrics::write_histogram(out, "http_parse_duration_seconds",
+                "Time parsing a request head and finding its resource, sampled.", totals.timers[Metrics::parse]);
+            Metrics::write_histogram(out, "http_handler_duration_seconds",
+                "Time in resource handlers, until they returned, sampled.", totals.timers[Metrics::handle]);
+            Metrics::write_histogram(out, "http_write_duration_seconds",
+                "Time of a gathered write of responses, sampled.", totals.timers[Metrics::write]);
         }
     protected:
+        // open connections and the acceptors waiting for one to close,
+        // declared before the io_service, sockets destroyed with it are
+        // counted. Accepts and closes only touch the counters, the mutex is
+        // taken when an acceptor waits at max_connections or goes on.
+        std::atomic<size_t> open_connections{0};
+        std::atomic<uint64_t> accepted_connections{0};
+        std::mutex paused_mutex;
+        std::vector<boost::asio::ip::tcp::acceptor*> paused;
+        std::atomic<size_t> paused_count{0};
+        mutable std::atomic<uint64_t> header_timeouts{0}, body_timeouts{0}, send_timeouts{0}, idle_timeouts{0};
+        mutable std::atomic<uint64_t> headers_too_large{0};
+
         // io_service is a dispatcher in asio library, all asynchronous io events are dispatched by it
         // in another word, constructor of IO object need a io_service object as parameter
         boost::asio::io_service m_io_service;
@@ -84,112 +422,908 @@ namespace Web {
         size_t num_threads;
         std::vector<std::thread> threads;
 
-        // all resource will be append to the end of vector, and created in start()
-        std::vector<resource_type::iterator> all_resources;
+        // with reuse_port, the io_contexts of threads other than the main
+        // thread and their acceptors, destroyed before the contexts
+        std::mutex contexts_mutex;
+        std::vector< std::unique_ptr<boost::asio::io_context> > contexts;
+        std::vector< std::unique_ptr<boost::asio::ip::tcp::acceptor> > acceptors;
+
+        // all resources in order, default resources in the end, created in start()
+        RouteTable<handler_type> routes;
+        RouteTable<handler_type> stream_routes;
+
+        // requires to implement this method for different type of server,
+        // sockets are created on the io_context of the acceptor; its
+        // completion calls accepted(), the socket calls closed() when it
+        // is destroyed
+        virtual void accept(boost::asio::ip::tcp::acceptor& acceptor) {}
+
+        // Count the connection the acceptor established, `connected` is
+        // false if the accept failed, and accept the next one, unless
+        // max_connections are open; the acceptor then waits for closed().
+        void accepted(boost::asio::ip::tcp::acceptor& acceptor, bool connected) {
+            size_t open = open_connections.load();
+            if(connected) {
+                open = open_connections.fetch_add(1) + 1;
+                accepted_connections.fetch_add(1, std::memory_order_relaxed);
+            }
+            if(max_connections > 0 && open >= max_connections) {
+                {
+                    std::lock_guard<std::mutex> lock(paused_mutex);
+                    paused.push_back(&acceptor);
+                    paused_count.fetch_add(1);
+                }
+                // a connection may have closed before the acceptor was listed
+                resume_one();
+                return;
+            }
+            accept(acceptor);
+        }
+
+        // a socket is destroyed, on any thread; it was a connection if it
+        // was accepted, a waiting acceptor goes on
+        void closed(socket_type& socket) {
+            if(!socket.lowest_layer().is_open())
+                return;
+            // both sequentially consistent, either this sees the acceptor
+            // listed or accepted() sees the connection gone
+            size_t open = open_connections.fetch_sub(1) - 1;
+            if(paused_count.load() > 0 && open < max_connections)
+                resume_one();
+        }
+
+        // a waiting acceptor goes on if there is room for a connection
+        void resume_one() {
+            boost::asio::ip::tcp::acceptor* acceptor;
+            {
+                std::lock_guard<std::mutex> lock(paused_mutex);
+                if(paused.empty() || open_connections.load() >= max_connections)
+                    return;
+                acceptor = paused.back();
+                paused.pop_back();
+                paused_count.fetch_sub(1);
+            }
+            boost::asio::post(acceptor->get_executor(), [this, acceptor] {
+                accept(*acceptor);
+            });
+        }
+
+        // the io_contexts have stopped, their acceptors are not resumed any more
+        void resume_none() {
+            std::lock_guard<std::mutex> lock(paused_mutex);
+            paused.clear();
+            paused_count.store(0);
+        }
+
+#if defined(SO_REUSEPORT)
+        // the main thread keeps m_io_service, its acceptor is bound again
+        // with SO_REUSEPORT, every other thread gets its own io_context
+        void run_per_thread() {
+            auto listen = [this](boost::asio::ip::tcp::acceptor& acceptor) {
+                acceptor.open(endpoint.protocol());
+                acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+                acceptor.set_option(reuse_port_option(true));
+                acceptor.bind(endpoint);
+                acceptor.listen();
+            };
+
+            {
+                std::lock_guard<std::mutex> lock(contexts_mutex);
+                acceptor.close();
+                listen(acceptor);
+                for(size_t c = 1; c < num_threads; c++) {
+                    // concurrency hint: a single thread runs the context
+                    contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+                    acceptors.push_back(std::make_unique<boost::asio::ip::tcp::acceptor>(*contexts.back()));
+                    listen(*acceptors.back());
+                }
+                // stop() was called before the contexts existed
+                if(m_io_service.stopped())
+                    for(auto& context: contexts)
+                        context->stop();
+            }
+
+            // keeps a context running while its acceptor waits at
+            // max_connections with no connection of its own
+            std::vector< boost::asio::executor_work_guard<boost::asio::io_context::executor_type> > work;
+            work.push_back(boost::asio::make_work_guard(m_io_service));
+            for(auto& context: contexts)
+                work.push_back(boost::asio::make_work_guard(*context));
+
+            accept(acceptor);
+            for(size_t c = 1; c < num_threads; c++) {
+                accept(*acceptors[c - 1]);
+                threads.emplace_back([this, c](){
+                    contexts[c - 1]->run();
+                });
+            }
+            m_io_service.run();
+
+            for(auto& t: threads)
+                t.join();
+            threads.clear();
+            resume_none();
+            // before the contexts they refer to are gone
+            work.clear();
+
+            std::lock_guard<std::mutex> lock(contexts_mutex);
+            acceptors.clear();
+            contexts.clear();
+        }
+#endif
+
+        // bytes requested from the socket per read
+        static constexpr size_t read_size = 4096;
+
+        // what a connection waits for, each with its own timeout
+        enum class Wait : uint8_t { none, header, body, send, idle };
 
-        // requires to implement this method for different type of server
-        virtual void accept() {}
+        // Everything a connection needs, kept for its lifetime. The buffers,
+        // the parser and the responses are reused by every request of a
+        // keep-alive connection. The request is built in place in an arena,
+        // which is reset after each response, so a request does not touch
+        // the heap unless its header outgrows the arena.
+        struct Connection : std::enable_shared_from_this<Connection> {
+            Connection(const ServerBase* server, std::shared_ptr<socket_type> socket) :
+                server(server), socket(std::move(socket)), timer(this->socket->get_executor()),
+                arena(arena_buffer.data(), arena_buffer.size()) {}
+
+            // requests that will not be answered
+            ~Connection() {
+                if(server->record_metrics && (request || batch > 0))
+                    server->metrics.local().aborted.add(batch + (request ? 1 : 0));
+            }
+
+            const ServerBase* server;
+            std::shared_ptr<socket_type> socket;
+
+            // what the connection waits for and until when, set by the io
+            // thread, checked by `timer` on any thread
+            std::atomic<Wait> wait{Wait::none};
+            std::atomic<std::chrono::steady_clock::time_point> deadline{std::chrono::steady_clock::time_point::max()};
+            boost::asio::steady_timer timer;
+
+            boost::asio::streambuf read_buffer;
+            RequestParser parser;
+
+            std::array<std::byte, 4096> arena_buffer;
+            std::pmr::monotonic_buffer_resource arena;
+            // destroyed before the arena is reset
+            std::optional<Request> request;
+            // when the server began to parse it, in TickClock ticks
+            uint64_t parse_started = 0;
+
+            // the content of the request, a window of read_buffer, or of
+            // `decoded` if it was chunked
+            ContentBuffer content_buffer;
+            std::istream content{&content_buffer};
+            // bytes of the content left to read if it is not chunked
+            uint64_t content_length = 0;
+            bool chunked = false;
+            ChunkedDecoder decoder;
+            std::string decoded;
+            bool keep_alive = false;
+
+            // the resource of the request; a streaming one is called before
+            // the content is read, once the responses before it are sent
+            const handler_type* handler = nullptr;
+            bool streaming = false, started = false;
+            RequestBody body;
+
+            // a malformed request is answered after the responses before it
+            std::string_view failure;
+
+            // responses of pipelined requests, written together, the first
+            // `batch` are in use; and the buffers of one gathered write
+            std::vector< std::unique_ptr<Response> > responses;
+            size_t batch = 0;
+            std::vector<boost::asio::const_buffer> gather;
+
+            // a block of a response source and its chunk size line
+            std::vector<char> block;
+            std::array<char, 32> chunk_line;
+        };
 
         void process_request_and_respond(std::shared_ptr<socket_type> socket) const {
-            // created cache for async_read_untile()
             // shared_ptr will use for passing object to anonymous function
-            // the type will be deduce as std::shared_ptr<boost::asio::streambuf>
-            auto read_buffer = std::make_shared<boost::asio::streambuf>();
-
-            boost::asio::async_read_until(*socket, *read_buffer, "\r\n\r\n",
-            [this, socket, read_buffer](const boost::system::error_code& ec, size_t bytes_transferred) {
-                if(!ec) {
-                    // Note: read_buffer->size() always equal to bytes_transferred, the document of Boost indicates:
-                    // after async_read_until operation, streambuf contains some extra data out of delimiter
-                    // thus, the best way is to read and parse the content from the left of read_buffer, then append the content of async_read
-                    size_t total = read_buffer->size();
-
-                    // convert istream to string-lines
-                    std::istream stream(read_buffer.get());
-
-                    // deduce the type of std::shared_ptr<Request>
-                    auto request = std::make_shared<Request>();
-                    *request = parse_request(stream);
-
-                    size_t num_additional_bytes = total-bytes_transferred;
-
-                    // if satisfy then also read
-                    if(request->header.count("Content-Length")>0) {
-                        boost::asio::async_read(*socket, *read_buffer,
-                        boost::asio::transfer_exactly(stoull(request->header["Content-Length"]) - num_additional_bytes),
-                        [this, socket, read_buffer, request](const boost::system::error_code& ec, size_t bytes_transferred) {
-                            if(!ec) {
-                                // pointer as istream object stored in read_buffer
-                                request->content = std::shared_ptr<std::istream>(new std::istream(read_buffer.get()));
-                                respond(socket, request);
-                            }
-                        });
-                    } else {
-                        respond(socket, request);
+            // the type will be deduce as std::shared_ptr<Connection>
+            auto connection = std::make_shared<Connection>(this, std::move(socket));
+            if(watch_interval.count() > 0)
+                watch(connection);
+            read_request(connection);
+        }
+
+        // the shortest timeout, 0 if there is none
+        std::chrono::steady_clock::duration watch_interval{};
+
+        // the connection waits for `wait` from now on, until its timeout
+        void expect(Connection& c, Wait wait) const {
+            std::chrono::steady_clock::duration timeout{};
+            switch(wait) {
+            case Wait::none:   break;
+            case Wait::header: timeout = header_timeout; break;
+            case Wait::body:   timeout = body_timeout; break;
+            case Wait::send:   timeout = send_timeout; break;
+            case Wait::idle:   timeout = idle_timeout; break;
+            }
+            c.deadline.store(timeout.count() > 0 ? std::chrono::steady_clock::now() + timeout
+                                                 : std::chrono::steady_clock::time_point::max(),
+                             std::memory_order_relaxed);
+            c.wait.store(wait, std::memory_order_relaxed);
+        }
+
+        // Shut down a connection that missed its deadline. The io threads
+        // only store deadlines, the timer of a connection is not re-armed
+        // when one changes; it wakes up at least every watch_interval
+        // instead, which is before any deadline that was set meanwhile.
+        void watch(const std::weak_ptr<Connection>& weak) const {
+            auto connection = weak.lock();
+            if(!connection)
+                return;
+            Connection& c = *connection;
+            auto now = std::chrono::steady_clock::now();
+            auto deadline = c.deadline.load(std::memory_order_relaxed);
+            if(deadline <= now) {
+                time_out(*c.socket, c.wait.load(std::memory_order_relaxed));
+                return;
+            }
+            c.timer.expires_at(std::min(deadline, now + watch_interval));
+            c.timer.async_wait([this, weak](const boost::system::error_code& ec) {
+                if(!ec)
+                    watch(weak);
+            });
+        }
+
+        // The pending operation of the socket fails, whatever thread runs
+        // it, and the connection is released. Only the descriptor is
+        // touched, the socket object belongs to the io thread.
+        void time_out(socket_type& socket, Wait wait) const {
+            switch(wait) {
+            case Wait::none:   return;
+            case Wait::header: header_timeouts.fetch_add(1, std::memory_order_relaxed); break;
+            case Wait::body:   body_timeouts.fetch_add(1, std::memory_order_relaxed); break;
+            case Wait::send:   send_timeouts.fetch_add(1, std::memory_order_relaxed); break;
+            case Wait::idle:   idle_timeouts.fetch_add(1, std::memory_order_relaxed); break;
+            }
+            ::shutdown(socket.lowest_layer().native_handle(), SHUT_RDWR);
+        }
+
+        // Answer every complete request that was received, then write the
+        // responses with one gathered write, or read more if nothing is
+        // complete. HTTP/1.1 clients may pipeline, i.e. send requests
+        // without waiting for the responses, they all arrive in one read.
+        // The parser goes on where it stopped, thus a header split across
+        // reads is scanned once.
+        void read_request(std::shared_ptr<Connection> connection) const {
+            Connection& c = *connection;
+            // A clock reading costs about as much as parsing a small
+            // request, so a request takes one at the start of its read and
+            // one when its response was sent, shared by a pipelined batch.
+            // The steps are timed for the first request of one read in
+            // Metrics::sample_every, a step ends where the next begins. A
+            // call that only issues the next read does not count, every
+            // other call would be one.
+            Metrics::Shard* shard = record_metrics ? &metrics.local() : nullptr;
+            bool sampled = shard && c.read_buffer.size() > 0 && shard->reads++ % Metrics::sample_every == 0;
+            uint64_t start = shard ? TickClock::now() : 0, mark = start;
+            bool timing = sampled;
+
+            while(c.batch < pipeline_depth) {
+                if(!c.request) {
+                    if(!next_request(c, shard))
+                        break;
+                    c.parse_started = start;
+                    if(timing) {
+                        uint64_t now = TickClock::now();
+                        shard->timers[Metrics::parse].record(TickClock::nanoseconds(now - mark));
+                        mark = now;
                     }
                 }
-            });
+                if(!read_content(c))
+                    break;
+
+                Response* response = respond(c);
+                if(timing) {
+                    uint64_t now = TickClock::now();
+                    shard->timers[Metrics::handle].record(TickClock::nanoseconds(now - mark));
+                    mark = now;
+                    timing = false;
+                } else {
+                    // the write is not issued at the end of the first handler
+                    mark = 0;
+                }
+                // deferred, resume() goes on
+                if(!response)
+                    return;
+                // a file or a source goes out after the buffers before it;
+                // an HTTP/1.0 connection closes after its response
+                if(response->file || response->source || !c.keep_alive)
+                    break;
+            }
+
+            if(c.batch > 0) {
+                // the write is issued when the last handler returned
+                write_responses(connection, sampled, mark);
+            } else if(!c.failure.empty()) {
+                fail(c.socket, c.failure);
+            } else {
+                // what is missing of the header or the content, a chunk at a
+                // time if the content is streamed or chunked
+                size_t size = read_size;
+                if(c.request && (c.streaming || c.chunked))
+                    size = body_chunk_size;
+                else if(c.request)
+                    size = std::max(size, static_cast<size_t>(c.content_length - c.read_buffer.size()));
+
+                // the content must make progress; a head has its time from
+                // the first byte on, an empty buffer after a response is idle
+                Wait wait = c.wait.load(std::memory_order_relaxed);
+                if(c.request)
+                    expect(c, Wait::body);
+                else if(c.read_buffer.size() == 0 && wait == Wait::send)
+                    expect(c, Wait::idle);
+                else if(wait != Wait::header)
+                    expect(c, Wait::header);
+
+                c.socket->async_read_some(c.read_buffer.prepare(size),
+                [this, connection](const boost::system::error_code& ec, size_t bytes_transferred) {
+                    if(ec)
+                        return;
+                    connection->read_buffer.commit(bytes_transferred);
+                    read_request(connection);
+                });
+            }
+        }
+
+        // bytes of a streamed or chunked content read and handed out at once
+        static constexpr size_t body_chunk_size = 64 * 1024;
+
+        static constexpr std::string_view bad_request_response =
+            "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        static constexpr std::string_view too_large_response =
+            "HTTP/1.1 413 Payload Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        static constexpr std::string_view header_too_large_response =
+            "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+        // parse the next request head in the buffer and find its resource,
+        // false if it is not complete or the request is refused
+        bool next_request(Connection& c, Metrics::Shard* shard) const {
+            if(!c.failure.empty())
+                return false;
+
+            // the parser works on the bytes in the buffer, nothing is copied
+            auto data = static_cast<const char*>(c.read_buffer.data().data());
+            switch(c.parser.parse(data, c.read_buffer.size())) {
+            case RequestParser::Result::incomplete:
+                // the buffer holds nothing but the head, it must not grow without end
+                if(c.read_buffer.size() > max_header_size)
+                    return refuse_head(c);
+                return false;
+            case RequestParser::Result::error:
+                c.failure = bad_request_response;
+                return false;
+            case RequestParser::Result::complete:
+                if(c.parser.size() > max_header_size)
+                    return refuse_head(c);
+                break;
+            }
+
+            c.request.emplace(&c.arena);
+            if(shard)
+                shard->requests.add();
+            Request& request = *c.request;
+            make_request(c.parser, data, request);
+            c.read_buffer.consume(c.parser.size());
+            c.parser.reset();
+            c.keep_alive = request.http_version >= "1.1"
+                           && !Headers::equals(request.header.get("Connection"), "close");
+
+            // the content ends after Content-Length bytes or with the last chunk,
+            // a request with both may try to smuggle another one past a proxy
+            c.content_length = 0;
+            c.chunked = false;
+            auto encoding = request.header.find("Transfer-Encoding");
+            auto length = request.header.find("Content-Length");
+            if(encoding != request.header.end()) {
+                if(!Headers::equals(encoding->second, "chunked") || length != request.header.end())
+                    return refuse(c, bad_request_response);
+                c.chunked = true;
+                c.decoder.reset();
+            } else if(length != request.header.end()) {
+                auto value = length->second;
+                auto result = std::from_chars(value.data(), value.data() + value.size(), c.content_length);
+                if(result.ec != std::errc() || result.ptr != value.data() + value.size())
+                    return refuse(c, bad_request_response);
+            }
+
+            c.started = false;
+            c.handler = stream_routes.size() ? stream_routes.find(request.method, request.path, request.path_match) : nullptr;
+            c.streaming = c.handler != nullptr;
+            if(!c.streaming) {
+                c.handler = routes.find(request.method, request.path, request.path_match);
+                if(c.content_length > max_content_length)
+                    return refuse(c, too_large_response);
+            }
+            return true;
         }
 
-        Request parse_request(std::istream& stream) const {
-            Request request;
+        // drop the current request, the connection is closed after the answer
+        bool refuse(Connection& c, std::string_view response) const {
+            if(record_metrics && c.request)
+                metrics.local().aborted.add();
+            c.request.reset();
+            c.arena.release();
+            c.body.read(nullptr, nullptr);
+            c.failure = response;
+            return false;
+        }
 
-            std::regex e("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
+        bool refuse_head(Connection& c) const {
+            headers_too_large.fetch_add(1, std::memory_order_relaxed);
+            c.failure = header_too_large_response;
+            return false;
+        }
 
-            std::smatch sub_match;
+        // copy the request head out of the read buffer once, and let the
+        // fields of the request refer to the copy
+        static void make_request(const RequestParser& parser, const char* data, Request& request) {
+            request.head.assign(data, parser.size());
+            const char* base = request.head.data();
 
-            // read method, path and http version from the frist line
-            std::string line;
-            getline(stream, line);
-            line.pop_back();
-            if(std::regex_match(line, sub_match, e)) {
-                request.method       = sub_match[1];
-                request.path         = sub_match[2];
-                request.http_version = sub_match[3];
+            request.method       = parser.method.in(base);
+            request.path         = parser.path.in(base);
+            request.http_version = parser.version.in(base);
+            request.header.reserve(parser.headers.size());
+            for(auto& field: parser.headers)
+                request.header.push_back(Header(field.first.in(base), field.second.in(base)));
+        }
 
-                bool matched;
-                e="^([^:]*): ?(.*)$";
-                // parse head information
-                do {
-                    getline(stream, line);
-                    line.pop_back();
-                    matched=std::regex_match(line, sub_match, e);
-                    if(matched) {
-                        request.header[sub_match[1]] = sub_match[2];
+        // malformed or refused requests are answered and the connection is closed
+        void fail(std::shared_ptr<socket_type> socket, std::string_view response) const {
+            boost::asio::async_write(*socket, boost::asio::buffer(response.data(), response.size()),
+            [socket](const boost::system::error_code&, size_t) {});
+        }
+
+        // Take the content out of the read buffer, true once it is complete.
+        // A streaming resource receives it chunk by chunk, a chunked content
+        // is decoded into a buffer; any other stays in the read buffer and
+        // is read in place.
+        bool read_content(Connection& c) const {
+            if(c.streaming && !c.started) {
+                // the response goes after the ones before it, they are sent first
+                if(c.batch > 0)
+                    return false;
+                start_streaming(c);
+            }
+            if(!c.streaming && !c.chunked)
+                return c.read_buffer.size() >= c.content_length;
+
+            for(;;) {
+                auto data = static_cast<const char*>(c.read_buffer.data().data());
+                size_t size = std::min(c.read_buffer.size(), body_chunk_size);
+                std::string_view chunk;
+                size_t consumed = 0;
+                bool complete = false;
+
+                if(c.chunked) {
+                    switch(c.decoder.decode(data, size, consumed, chunk)) {
+                    case ChunkedDecoder::Result::error:
+                        return refuse(c, bad_request_response);
+                    case ChunkedDecoder::Result::incomplete:
+                        c.read_buffer.consume(consumed);
+                        return false;
+                    case ChunkedDecoder::Result::complete:
+                        complete = true;
+                        break;
+                    case ChunkedDecoder::Result::data:
+                        break;
                     }
+                } else {
+                    consumed = static_cast<size_t>(std::min<uint64_t>(c.content_length, size));
+                    chunk = std::string_view(data, consumed);
+                    c.content_length -= consumed;
+                    complete = c.content_length == 0;
+                    if(consumed == 0 && !complete)
+                        return false;
+                }
+
+                if(!chunk.empty()) {
+                    if(c.streaming) {
+                        c.body.received += chunk.size();
+                        if(c.body.on_chunk)
+                            c.body.on_chunk(chunk);
+                    } else if(c.decoded.size() + chunk.size() > max_content_length) {
+                        return refuse(c, too_large_response);
+                    } else {
+                        c.decoded.append(chunk);
+                    }
+                }
+                c.read_buffer.consume(consumed);
+                if(complete)
+                    return true;
+            }
+        }
+
+        // call a streaming resource with the response the request will get
+        void start_streaming(Connection& c) const {
+            c.started = true;
+            c.body.received = 0;
+            Request& request = *c.request;
+            // the body object stored in connection, the shared_ptr does not own it
+            request.body = std::shared_ptr<RequestBody>(std::shared_ptr<void>(), &c.body);
+            (*c.handler)(next_response(c), request);
+        }
+
+        // the response the current request gets, the next of the batch
+        Response& next_response(Connection& c) const {
+            if(c.batch == c.responses.size()) {
+                auto response = std::make_unique<Response>();
+                response->executor = c.socket->get_executor();
+                response->defer_hook = &resume_later;
+                response->defer_context = &c;
+                c.responses.push_back(std::move(response));
+            }
+            return *c.responses[c.batch];
+        }
+
+        // answer the current request, nullptr if the handler deferred its response
+        Response* respond(Connection& c) const {
+            Request& request = *c.request;
+            Response& response = next_response(c);
+
+            if(c.streaming) {
+                if(c.body.on_end)
+                    c.body.on_end();
+                c.body.read(nullptr, nullptr);
+            } else {
+                // the content is read in place, a handler cannot read past it
+                const char* data = c.chunked ? c.decoded.data() : static_cast<const char*>(c.read_buffer.data().data());
+                size_t size = c.chunked ? c.decoded.size() : static_cast<size_t>(c.content_length);
+                if(size > 0) {
+                    c.content_buffer.assign(data, size);
+                    c.content.clear();
+                    // pointer as istream object stored in connection, the shared_ptr does not own it
+                    request.content = std::shared_ptr<std::istream>(std::shared_ptr<void>(), &c.content);
+                }
+
+                if(c.handler)
+                    (*c.handler)(response, request);
+                else
+                    // nothing to answer with, the connection is closed after the responses before
+                    c.keep_alive = false;
+            }
+
+            // the handler has as long as it needs
+            if(response.deferred) {
+                expect(c, Wait::none);
+                return nullptr;
+            }
+            finish_request(c);
+            return &response;
+        }
+
+        // the response is complete and joins the batch
+        void finish_request(Connection& c) const {
+            if(compression.level > 0)
+                compress(*c.request, *c.responses[c.batch]);
+            if(!c.streaming && c.chunked) {
+                c.decoded.clear();
+                if(c.decoded.capacity() > body_chunk_size)
+                    c.decoded.shrink_to_fit();
+            } else if(!c.streaming) {
+                c.read_buffer.consume(c.content_length);
+            }
+
+            // the request is done, its memory goes back to the arena
+            c.responses[c.batch]->parse_started = c.parse_started;
+            c.content_length = 0;
+            c.request.reset();
+            c.arena.release();
+            ++c.batch;
+        }
+
+        // Gzip the content of a response in the stream if the client takes
+        // it, the header gets the new Content-Length and the coding. The
+        // content must be complete, i.e. its Content-Length is given. A
+        // client that does not take gzip gets the content as it is, with
+        // "Vary: Accept-Encoding" as well, so that a shared cache keeps
+        // the two apart.
+        void compress(const Request& request, Response& response) const {
+            if(response.buffer.size() < compression.min_size || response.shared || response.file || response.source)
+                return;
+            std::string_view message(static_cast<const char*>(response.buffer.data().data()), response.buffer.size());
+            size_t end = message.find("\r\n\r\n");
+            if(end == std::string_view::npos || message.compare(0, 13, "HTTP/1.1 200 ") != 0)
+                return;
+            std::string_view content = message.substr(end + 4);
+            if(content.size() < compression.min_size)
+                return;
+
+            // the header without Content-Length and the content to send,
+            // kept by the thread, the stream is written again from them
+            thread_local std::string head, compressed;
+            size_t line_end = message.find("\r\n");
+            head.assign(message.substr(0, line_end + 2));
+            bool length = false;
+            for(size_t pos = line_end + 2; pos < end + 2; pos = line_end + 2) {
+                line_end = message.find("\r\n", pos);
+                std::string_view line = message.substr(pos, line_end - pos);
+                size_t colon = line.find(':');
+                std::string_view name = line.substr(0, colon);
+                std::string_view value = colon == std::string_view::npos ? std::string_view() : line.substr(colon + 1);
+                while(!value.empty() && value.front() == ' ')
+                    value.remove_prefix(1);
+
+                if(Headers::equals(name, "Content-Encoding") || Headers::equals(name, "Transfer-Encoding")
+                   || (Headers::equals(name, "Content-Type") && compressed_type(value)))
+                    return;
+                if(Headers::equals(name, "Content-Length")) {
+                    uint64_t size = 0;
+                    auto result = std::from_chars(value.data(), value.data() + value.size(), size);
+                    if(result.ec != std::errc() || size != content.size())
+                        return;
+                    length = true;
+                    continue;
+                }
+                head.append(line).append("\r\n");
+            }
+            if(!length)
+                return;
+            if(accepts_gzip(request.header.get("Accept-Encoding"))) {
+                if(!gzip(content, compressed, compression.level) || compressed.size() >= content.size())
+                    return;
+                head.append("Content-Encoding: gzip\r\n");
+            } else {
+                compressed.assign(content);
+            }
+
+            std::array<char, 24> number;
+            head.append("Vary: Accept-Encoding\r\nContent-Length: ")
+                .append(number.data(), std::to_chars(number.data(), number.data() + number.size(), compressed.size()).ptr)
+                .append("\r\n\r\n");
+            response.buffer.consume(response.buffer.size());
+            response.buffer.sputn(head.data(), head.size());
+            response.buffer.sputn(compressed.data(), compressed.size());
+        }
+
+        // what Response::defer() hands out, the connection is kept until it is called
+        static std::function<void()> resume_later(void* context) {
+            auto connection = static_cast<Connection*>(context)->shared_from_this();
+            return [connection] {
+                // the handler may still be running, or on another thread
+                boost::asio::post(connection->socket->get_executor(), [connection] {
+                    connection->server->resume(connection);
+                });
+            };
+        }
+
+        // a deferred response is complete, the connection goes on
+        void resume(std::shared_ptr<Connection> connection) const {
+            Connection& c = *connection;
+            Response& response = *c.responses[c.batch];
+            response.deferred = false;
+            finish_request(c);
+            if(response.file || response.source || !c.keep_alive)
+                write_responses(connection);
+            else
+                read_request(connection);
+        }
 
-                } while(matched==true);
+        // the buffers of a gathered write, refers to the vector of the
+        // connection, which async_write would copy otherwise
+        struct Buffers {
+            using value_type = boost::asio::const_buffer;
+            using const_iterator = const boost::asio::const_buffer*;
+            const_iterator first, last;
+            const_iterator begin() const { return first; }
+            const_iterator end() const { return last; }
+        };
+
+        // write the batch with a single gathered write, the stream of every
+        // response and its shared buffer are separate buffers, nothing is
+        // concatenated; a file of the last response follows. The write is
+        // timed if `timed`, from `issued` if that is known.
+        void write_responses(std::shared_ptr<Connection> connection, bool timed = true, uint64_t issued = 0) const {
+            Connection& c = *connection;
+            c.gather.clear();
+            for(size_t i = 0; i < c.batch; ++i) {
+                Response& response = *c.responses[i];
+                if(response.buffer.size() > 0)
+                    c.gather.push_back(response.buffer.data());
+                if(response.shared)
+                    c.gather.push_back(boost::asio::buffer(*response.shared));
+            }
+
+            Response& last = *c.responses[c.batch - 1];
+            if(last.file)
+                cork(*c.socket, true);
+            expect(c, Wait::send);
+            if(record_metrics && timed && issued == 0)
+                issued = TickClock::now();
+
+            // capture connection in lambda, make sure the buffers live until async_write is done
+            boost::asio::async_write(*c.socket, Buffers{c.gather.data(), c.gather.data() + c.gather.size()},
+            [this, connection, timed, issued](const boost::system::error_code& ec, size_t bytes_transferred) {
+                if(ec)
+                    return;
+                uint64_t sent = 0;
+                if(record_metrics) {
+                    sent = TickClock::now();
+                    if(timed)
+                        metrics.local().timers[Metrics::write].record(TickClock::nanoseconds(sent - issued));
+                }
+                Connection& c = *connection;
+                if(c.responses[c.batch - 1]->file)
+                    send_file(connection);
+                else if(c.responses[c.batch - 1]->source)
+                    send_source(connection);
+                else
+                    keep_alive(connection, sent);
+            });
+        }
+
+        // 2 for "HTTP/1.1 200 OK", 0 if the response does not begin with a status line
+        static size_t status_class(const Response& response) {
+            std::string_view head;
+            if(response.buffer.size() > 0)
+                head = std::string_view(static_cast<const char*>(response.buffer.data().data()), response.buffer.size());
+            else if(response.shared)
+                head = *response.shared;
+            if(head.size() < 12 || head.compare(0, 5, "HTTP/") != 0 || head[9] < '1' || head[9] > '5')
+                return 0;
+            return static_cast<size_t>(head[9] - '0');
+        }
+
+        // the batch is sent, at `sent` if it is known, HTTP 1.1 connection goes on with the next requests
+        void keep_alive(std::shared_ptr<Connection> connection, uint64_t sent = 0) const {
+            Connection& c = *connection;
+            if(record_metrics) {
+                if(sent == 0)
+                    sent = TickClock::now();
+                Metrics::Shard& shard = metrics.local();
+                // requests parsed in the same read began together
+                for(size_t i = 0, same = 1; i < c.batch; i += same) {
+                    uint64_t started = c.responses[i]->parse_started;
+                    for(same = 1; i + same < c.batch && c.responses[i + same]->parse_started == started; ++same) {}
+                    shard.timers[Metrics::request].record(TickClock::nanoseconds(sent - started), same);
+                }
+                for(size_t i = 0; i < c.batch; ++i)
+                    shard.status[status_class(*c.responses[i])].add();
+                shard.responses.add(c.batch);
             }
-            return request;
+            for(size_t i = 0; i < c.batch; ++i)
+                c.responses[i]->reset();
+            c.batch = 0;
+            if(c.keep_alive)
+                read_request(connection);
         }
 
-        void respond(std::shared_ptr<socket_type> socket, std::shared_ptr<Request> request) const {
-            // response after search requested path and method
-            for(auto res_it: all_resources) {
-                std::regex e(res_it->first);
-                std::smatch sm_res;
-                if(std::regex_match(request->path, sm_res, e)) {
-                    if(res_it->second.count(request->method)>0) {
-                        request->path_match = move(sm_res);
+        // Hold back partial segments while the header and the file are sent,
+        // otherwise Nagle's algorithm delays the body behind the header until
+        // the peer's delayed ACK arrives. Uncorking sends what is left.
+        static void cork(socket_type& socket, bool on) {
+#if defined(__linux__)
+            int value = on;
+            ::setsockopt(socket.lowest_layer().native_handle(), IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+#else
+            (void)socket;
+            (void)on;
+#endif
+        }
+
+        // bytes of a file sent per step, other connections are served in between
+        static constexpr uint64_t file_chunk_size = 1 << 20;
 
-                        // will be deduce to std::shared_ptr<boost::asio::streambuf>
-                        auto write_buffer = std::make_shared<boost::asio::streambuf>();
-                        std::ostream response(write_buffer.get());
-                        res_it->second[request->method](response, *request);
+        // send the file region of the last response in chunks, HTTP sockets
+        // use sendfile(2), the file never enters user space; HTTPS must
+        // encrypt, so chunks of the file are mapped and written from the mapping
+        void send_file(std::shared_ptr<Connection> connection) const {
+            socket_type& socket = *connection->socket;
+            Response& response = *connection->responses[connection->batch - 1];
+            expect(*connection, Wait::send);
+            if(response.file_length == 0) {
+                cork(socket, false);
+                keep_alive(connection);
+                return;
+            }
+            const OpenFile& file = *response.file;
 
-                        // capture write_buffer in lambda, make sure it can be destroyed after async_write
-                        boost::asio::async_write(*socket, *write_buffer,
-                        [this, socket, request, write_buffer](const boost::system::error_code& ec, size_t bytes_transferred) {
-                            // HTTP 1.1 connection
-                            if(!ec && stof(request->http_version)>1.05)
-                                process_request_and_respond(socket);
+#if defined(__linux__)
+            if constexpr (std::is_same_v<socket_type, boost::asio::ip::tcp::socket>) {
+                socket.native_non_blocking(true);
+                for(int chunks = 0; chunks < 4 && response.file_length > 0; ++chunks) {
+                    off_t offset = static_cast<off_t>(response.file_offset);
+                    ssize_t n = ::sendfile(socket.native_handle(), file.fd, &offset,
+                                           std::min(response.file_length, file_chunk_size));
+                    if(n > 0) {
+                        response.file_offset += n;
+                        response.file_length -= n;
+                    } else if(n < 0 && errno == EINTR) {
+                        continue;
+                    } else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                        socket.async_wait(boost::asio::ip::tcp::socket::wait_write,
+                        [this, connection](const boost::system::error_code& ec) {
+                            if(!ec)
+                                send_file(connection);
                         });
                         return;
+                    } else {
+                        // the file became shorter, or the connection failed
+                        return;
                     }
                 }
+                // give other connections a turn before the next chunks
+                boost::asio::post(socket.get_executor(), [this, connection] {
+                    send_file(connection);
+                });
+                return;
             }
+#endif
+            // mappings begin at a page boundary
+            static const uint64_t page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+            uint64_t begin = response.file_offset - response.file_offset % page;
+            uint64_t skip = response.file_offset - begin;
+            size_t length = static_cast<size_t>(std::min(response.file_length, file_chunk_size) + skip);
+
+            void* address = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, file.fd, static_cast<off_t>(begin));
+            if(address == MAP_FAILED)
+                return;
+            auto mapping = std::shared_ptr<void>(address, [length](void* p) { ::munmap(p, length); });
+
+            boost::asio::async_write(socket,
+            boost::asio::buffer(static_cast<const char*>(address) + skip, length - skip),
+            [this, connection, mapping](const boost::system::error_code& ec, size_t bytes_transferred) {
+                if(ec)
+                    return;
+                Response& response = *connection->responses[connection->batch - 1];
+                response.file_offset += bytes_transferred;
+                response.file_length -= bytes_transferred;
+                send_file(connection);
+            });
         }
 
+        // bytes asked from a response source per write
+        static constexpr size_t source_block_size = 64 * 1024;
+
+        // write what the source of the last response produces, the next
+        // block is produced when the socket took the one before, thus the
+        // client's pace bounds the memory; an empty block ends the content
+        void send_source(std::shared_ptr<Connection> connection) const {
+            Connection& c = *connection;
+            Response& response = *c.responses[c.batch - 1];
+            expect(c, Wait::send);
+            if(c.block.size() < source_block_size)
+                c.block.resize(source_block_size);
+            size_t size = response.source(c.block.data(), source_block_size);
+
+            c.gather.clear();
+            if(response.chunked) {
+                // chunk size in hex, the content, and the end of the chunk
+                char* line = c.chunk_line.data();
+                char* end = std::to_chars(line, line + c.chunk_line.size() - 2, size, 16).ptr;
+                *end++ = '\r';
+                *end++ = '\n';
+                c.gather.push_back(boost::asio::buffer(line, end - line));
+            }
+            if(size > 0)
+                c.gather.push_back(boost::asio::buffer(c.block.data(), size));
+            if(response.chunked)
+                c.gather.push_back(boost::asio::buffer("\r\n", 2));
+            if(c.gather.empty()) {
+                keep_alive(connection);
+                return;
+            }
+
+            boost::asio::async_write(*c.socket, Buffers{c.gather.data(), c.gather.data() + c.gather.size()},
+            [this, connection, size](const boost::system::error_code& ec, size_t bytes_transferred) {
+                if(ec)
+                    return;
+                if(size > 0)
+                    send_source(connection);
+                else
+                    keep_alive(connection);
+            });
+        }
     };
 
     template<typename socket_type>
@@ -21,15 +21,18 @@ namespace Web {
             ServerBase<HTTP>::ServerBase(port, num_threads) {};
     private:
         // implement accept() method
-        void accept() {
+        void accept(boost::asio::ip::tcp::acceptor& acceptor) {
             // create a new socket for current connection
             // shared_ptr is used for passing temporal object to anonymous function
             // socket will be deduce as type of std::shared_ptr<HTTP>
-            auto socket = std::make_shared<HTTP>(m_io_service);
+            auto socket = std::shared_ptr<HTTP>(new HTTP(acceptor.get_executor()), [this](HTTP* socket) {
+                closed(*socket);
+                delete socket;
+            });
 
-            acceptor.async_accept(*socket, [this, socket](const boost::system::error_code& ec) {
-                // establish a connection
-                accept();
+            acceptor.async_accept(*socket, [this, &acceptor, socket](const boost::system::error_code& ec) {
+                // establish a connection, unless there are too many
+                accepted(acceptor, !ec);
                 // if no error
                 if(!ec) process_request_and_respond(socket);
             });
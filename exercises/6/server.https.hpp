@@ -10,6 +10,7 @@
 
 #include "server.http.hpp"
 #include <boost/asio/ssl.hpp>
+#include <boost/asio/thread_pool.hpp>
 
 namespace Web {
 
@@ -17,49 +18,132 @@ namespace Web {
     typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket> HTTPS;
 
     // define HTTPS service, template type is HTTPS
+    //
+    // Only TLS 1.2 and 1.3 are accepted, TLS 1.2 with forward secret AEAD
+    // ciphers. Clients resume sessions with a session ticket, or from the
+    // server's session cache for clients without tickets, which saves the
+    // key exchange, the most expensive part of a handshake.
     template<>
     class Server<HTTPS> : public ServerBase<HTTPS> {
     public:
+        // Do the TLS handshakes on a pool of this many threads, the key
+        // exchange then does not hold up the requests of the io threads;
+        // 0 does them on the io threads. Set it before start().
+        size_t handshake_threads = 0;
+
+        // sessions kept for resumption without a ticket, and how long they are valid
+        static constexpr long session_cache_size = 20480;
+        static constexpr long session_timeout = 300;
+
         // a HTTPS server requires two more parameters: certificate file and private key file
         Server(unsigned short port, size_t num_threads,
                const std::string& cert_file, const std::string& private_key_file) :
           ServerBase<HTTPS>::ServerBase(port, num_threads),
-          context(boost::asio::ssl::context::sslv23) {
+          context(boost::asio::ssl::context::tls_server) {
             // use certificate file
             context.use_certificate_chain_file(cert_file);
             // use private key file, we need pass a new parameter to specify the format
             context.use_private_key_file(private_key_file, boost::asio::ssl::context::pem);
+
+            SSL_CTX* ctx = context.native_handle();
+            context.set_options(boost::asio::ssl::context::default_workarounds
+                                | boost::asio::ssl::context::single_dh_use);
+            SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+            SSL_CTX_set_options(ctx, SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_NO_RENEGOTIATION);
+            // the TLS 1.3 suites are all AEAD, OpenSSL's default order is kept
+            SSL_CTX_set_cipher_list(ctx, "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+                                         "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"
+                                         "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305");
+
+            // tickets are on by default, their keys are shared by all threads
+            // of the server; the cache serves clients that do not take them
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+            SSL_CTX_sess_set_cache_size(ctx, session_cache_size);
+            SSL_CTX_set_timeout(ctx, session_timeout);
+            static const unsigned char id[] = "web_server";
+            SSL_CTX_set_session_id_context(ctx, id, sizeof(id) - 1);
         }
 
+        // for further settings of the TLS context, before start()
+        boost::asio::ssl::context& ssl_context() { return context; }
+
     private:
         // compare to HTTP server, we must define ssl context object
         boost::asio::ssl::context context;
+        // destroyed before the context, handshakes in flight are dropped
+        std::unique_ptr<boost::asio::thread_pool> handshake_pool;
 
         // the difference between HTTPS and HTTP server
         // is the construct difference of socket object
         // HTTPS will encrypt the IO stream socket
         // thus, accept() method must initialize ssl context
-        void accept() {
+        void accept(boost::asio::ip::tcp::acceptor& acceptor) {
+            // the pool is created by the first call, from start() before the io threads run
+            if(handshake_threads > 0 && !handshake_pool)
+                handshake_pool = std::make_unique<boost::asio::thread_pool>(handshake_threads);
+
             // create a new socket for current connection
             // shared_ptr is used for passing temporal object to anonymous function
             // socket will be deduce as std::shared_ptr<HTTPS>
-            auto socket = std::make_shared<HTTPS>(m_io_service, context);
+            // connections are closed without close_notify, OpenSSL would drop
+            // their sessions from the cache then, unless they count as shut down
+            auto socket = std::shared_ptr<HTTPS>(new HTTPS(acceptor.get_executor(), context), [this](HTTPS* socket) {
+                SSL_set_shutdown(socket->native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+                closed(*socket);
+                delete socket;
+            });
 
             acceptor.async_accept(
                 (*socket).lowest_layer(),
-                [this, socket](const boost::system::error_code& ec) {
-                    // accept a new connection
-                    accept();
+                [this, &acceptor, socket](const boost::system::error_code& ec) {
+                    // accept a new connection, unless there are too many
+                    accepted(acceptor, !ec);
 
                     // if no error
                     if(!ec) {
-                        (*socket).async_handshake(boost::asio::ssl::stream_base::server,
-                            [this, socket](const boost::system::error_code& ec) {
-                            if(!ec) process_request_and_respond(socket);
-                        });
+                        // a handshake is several small writes, they must not wait for ACKs
+                        boost::system::error_code ignored;
+                        (*socket).lowest_layer().set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+                        handshake(socket);
                     }
             });
         }
+
+        void handshake(std::shared_ptr<HTTPS> socket) {
+            // the handshake has the time of a request head, a client that
+            // stalls it is cut off; the timer goes with the handshake's handler
+            auto timer = std::make_shared<boost::asio::steady_timer>((*socket).get_executor());
+            if(header_timeout.count() > 0) {
+                timer->expires_after(header_timeout);
+                timer->async_wait([this, weak = std::weak_ptr<HTTPS>(socket)](const boost::system::error_code& ec) {
+                    auto socket = weak.lock();
+                    if(!ec && socket)
+                        time_out(*socket, Wait::header);
+                });
+            }
+
+            if(!handshake_pool) {
+                (*socket).async_handshake(boost::asio::ssl::stream_base::server,
+                    [this, socket, timer](const boost::system::error_code& ec) {
+                    timer->cancel();
+                    if(!ec) process_request_and_respond(socket);
+                });
+                return;
+            }
+
+            // the steps of the handshake run where its handler runs, on the
+            // pool, the connection goes back to its io thread afterwards
+            (*socket).async_handshake(boost::asio::ssl::stream_base::server,
+                boost::asio::bind_executor(handshake_pool->get_executor(),
+                [this, socket, timer](const boost::system::error_code& ec) {
+                    timer->cancel();
+                    if(ec)
+                        return;
+                    boost::asio::post((*socket).get_executor(), [this, socket] {
+                        process_request_and_respond(socket);
+                    });
+                }));
+        }
     };
 }
 
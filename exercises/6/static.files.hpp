@@ -0,0 +1,217 @@
+//
+// static_files.hpp
+// web_server
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef STATIC_FILES_HPP
+#define STATIC_FILES_HPP
+
+#include "server.base.hpp"
+#include "response.cache.hpp"
+#include "compression.hpp"
+
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <charconv>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace Web {
+    // Serves files with sendfile(2)/mmap through Response::send_file().
+    //
+    // Small files are answered from the response cache, if one is given.
+    // For the others, open descriptors and their metadata are cached, so a
+    // request for a popular file costs neither open() nor fstat(). An entry
+    // is checked against the file system at most every `revalidate`
+    // interval, and reopened if the file was modified or replaced; files
+    // that do not exist are remembered as well.
+    //
+    // Text files are sent gzip compressed to clients that accept it: a
+    // precompressed sibling "name.gz" is preferred if it is not older than
+    // the file, otherwise small files are compressed once into the cache.
+    // Other files are sent as they are. Pass the server's `compression`,
+    // it is copied, so set it up before the files.
+    class StaticFiles {
+    public:
+        explicit StaticFiles(const Compression& compression, size_t max_open = 1024,
+                             std::chrono::milliseconds revalidate = std::chrono::seconds(1),
+                             std::shared_ptr<ResponseCache> cache = nullptr) :
+            max_open(max_open), revalidate(revalidate), cache(std::move(cache)), compression(compression) {}
+
+        // Respond with `filename`, honoring a single "Range: bytes=" range.
+        // False if the file cannot be opened, nothing is written then.
+        bool serve(Response& response, const Request& request, const std::string& filename) {
+            // a range is cut from the file as it is
+            bool whole = request.header.count("Range") == 0;
+            // whether the response depends on Accept-Encoding
+            bool negotiated = compression.level > 0 && compressible(filename);
+            bool gzip = whole && negotiated && accepts_gzip(request.header.get("Accept-Encoding"));
+
+            if(gzip) {
+                auto file = open(filename);
+                if(!file)
+                    return false;
+                auto compressed = open(filename + ".gz");
+                if(compressed && compressed->mtime >= file->mtime) {
+                    uint64_t size = compressed->size;
+                    response << "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nVary: Accept-Encoding\r\nContent-Length: "
+                             << size << "\r\n\r\n";
+                    response.send_file(std::move(compressed), 0, size);
+                    return true;
+                }
+            }
+
+            // whole files come from the cache
+            if(cache && whole) {
+                if(auto cached = cache->get(filename, negotiated ? &compression : nullptr, gzip)) {
+                    response.send_buffer(std::move(cached));
+                    return true;
+                }
+            }
+
+            auto file = open(filename);
+            if(!file)
+                return false;
+
+            uint64_t first = 0, last = file->size;
+            const char* vary = negotiated ? "Vary: Accept-Encoding\r\n" : "";
+            switch(parse_range(request.header.get("Range"), file->size, first, last)) {
+            case Range::none:
+                response << "HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\n" << vary << "Content-Length: " << file->size << "\r\n\r\n";
+                break;
+            case Range::partial:
+                response << "HTTP/1.1 206 Partial Content\r\nAccept-Ranges: bytes\r\n" << vary << "Content-Range: bytes "
+                         << first << "-" << last - 1 << "/" << file->size
+                         << "\r\nContent-Length: " << last - first << "\r\n\r\n";
+                break;
+            case Range::unsatisfiable:
+                response << "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" << file->size
+                         << "\r\nContent-Length: 0\r\n\r\n";
+                return true;
+            }
+            response.send_file(std::move(file), first, last - first);
+            return true;
+        }
+
+        // the cached descriptor of `filename`, nullptr if it cannot be opened
+        std::shared_ptr<const OpenFile> open(const std::string& filename) {
+            auto now = std::chrono::steady_clock::now();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = entries.find(filename);
+                if(it != entries.end() && now - it->second.checked < revalidate)
+                    return it->second.file;
+            }
+
+            // stat and open outside of the lock, other files are served meanwhile
+            struct stat st;
+            if(::stat(filename.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+                return missing(filename, now);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(filename);
+            if(it != entries.end() && it->second.file && it->second.file->inode == st.st_ino
+               && it->second.file->mtime == modification_time(st) && it->second.file->size == uint64_t(st.st_size)) {
+                it->second.checked = now;
+                return it->second.file;
+            }
+
+            auto file = std::make_shared<OpenFile>();
+            file->fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+            if(file->fd < 0 || ::fstat(file->fd, &st) != 0) {
+                entries.erase(filename);
+                return nullptr;
+            }
+            file->size = st.st_size;
+            file->mtime = modification_time(st);
+            file->inode = st.st_ino;
+
+            // responses in flight keep their descriptor until they are done
+            if(entries.size() >= max_open && it == entries.end())
+                entries.erase(entries.begin());
+            entries[filename] = Entry{file, now};
+            return file;
+        }
+
+    private:
+        enum class Range { none, partial, unsatisfiable };
+
+        // Parse "bytes=first-last", "bytes=first-" or "bytes=-suffix" into
+        // the half open [first, last). Several ranges or anything unknown
+        // are ignored, which lets the whole file be sent, as RFC 7233 allows.
+        static Range parse_range(std::string_view value, uint64_t size, uint64_t& first, uint64_t& last) {
+            if(value.compare(0, 6, "bytes=") != 0)
+                return Range::none;
+            value.remove_prefix(6);
+            size_t dash = value.find('-');
+            if(dash == std::string_view::npos || value.find(',') != std::string_view::npos)
+                return Range::none;
+
+            auto number = [](std::string_view text, uint64_t& n) {
+                auto result = std::from_chars(text.data(), text.data() + text.size(), n);
+                return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+            };
+            uint64_t a = 0, b = 0;
+            std::string_view from = value.substr(0, dash), to = value.substr(dash + 1);
+            if(from.empty()) {
+                // the last b bytes
+                if(!number(to, b))
+                    return Range::none;
+                if(b == 0)
+                    return Range::unsatisfiable;
+                first = size - std::min(b, size);
+                last = size;
+            } else {
+                if(!number(from, a) || (!to.empty() && (!number(to, b) || b < a)))
+                    return Range::none;
+                if(a >= size)
+                    return Range::unsatisfiable;
+                first = a;
+                last = to.empty() ? size : std::min(b + 1, size);
+            }
+            return Range::partial;
+        }
+
+        // remember that there is no such file until it is checked again
+        std::shared_ptr<const OpenFile> missing(const std::string& filename, std::chrono::steady_clock::time_point now) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(filename);
+            if(it != entries.end())
+                it->second = Entry{nullptr, now};
+            else if(entries.size() < max_open)
+                entries.emplace(filename, Entry{nullptr, now});
+            return nullptr;
+        }
+
+        // files of text formats, others are compressed already or hardly compress
+        static bool compressible(std::string_view filename) {
+            size_t dot = filename.rfind('.');
+            if(dot == std::string_view::npos)
+                return false;
+            std::string_view extension = filename.substr(dot + 1);
+            for(std::string_view text: {"html", "htm", "css", "js", "mjs", "json", "xml", "svg", "txt", "csv", "map", "wasm"})
+                if(Headers::equals(extension, text))
+                    return true;
+            return false;
+        }
+
+        struct Entry {
+            std::shared_ptr<const OpenFile> file;
+            std::chrono::steady_clock::time_point checked;
+        };
+
+        size_t max_open;
+        std::chrono::milliseconds revalidate;
+        std::shared_ptr<ResponseCache> cache;
+        Compression compression;
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+    };
+}
+#endif /* STATIC_FILES_HPP */
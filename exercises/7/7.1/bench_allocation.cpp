@@ -0,0 +1,128 @@
+//
+// bench_allocation.cpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// counts the heap allocations and measures the cost per task of the
+// submission paths: the former packaged_task + std::function path,
+// enqueue() with a slab backed promise, and the fire-and-forget post().
+//
+
+#include <iostream> // std::cout, std::endl
+#include <iomanip>  // std::setw, std::setprecision
+#include <atomic>   // std::atomic
+#include <chrono>   // std::chrono::steady_clock
+#include <cstdlib>  // std::malloc, std::aligned_alloc, std::free
+#include <new>      // std::bad_alloc, std::align_val_t
+#include <memory>   // std::make_shared
+#include <vector>   // std::vector
+#include <string>   // std::string
+#include <thread>   // std::this_thread::yield
+
+#include "thread_pool.hpp"
+
+// count every call of the global operator new, the array and the
+// over-aligned forms included, e.g. Slab forwards big blocks to the
+// latter. The nothrow forms call these ones.
+static std::atomic<size_t> allocations{0};
+
+static void* counted_alloc(std::size_t n, std::size_t align = 0) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    n = n ? n : 1;
+    // aligned_alloc wants the size to be a multiple of the alignment
+    void* p = align ? std::aligned_alloc(align, (n + align - 1) / align * align) : std::malloc(n);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(std::size_t n) { return counted_alloc(n); }
+void* operator new[](std::size_t n) { return counted_alloc(n); }
+void* operator new(std::size_t n, std::align_val_t a) { return counted_alloc(n, std::size_t(a)); }
+void* operator new[](std::size_t n, std::align_val_t a) { return counted_alloc(n, std::size_t(a)); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+// what enqueue() used to do: a shared packaged_task wrapped in a std::function
+template<class F>
+std::future<int> legacy_enqueue(ThreadPool& pool, F&& f) {
+    auto task = std::make_shared<std::packaged_task<int()>>(std::bind(std::forward<F>(f)));
+    std::future<int> res = task->get_future();
+    std::function<void()> wrapper([task]{ (*task)(); });
+    pool.post(std::move(wrapper));
+    return res;
+}
+
+struct Result {
+    double allocations_per_task;
+    double ns_per_task;
+};
+
+template<class Submit>
+Result measure(size_t n, Submit submit) {
+    size_t before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    submit(n);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    size_t after = allocations.load();
+    return {double(after - before) / n, elapsed.count() / n};
+}
+
+static void print(const char* name, Result r) {
+    std::cout << std::setw(16) << name
+              << std::setw(10) << std::setprecision(3) << r.allocations_per_task << " allocs/task"
+              << std::setw(10) << std::setprecision(4) << r.ns_per_task << " ns/task" << std::endl;
+}
+
+int main() {
+    const size_t n = 200000;
+
+    ThreadPool pool(2);
+    std::vector< std::future<int> > futures;
+    futures.reserve(n);
+    std::atomic<size_t> done{0};
+
+    auto legacy = [&](size_t n) {
+        for(size_t i = 0; i < n; ++i)
+            futures.emplace_back(legacy_enqueue(pool, [i] { return int(i); }));
+        for(auto& f: futures)
+            f.get();
+        futures.clear();
+    };
+    auto enqueue = [&](size_t n) {
+        for(size_t i = 0; i < n; ++i)
+            futures.emplace_back(pool.enqueue([i] { return int(i); }));
+        for(auto& f: futures)
+            f.get();
+        futures.clear();
+    };
+    auto post = [&](size_t n) {
+        done = 0;
+        for(size_t i = 0; i < n; ++i)
+            pool.post([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+        while(done.load() < n)
+            std::this_thread::yield();
+    };
+
+    // warm up, so the slab and the queue reach their steady state size
+    legacy(n); enqueue(n); post(n);
+
+    for(int round = 0; round < 3; ++round) {
+        std::cout << "round " << round << std::endl;
+        print("packaged_task", measure(n, legacy));
+        print("enqueue", measure(n, enqueue));
+        print("post", measure(n, post));
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+//
+// bench_continuation.cpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// evaluates a layered dependency graph of 10k nodes, every node depends on
+// two nodes of the previous layer. The blocking version enqueues all nodes
+// and calls get() on the dependencies inside the tasks, the continuation
+// version attaches each node to its dependencies with when_all().then().
+//
+
+#include <iostream>  // std::cout, std::endl
+#include <iomanip>   // std::setw, std::setprecision
+#include <chrono>    // std::chrono::steady_clock
+#include <vector>    // std::vector
+#include <future>    // std::shared_future
+#include <algorithm> // std::max
+#include <thread>    // std::thread::hardware_concurrency
+
+#include "thread_pool.hpp"
+
+const size_t layers = 100;
+const size_t width = 100;
+
+// a little work for every node
+static long node(long a, long b) {
+    long v = a + b;
+    for(int i = 0; i < 200; ++i)
+        v = (v * 31 + i) % 1000003;
+    return v;
+}
+
+static long blocking(ThreadPool& pool) {
+    std::vector< std::shared_future<long> > prev, next;
+    for(size_t j = 0; j < width; ++j)
+        prev.push_back(pool.enqueue([j] { return long(j); }).share());
+
+    for(size_t l = 1; l < layers; ++l) {
+        next.clear();
+        for(size_t j = 0; j < width; ++j) {
+            auto a = prev[j], b = prev[(j + 1) % width];
+            // the worker sits in get() until both inputs are ready
+            next.push_back(pool.enqueue([a, b] { return node(a.get(), b.get()); }).share());
+        }
+        prev.swap(next);
+    }
+
+    long sum = 0;
+    for(auto& f: prev)
+        sum += f.get();
+    return sum;
+}
+
+static long continuation(ThreadPool& pool) {
+    std::vector< Future<long> > prev, next;
+    for(size_t j = 0; j < width; ++j)
+        prev.push_back(pool.async([j] { return long(j); }));
+
+    for(size_t l = 1; l < layers; ++l) {
+        next.clear();
+        for(size_t j = 0; j < width; ++j) {
+            // scheduled on the pool once both inputs are ready
+            next.push_back(when_all(std::vector< Future<long> >{prev[j], prev[(j + 1) % width]})
+                .then([](const std::vector<long>& in) { return node(in[0], in[1]); }));
+        }
+        prev.swap(next);
+    }
+
+    long sum = 0;
+    for(auto& f: prev)
+        sum += f.get();
+    return sum;
+}
+
+template<class F>
+static void measure(const char* name, F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    long result = f();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << std::setw(14) << name << std::setw(10) << elapsed.count() << " ms"
+              << "  (" << layers * width / elapsed.count() * 1000 << " nodes/s, result " << result << ")" << std::endl;
+}
+
+int main() {
+    size_t threads = std::max(2u, std::thread::hardware_concurrency());
+    ThreadPool pool(threads);
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "threads: " << threads << ", nodes: " << layers * width << std::endl;
+    for(int round = 0; round < 3; ++round) {
+        measure("blocking get", [&] { return blocking(pool); });
+        measure("continuation", [&] { return continuation(pool); });
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+//
+// bench_latency.cpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// ping-pong latency: submit one task, wait for its result, pause a little
+// and repeat. Idle workers either park right away or spin first. Then a
+// burst shows the pool growing to its maximum and shrinking back.
+//
+
+#include <iostream>  // std::cout, std::endl
+#include <iomanip>   // std::setw, std::setprecision
+#include <chrono>    // std::chrono::steady_clock
+#include <vector>    // std::vector
+#include <algorithm> // std::sort, std::max
+#include <thread>    // std::this_thread::sleep_for
+
+#include "thread_pool.hpp"
+
+using clock_type = std::chrono::steady_clock;
+
+static void ping_pong(const char* name, ThreadPool::Idle idle) {
+    ThreadPool::Config config;
+    config.min_threads = 2;
+    config.max_threads = 2;
+    config.idle = idle;
+    ThreadPool pool(config);
+
+    const size_t rounds = 20000;
+    std::vector<double> latencies;
+    latencies.reserve(rounds);
+
+    for(size_t i = 0; i < rounds; ++i) {
+        auto start = clock_type::now();
+        pool.enqueue([] { return 1; }).get();
+        std::chrono::duration<double, std::micro> rtt = clock_type::now() - start;
+        latencies.push_back(rtt.count());
+
+        // bursty load, a short gap between two requests
+        auto gap = clock_type::now() + std::chrono::microseconds(20);
+        while(clock_type::now() < gap);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::setw(16) << name
+              << "  p50: " << std::setw(8) << latencies[rounds / 2] << " us"
+              << "  p99: " << std::setw(8) << latencies[rounds * 99 / 100] << " us" << std::endl;
+}
+
+static void resizing() {
+    ThreadPool::Config config;
+    config.min_threads = 1;
+    config.max_threads = std::max(4u, std::thread::hardware_concurrency());
+    config.idle_timeout = std::chrono::milliseconds(100);
+    ThreadPool pool(config);
+
+    std::cout << "workers at start:       " << pool.size() << std::endl;
+
+    std::vector< std::future<void> > results;
+    for(int i = 0; i < 64; ++i)
+        results.emplace_back(pool.enqueue([] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }));
+    std::cout << "workers during a burst: " << pool.size() << std::endl;
+    for(auto& r: results)
+        r.get();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    std::cout << "workers after idling:   " << pool.size() << std::endl;
+}
+
+int main() {
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "submit -> complete round trip" << std::endl;
+    for(int round = 0; round < 2; ++round) {
+        ping_pong("park", ThreadPool::Idle::park);
+        ping_pong("spin_then_park", ThreadPool::Idle::spin_then_park);
+    }
+    resizing();
+    return 0;
+}
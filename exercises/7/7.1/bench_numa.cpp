@@ -0,0 +1,104 @@
+//
+// bench_numa.cpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// memory bandwidth of pinned workers reading node local versus remote
+// memory. Every node gets a buffer that is first touched by its own
+// workers, so the kernel places the pages on that node. Then the workers
+// of every node sum up either their own buffer or the buffer of the next
+// node, submitted with a locality hint.
+//
+
+#include <iostream>  // std::cout, std::endl
+#include <iomanip>   // std::setprecision
+#include <chrono>    // std::chrono::steady_clock
+#include <vector>    // std::vector
+#include <memory>    // std::unique_ptr
+#include <cstdint>   // std::uint64_t
+#include <algorithm> // std::max
+#include <utility>   // std::make_pair
+
+#include "thread_pool.hpp"
+
+using word = std::uint64_t;
+
+static word sum(const word* data, size_t n) {
+    word s = 0;
+    for(size_t i = 0; i < n; ++i)
+        s += data[i];
+    return s;
+}
+
+int main() {
+    const size_t words_per_node = (256u << 20) / sizeof(word);
+
+    Topology topology = Topology::detect();
+    size_t nodes = topology.nodes.size();
+    std::cout << "NUMA nodes: " << nodes << ", cpus: " << topology.cpu_count() << std::endl;
+    if(nodes == 1)
+        std::cout << "single node machine, local and remote access are the same" << std::endl;
+
+    ThreadPool::Config config;
+    config.min_threads = config.max_threads = topology.cpu_count();
+    config.affinity = ThreadPool::Affinity::node;
+    ThreadPool pool(config);
+
+    // every worker of a node works on its own slice of a buffer
+    size_t slices = std::max<size_t>(1, topology.cpu_count() / nodes);
+    size_t slice = words_per_node / slices;
+
+    // first touch from the owning node places the pages there
+    std::vector< std::unique_ptr<word[]> > buffers;
+    std::vector< std::future<void> > touched;
+    for(size_t node = 0; node < nodes; ++node) {
+        buffers.emplace_back(new word[words_per_node]);
+        for(size_t s = 0; s < slices; ++s) {
+            word* data = buffers.back().get() + s * slice;
+            touched.emplace_back(pool.enqueue(
+                ThreadPool::TaskOptions(ThreadPool::Priority::normal,
+                    TaskOptions::clock::time_point::max(), static_cast<int>(node)),
+                [data, slice] {
+                    for(size_t i = 0; i < slice; ++i)
+                        data[i] = i;
+                }));
+        }
+    }
+    for(auto& t: touched)
+        t.get();
+
+    // the workers of node n read the buffer of node (n + distance) % nodes
+    auto run = [&](size_t distance) {
+        std::vector< std::future<word> > results;
+        auto start = std::chrono::steady_clock::now();
+        for(size_t node = 0; node < nodes; ++node) {
+            const word* buffer = buffers[(node + distance) % nodes].get();
+            for(size_t s = 0; s < slices; ++s)
+                results.emplace_back(pool.enqueue(
+                    ThreadPool::TaskOptions(ThreadPool::Priority::normal,
+                        TaskOptions::clock::time_point::max(), static_cast<int>(node)),
+                    sum, buffer + s * slice, slice));
+        }
+        word check = 0;
+        for(auto& r: results)
+            check += r.get();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double bytes = double(nodes) * slices * slice * sizeof(word);
+        return std::make_pair(bytes / elapsed.count() / 1e9, check);
+    };
+
+    std::cout << std::fixed << std::setprecision(2);
+    for(int round = 0; round < 3; ++round) {
+        auto local = run(0);
+        auto remote = run(nodes > 1 ? 1 : 0);
+        std::cout << "round " << round
+                  << "  local: " << local.first << " GB/s"
+                  << "  remote: " << remote.first << " GB/s"
+                  << "  (checksum " << (local.second == remote.second ? "ok" : "mismatch") << ")" << std::endl;
+    }
+    return 0;
+}
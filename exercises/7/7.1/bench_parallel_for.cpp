@@ -0,0 +1,85 @@
+//
+// bench_parallel_for.cpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// per-item overhead of processing 1e6 trivial items: one enqueue() per
+// item, one enqueue_bulk() for all items, parallel_for and parallel_reduce.
+//
+
+#include <iostream> // std::cout, std::endl
+#include <iomanip>  // std::setw, std::setprecision
+#include <chrono>   // std::chrono::steady_clock
+#include <vector>   // std::vector
+#include <numeric>  // std::iota
+#include <thread>   // std::thread::hardware_concurrency
+#include <algorithm> // std::max
+#include <functional> // std::function
+
+#include "thread_pool.hpp"
+
+template<class F>
+static double ns_per_item(size_t n, F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / n;
+}
+
+int main() {
+    const size_t n = 1000000;
+    size_t threads = std::max(2u, std::thread::hardware_concurrency());
+
+    ThreadPool pool(threads);
+    std::vector<unsigned> data(n);
+    std::iota(data.begin(), data.end(), 0u);
+
+    // the trivial per item work
+    auto item = [&data](size_t i) { data[i] = data[i] * 3 + 1; };
+
+    auto per_task = [&] {
+        std::vector< std::future<void> > results;
+        results.reserve(n);
+        for(size_t i = 0; i < n; ++i)
+            results.emplace_back(pool.enqueue(item, i));
+        for(auto& r: results)
+            r.get();
+    };
+
+    auto bulk = [&] {
+        std::vector< std::function<void()> > items;
+        items.reserve(n);
+        for(size_t i = 0; i < n; ++i)
+            items.emplace_back([&item, i] { item(i); });
+        for(auto& r: pool.enqueue_bulk(items.begin(), items.end()))
+            r.get();
+    };
+
+    auto for_grain_1 = [&] { pool.parallel_for(size_t(0), n, size_t(1), item); };
+    auto for_grain_1024 = [&] { pool.parallel_for(size_t(0), n, size_t(1024), item); };
+
+    unsigned long long sum = 0;
+    auto reduce = [&] {
+        sum = pool.parallel_reduce(size_t(0), n, size_t(1024), 0ull,
+            [&data](size_t i) { return static_cast<unsigned long long>(data[i]); },
+            [](unsigned long long a, unsigned long long b) { return a + b; });
+    };
+
+    std::cout << "threads: " << threads << ", items: " << n << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for(int round = 0; round < 3; ++round) {
+        std::cout << "round " << round << std::endl;
+        std::cout << "  enqueue per item      " << std::setw(10) << ns_per_item(n, per_task)       << " ns/item" << std::endl;
+        std::cout << "  enqueue_bulk          " << std::setw(10) << ns_per_item(n, bulk)           << " ns/item" << std::endl;
+        std::cout << "  parallel_for (1)      " << std::setw(10) << ns_per_item(n, for_grain_1)    << " ns/item" << std::endl;
+        std::cout << "  parallel_for (1024)   " << std::setw(10) << ns_per_item(n, for_grain_1024) << " ns/item" << std::endl;
+        std::cout << "  parallel_reduce (1024)" << std::setw(10) << ns_per_item(n, reduce)         << " ns/item" << std::endl;
+    }
+    // keep the result alive
+    std::cout << "checksum: " << sum << std::endl;
+    return 0;
+}
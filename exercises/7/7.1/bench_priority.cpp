@@ -0,0 +1,93 @@
+//
+// bench_priority.cpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// latency of user facing requests submitted while the pool is flooded with
+// background compaction work: once with everything in one FIFO class and
+// once with the requests in the high and the compaction in the background
+// class. Prints the queueing delay reported by ThreadPool::stats().
+//
+
+#include <iostream>  // std::cout, std::endl
+#include <iomanip>   // std::setw
+#include <chrono>    // std::chrono::steady_clock
+#include <vector>    // std::vector
+#include <mutex>     // std::mutex
+#include <algorithm> // std::sort, std::max
+#include <thread>    // std::this_thread::sleep_for
+
+#include "thread_pool.hpp"
+
+using clock_type = std::chrono::steady_clock;
+
+// keep a worker busy for the given time
+static void spin_for(std::chrono::microseconds d) {
+    auto end = clock_type::now() + d;
+    while(clock_type::now() < end);
+}
+
+static void print_stats(const char* name, const QueueStats& s) {
+    std::cout << "    " << std::setw(10) << name
+              << "  tasks: " << std::setw(6) << s.wait.total
+              << "  p50 <= " << std::setw(8) << s.wait.percentile(50) << " us"
+              << "  p99 <= " << std::setw(8) << s.wait.percentile(99) << " us"
+              << "  max <= " << std::setw(8) << s.wait.percentile(100) << " us" << std::endl;
+}
+
+static void run(bool prioritized) {
+    const size_t threads = std::max(2u, std::thread::hardware_concurrency());
+    const size_t compactions = 4000 * threads;
+    const size_t requests = 200;
+
+    ThreadPool pool(threads);
+    ThreadPool::TaskOptions background(prioritized ? ThreadPool::Priority::background : ThreadPool::Priority::normal);
+    ThreadPool::TaskOptions request(prioritized ? ThreadPool::Priority::high : ThreadPool::Priority::normal);
+
+    // a burst of background work, about 200 ms per worker
+    for(size_t i = 0; i < compactions; ++i)
+        pool.post(background, spin_for, std::chrono::microseconds(50));
+
+    // requests arrive every 500 us, each records its own queueing delay
+    std::mutex latency_mutex;
+    std::vector<double> latencies;
+    std::vector< std::future<void> > results;
+    for(size_t i = 0; i < requests; ++i) {
+        auto submitted = clock_type::now();
+        results.emplace_back(pool.enqueue(request, [&, submitted] {
+            std::chrono::duration<double, std::micro> wait = clock_type::now() - submitted;
+            spin_for(std::chrono::microseconds(20));
+            std::lock_guard<std::mutex> lock(latency_mutex);
+            latencies.push_back(wait.count());
+        }));
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    for(auto& r: results)
+        r.get();
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << (prioritized ? "high/background classes" : "single FIFO class") << std::endl;
+    std::cout << "  request wait  p50: " << std::setw(10) << latencies[latencies.size() / 2] << " us"
+              << "  p99: " << std::setw(10) << latencies[latencies.size() * 99 / 100] << " us" << std::endl;
+
+    // the background work still makes progress meanwhile
+    std::cout << "  background still queued after the requests: "
+              << pool.stats(ThreadPool::Priority::background).depth
+              + (prioritized ? 0 : pool.stats(ThreadPool::Priority::normal).depth) << std::endl;
+
+    std::cout << "  pool stats" << std::endl;
+    print_stats("high", pool.stats(ThreadPool::Priority::high));
+    print_stats("normal", pool.stats(ThreadPool::Priority::normal));
+    print_stats("background", pool.stats(ThreadPool::Priority::background));
+}
+
+int main() {
+    std::cout << std::fixed << std::setprecision(1);
+    run(false);
+    run(true);
+    return 0;
+}
@@ -0,0 +1,73 @@
+//
+// bench_work_stealing.cpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// compares the task throughput of the shared queue and the work stealing
+// scheduler for a fan-out workload: a few root tasks are enqueued from
+// outside, each of them spawns many tiny child tasks from inside the pool.
+//
+
+#include <iostream> // std::cout, std::endl
+#include <iomanip>  // std::setw
+#include <atomic>   // std::atomic
+#include <chrono>   // std::chrono::steady_clock
+#include <thread>   // std::thread::hardware_concurrency, std::this_thread::yield
+#include <algorithm> // std::max
+
+#include "thread_pool.hpp"
+
+// a tiny piece of work, so the scheduling overhead dominates
+static void tiny_work(std::atomic<size_t>& done) {
+    volatile unsigned x = 0;
+    for(unsigned i = 0; i < 64; ++i)
+        x = x + i;
+    done.fetch_add(1, std::memory_order_relaxed);
+}
+
+static double run(ThreadPool::Scheduling scheduling, size_t threads,
+                  size_t roots, size_t children) {
+    std::atomic<size_t> done{0};
+    size_t total = roots * children;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads, scheduling);
+        for(size_t r = 0; r < roots; ++r)
+            pool.enqueue([&pool, &done, children] {
+                for(size_t c = 0; c < children; ++c)
+                    pool.enqueue(tiny_work, std::ref(done));
+            });
+
+        // wait until every child has finished
+        while(done.load(std::memory_order_relaxed) < total)
+            std::this_thread::yield();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return total / elapsed.count();
+}
+
+int main() {
+    size_t threads = std::max(2u, std::thread::hardware_concurrency());
+    size_t roots = threads * 4;
+    size_t children = 20000;
+
+    std::cout << "threads: " << threads << ", tasks: " << roots * children << std::endl;
+
+    // warm up the allocator and the threads
+    run(ThreadPool::Scheduling::shared_queue, threads, roots, children / 10);
+
+    for(int round = 0; round < 3; ++round) {
+        double shared = run(ThreadPool::Scheduling::shared_queue, threads, roots, children);
+        double stealing = run(ThreadPool::Scheduling::work_stealing, threads, roots, children);
+        std::cout << "round " << round
+                  << "  shared_queue: "  << std::setw(12) << static_cast<size_t>(shared)   << " tasks/s"
+                  << "  work_stealing: " << std::setw(12) << static_cast<size_t>(stealing) << " tasks/s"
+                  << "  speedup: " << stealing / shared << "x" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,312 @@
+//
+// future.hpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef FUTURE_H
+#define FUTURE_H
+
+#include <atomic>               // std::atomic
+#include <mutex>                // std::mutex, std::unique_lock
+#include <memory>               // std::shared_ptr, std::make_shared
+#include <vector>               // std::vector
+#include <optional>             // std::optional
+#include <utility>              // std::move, std::pair
+#include <exception>            // std::exception_ptr
+#include <functional>           // std::invoke
+#include <type_traits>          // std::invoke_result_t
+#include <stdexcept>            // std::logic_error
+
+#include "task.hpp"
+
+// where continuations are executed, a ThreadPool installs itself here.
+// Without an executor continuations run on the thread that completes
+// the future. The context is shared, futures may outlive their pool.
+struct Executor {
+    std::shared_ptr<void> context;
+    void (*execute)(void*, Task&&) = nullptr;
+
+    void operator()(Task&& task) const {
+        if(execute)
+            execute(context.get(), std::move(task));
+        else
+            task();
+    }
+};
+
+template<class T> class Future;
+template<class T> class Promise;
+
+namespace detail {
+    // void results are stored as an empty value
+    struct Unit {};
+
+    template<class T>
+    using stored_t = std::conditional_t<std::is_void_v<T>, Unit, T>;
+
+    // result of a continuation, it receives the value unless there is none
+    template<class T, class F>
+    struct then_result { using type = std::invoke_result_t<F, const T&>; };
+    template<class F>
+    struct then_result<void, F> { using type = std::invoke_result_t<F>; };
+
+    template<class T>
+    struct FutureState {
+        explicit FutureState(Executor executor): executor(executor) {}
+
+        Executor executor;
+        std::mutex mutex;
+        std::atomic<bool> ready{false};
+        std::optional< stored_t<T> > value;
+        std::exception_ptr error;
+        // waiting for the value, (task, run inline) pairs
+        std::vector< std::pair<Task, bool> > continuations;
+
+        // run `task` once the state is ready, on the executor or right
+        // away on the completing thread if `run_inline` is set
+        void on_ready(Task&& task, bool run_inline = false) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if(!ready.load(std::memory_order_relaxed)) {
+                    continuations.emplace_back(std::move(task), run_inline);
+                    return;
+                }
+            }
+            run_inline ? task() : executor(std::move(task));
+        }
+
+        template<class... V>
+        void set_value(V&&... v) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if(ready.load(std::memory_order_relaxed))
+                    throw std::logic_error("promise already satisfied");
+                value.emplace(std::forward<V>(v)...);
+            }
+            complete();
+        }
+
+        void set_error(std::exception_ptr e) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if(ready.load(std::memory_order_relaxed))
+                    throw std::logic_error("promise already satisfied");
+                error = std::move(e);
+            }
+            complete();
+        }
+
+    private:
+        void complete() {
+            std::vector< std::pair<Task, bool> > waiting;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.store(true, std::memory_order_release);
+                waiting.swap(continuations);
+            }
+            ready.notify_all();
+
+            for(auto& c: waiting)
+                c.second ? c.first() : executor(std::move(c.first));
+        }
+    };
+}
+
+// Future returned by ThreadPool::async(). Unlike std::future the result
+// can be consumed without blocking a thread: then() attaches a
+// continuation that is scheduled on the pool once the value is ready.
+//
+// A Future shares its state like std::shared_future, it can be copied,
+// get() can be called repeatedly, and several continuations may depend on
+// the same result, as needed for the nodes of a dependency graph.
+template<class T>
+class Future {
+public:
+    using value_type = T;
+
+    Future() = default;
+
+    bool valid() const { return state != nullptr; }
+    bool is_ready() const { return state->ready.load(std::memory_order_acquire); }
+
+    // block until the result is available
+    void wait() const {
+        state->ready.wait(false, std::memory_order_acquire);
+    }
+
+    // block until the result is available, rethrow a stored exception
+    decltype(auto) get() const {
+        wait();
+        if(state->error)
+            std::rethrow_exception(state->error);
+        if constexpr (!std::is_void_v<T>)
+            return static_cast<const T&>(*state->value);
+    }
+
+    // schedule fn(value) (or fn() for Future<void>) once the result is
+    // ready, an exception is passed on to the returned future without
+    // calling fn
+    template<class F>
+    auto then(F&& fn) const;
+
+private:
+    template<class U> friend class Future;
+    template<class U> friend class Promise;
+
+    explicit Future(std::shared_ptr< detail::FutureState<T> > state): state(std::move(state)) {}
+
+    // the producing side, for the combinators below
+    template<class U>
+    friend Future< std::conditional_t<std::is_void_v<U>, void, std::vector<U>> >
+    when_all(const std::vector< Future<U> >& futures);
+    template<class U>
+    friend Future< std::conditional_t<std::is_void_v<U>, size_t, std::pair<size_t, U>> >
+    when_any(const std::vector< Future<U> >& futures);
+
+    std::shared_ptr< detail::FutureState<T> > state;
+};
+
+template<class T>
+class Promise {
+public:
+    explicit Promise(Executor executor = Executor()):
+        state(std::make_shared< detail::FutureState<T> >(executor)) {}
+
+    Future<T> get_future() const { return Future<T>(state); }
+
+    template<class... V>
+    void set_value(V&&... v) { state->set_value(std::forward<V>(v)...); }
+    void set_exception(std::exception_ptr e) { state->set_error(std::move(e)); }
+
+    // store the result of fn(args...) or the exception it throws
+    template<class F, class... Args>
+    void set_from(F&& fn, Args&&... args) {
+        try {
+            if constexpr (std::is_void_v<T>) {
+                std::invoke(std::forward<F>(fn), std::forward<Args>(args)...);
+                set_value();
+            } else {
+                set_value(std::invoke(std::forward<F>(fn), std::forward<Args>(args)...));
+            }
+        } catch(...) {
+            set_exception(std::current_exception());
+        }
+    }
+
+private:
+    std::shared_ptr< detail::FutureState<T> > state;
+};
+
+template<class T>
+template<class F>
+auto Future<T>::then(F&& fn) const {
+    using R = typename detail::then_result<T, F>::type;
+
+    Promise<R> next(state->executor);
+    Future<R> result = next.get_future();
+
+    state->on_ready([state = state, next = std::move(next), fn = std::forward<F>(fn)]() mutable {
+        if(state->error)
+            next.set_exception(state->error);
+        else if constexpr (std::is_void_v<T>)
+            next.set_from(std::move(fn));
+        else
+            next.set_from(std::move(fn), static_cast<const T&>(*state->value));
+    });
+    return result;
+}
+
+// a future that becomes ready when all inputs are, with their values in
+// order, or with the first exception. Future<void> inputs give Future<void>.
+template<class T>
+Future< std::conditional_t<std::is_void_v<T>, void, std::vector<T>> >
+when_all(const std::vector< Future<T> >& futures) {
+    using R = std::conditional_t<std::is_void_v<T>, void, std::vector<T>>;
+
+    struct Join {
+        Join(const std::vector< Future<T> >& inputs, Executor executor):
+            remaining(inputs.size()), inputs(inputs), promise(executor) {}
+
+        std::atomic<size_t> remaining;
+        std::vector< Future<T> > inputs;
+        Promise<R> promise;
+    };
+
+    Executor executor = futures.empty() ? Executor() : futures.front().state->executor;
+    auto join = std::make_shared<Join>(futures, executor);
+    Future<R> result = join->promise.get_future();
+
+    auto finish = [](Join& j) {
+        for(auto& f: j.inputs)
+            if(f.state->error) {
+                j.promise.set_exception(f.state->error);
+                return;
+            }
+        if constexpr (std::is_void_v<T>) {
+            j.promise.set_value();
+        } else {
+            std::vector<T> values;
+            values.reserve(j.inputs.size());
+            for(auto& f: j.inputs)
+                values.push_back(*f.state->value);
+            j.promise.set_value(std::move(values));
+        }
+    };
+
+    if(futures.empty()) {
+        finish(*join);
+        return result;
+    }
+
+    // counting down is cheap, it runs inline on the completing thread,
+    // only the continuations of the joined future are scheduled
+    for(auto& f: futures)
+        f.state->on_ready([join, finish] {
+            if(join->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                finish(*join);
+        }, true);
+    return result;
+}
+
+// a future that becomes ready with the first input that does, giving its
+// index and value (only the index for Future<void>), or its exception
+template<class T>
+Future< std::conditional_t<std::is_void_v<T>, size_t, std::pair<size_t, T>> >
+when_any(const std::vector< Future<T> >& futures) {
+    using R = std::conditional_t<std::is_void_v<T>, size_t, std::pair<size_t, T>>;
+
+    if(futures.empty())
+        throw std::invalid_argument("when_any of no futures");
+
+    struct Race {
+        explicit Race(Executor executor): promise(executor) {}
+
+        std::atomic<bool> done{false};
+        Promise<R> promise;
+    };
+
+    auto race = std::make_shared<Race>(futures.front().state->executor);
+    Future<R> result = race->promise.get_future();
+
+    for(size_t i = 0; i < futures.size(); ++i) {
+        auto state = futures[i].state;
+        state->on_ready([race, state, i] {
+            if(race->done.exchange(true, std::memory_order_acq_rel))
+                return;
+            if(state->error)
+                race->promise.set_exception(state->error);
+            else if constexpr (std::is_void_v<T>)
+                race->promise.set_value(i);
+            else
+                race->promise.set_value(R(i, *state->value));
+        }, true);
+    }
+    return result;
+}
+
+#endif
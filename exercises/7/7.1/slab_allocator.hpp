@@ -0,0 +1,118 @@
+//
+// slab_allocator.hpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef SLAB_ALLOCATOR_H
+#define SLAB_ALLOCATOR_H
+
+#include <cstddef>              // std::size_t, std::max_align_t
+#include <new>                  // ::operator new, ::operator delete
+#include <memory>               // std::shared_ptr, std::unique_ptr
+#include <mutex>                // std::mutex, std::lock_guard
+#include <vector>               // std::vector
+
+// Slab hands out fixed size blocks and keeps released blocks in a free
+// list, so once the pool has warmed up, allocating and releasing blocks
+// never reaches the global heap. Requests bigger than a block are
+// forwarded to ::operator new.
+//
+// Blocks may be released by any thread, e.g. the shared state of a future
+// is freed by whoever drops the last reference, thus the free list is
+// guarded by a mutex.
+class Slab {
+public:
+    static constexpr std::size_t block_size = 128;
+
+    explicit Slab(std::size_t blocks_per_chunk = 256):
+        blocks_per_chunk(blocks_per_chunk) {}
+
+    Slab(const Slab&) = delete;
+    Slab& operator=(const Slab&) = delete;
+
+    void* allocate(std::size_t n, std::size_t align = alignof(std::max_align_t)) {
+        if(n > block_size || align > alignof(std::max_align_t))
+            return ::operator new(n, std::align_val_t(align));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!free_list)
+            refill();
+        Block* block = free_list;
+        free_list = block->next;
+        return block;
+    }
+
+    void deallocate(void* p, std::size_t n, std::size_t align = alignof(std::max_align_t)) noexcept {
+        if(n > block_size || align > alignof(std::max_align_t)) {
+            ::operator delete(p, std::align_val_t(align));
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Block* block = static_cast<Block*>(p);
+        block->next = free_list;
+        free_list = block;
+    }
+
+private:
+    struct Block {
+        Block* next;
+    };
+
+    // carve a new chunk into blocks, called with the mutex held
+    void refill() {
+        chunks.emplace_back(new Storage[blocks_per_chunk]);
+        Storage* chunk = chunks.back().get();
+        for(std::size_t i = 0; i < blocks_per_chunk; ++i) {
+            Block* block = reinterpret_cast<Block*>(&chunk[i]);
+            block->next = free_list;
+            free_list = block;
+        }
+    }
+
+    struct alignas(std::max_align_t) Storage {
+        unsigned char bytes[block_size];
+    };
+
+    std::size_t blocks_per_chunk;
+    std::mutex mutex;
+    Block* free_list = nullptr;
+    std::vector< std::unique_ptr<Storage[]> > chunks;
+};
+
+// standard allocator interface on top of a shared Slab, e.g. for
+// std::promise(std::allocator_arg, alloc). The allocator keeps the slab
+// alive, so a future may outlive the pool that created it.
+template<class T>
+class SlabAllocator {
+public:
+    using value_type = T;
+
+    explicit SlabAllocator(std::shared_ptr<Slab> slab) noexcept: slab(std::move(slab)) {}
+
+    template<class U>
+    SlabAllocator(const SlabAllocator<U>& other) noexcept: slab(other.slab) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(slab->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* p, std::size_t n) noexcept {
+        slab->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    template<class U>
+    bool operator==(const SlabAllocator<U>& other) const noexcept { return slab == other.slab; }
+    template<class U>
+    bool operator!=(const SlabAllocator<U>& other) const noexcept { return slab != other.slab; }
+
+private:
+    template<class U> friend class SlabAllocator;
+    std::shared_ptr<Slab> slab;
+};
+
+#endif
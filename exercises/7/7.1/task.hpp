@@ -0,0 +1,117 @@
+//
+// task.hpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef TASK_H
+#define TASK_H
+
+#include <cstddef>              // std::size_t, std::max_align_t
+#include <new>                  // placement new
+#include <type_traits>          // std::decay_t, std::is_same_v
+#include <utility>              // std::move, std::forward
+
+// Task is a move-only replacement of std::function<void()>.
+// std::function must be copyable, so it can not hold a std::promise,
+// and it only stores very small callables (two pointers in libstdc++)
+// without a heap allocation. Task keeps callables up to 64 bytes inline,
+// which is enough for a lambda capturing a promise and a few arguments.
+class Task {
+public:
+    // size of the inline storage, bigger callables are stored on the heap
+    static constexpr std::size_t inline_size = 64;
+
+    Task() noexcept = default;
+
+    template<class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+    Task(F&& f) {
+        using Fn = std::decay_t<F>;
+        if constexpr (fits_inline<Fn>()) {
+            new (storage) Fn(std::forward<F>(f));
+            vtable = &inline_vtable<Fn>;
+        } else {
+            *reinterpret_cast<Fn**>(storage) = new Fn(std::forward<F>(f));
+            vtable = &heap_vtable<Fn>;
+        }
+    }
+
+    Task(Task&& other) noexcept { move_from(other); }
+
+    Task& operator=(Task&& other) noexcept {
+        if(this != &other) {
+            reset();
+            move_from(other);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    void operator()() { vtable->invoke(storage); }
+
+    explicit operator bool() const noexcept { return vtable != nullptr; }
+
+private:
+    // hand written vtable, one instance for each stored callable type
+    struct VTable {
+        void (*invoke)(void*);
+        // move construct into dst and destroy src
+        void (*relocate)(void* dst, void* src) noexcept;
+        void (*destroy)(void*) noexcept;
+    };
+
+    template<class Fn>
+    static constexpr bool fits_inline() {
+        return sizeof(Fn) <= inline_size
+            && alignof(Fn) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible_v<Fn>;
+    }
+
+    template<class Fn>
+    static constexpr VTable inline_vtable = {
+        [](void* p) { (*static_cast<Fn*>(p))(); },
+        [](void* dst, void* src) noexcept {
+            new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        },
+        [](void* p) noexcept { static_cast<Fn*>(p)->~Fn(); }
+    };
+
+    // the inline storage only holds a pointer to the callable
+    template<class Fn>
+    static constexpr VTable heap_vtable = {
+        [](void* p) { (**static_cast<Fn**>(p))(); },
+        [](void* dst, void* src) noexcept {
+            *static_cast<Fn**>(dst) = *static_cast<Fn**>(src);
+        },
+        [](void* p) noexcept { delete *static_cast<Fn**>(p); }
+    };
+
+    void move_from(Task& other) noexcept {
+        if(other.vtable) {
+            other.vtable->relocate(storage, other.storage);
+            vtable = other.vtable;
+            other.vtable = nullptr;
+        }
+    }
+
+    void reset() noexcept {
+        if(vtable) {
+            vtable->destroy(storage);
+            vtable = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage[inline_size];
+    const VTable* vtable = nullptr;
+};
+
+#endif
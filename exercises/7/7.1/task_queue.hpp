@@ -0,0 +1,269 @@
+//
+// task_queue.hpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef TASK_QUEUE_H
+#define TASK_QUEUE_H
+
+#include <cstddef>              // std::size_t
+#include <cstdint>              // std::uint64_t
+#include <memory>               // std::unique_ptr
+#include <utility>              // std::move
+#include <vector>               // std::vector
+#include <array>                // std::array
+#include <algorithm>            // std::push_heap, std::pop_heap
+#include <chrono>               // std::chrono::steady_clock
+
+#include "task.hpp"
+
+// FIFO queue on top of a growable ring buffer.
+// std::queue is backed by std::deque, which allocates and releases a
+// chunk every few elements; the ring buffer keeps its capacity, so a
+// warmed up queue never touches the heap again. Not thread safe, the
+// pool guards it with its queue mutex.
+template<class T>
+class RingQueue {
+public:
+    explicit RingQueue(std::size_t capacity = 64):
+        slots(new T[capacity]), capacity(capacity) {}
+
+    bool empty() const { return count == 0; }
+    std::size_t size() const { return count; }
+
+    void push(T&& item) {
+        if(count == capacity)
+            grow();
+        slots[(head + count) % capacity] = std::move(item);
+        ++count;
+    }
+
+    T& front() { return slots[head]; }
+
+    void pop() {
+        // release the captured state right away, not when the slot is reused
+        slots[head] = T();
+        head = (head + 1) % capacity;
+        --count;
+    }
+
+private:
+    void grow() {
+        std::unique_ptr<T[]> bigger(new T[capacity * 2]);
+        for(std::size_t i = 0; i < count; ++i)
+            bigger[i] = std::move(slots[(head + i) % capacity]);
+        slots = std::move(bigger);
+        capacity *= 2;
+        head = 0;
+    }
+
+    std::unique_ptr<T[]> slots;
+    std::size_t capacity;
+    std::size_t head = 0;
+    std::size_t count = 0;
+};
+
+// scheduling classes, in order of decreasing priority
+enum class Priority {
+    high,
+    normal,
+    background
+};
+
+// per task scheduling hints for ThreadPool::enqueue
+struct TaskOptions {
+    using clock = std::chrono::steady_clock;
+
+    TaskOptions(Priority priority = Priority::normal,
+                clock::time_point deadline = clock::time_point::max(),
+                int node = -1):
+        priority(priority), deadline(deadline), node(node) {}
+
+    Priority priority;
+    // a task whose deadline has passed is served before any other class
+    clock::time_point deadline;
+    // preferred NUMA node, the task is queued for the workers of that
+    // node if the pool pins its workers, -1 means no preference
+    int node;
+};
+
+// histogram of queueing delays with power of two buckets:
+// bucket 0 counts waits below 1us, bucket i waits in [2^(i-1), 2^i) us
+struct WaitHistogram {
+    static constexpr std::size_t buckets = 32;
+
+    std::array<std::uint64_t, buckets> counts{};
+    std::uint64_t total = 0;
+
+    void record(std::chrono::steady_clock::duration wait) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(wait).count();
+        std::size_t bucket = 0;
+        while(us > 0 && bucket < buckets - 1) {
+            us >>= 1;
+            ++bucket;
+        }
+        ++counts[bucket];
+        ++total;
+    }
+
+    void merge(const WaitHistogram& other) {
+        for(std::size_t i = 0; i < buckets; ++i)
+            counts[i] += other.counts[i];
+        total += other.total;
+    }
+
+    // upper bound in microseconds of the bucket holding the p-th percentile
+    std::uint64_t percentile(double p) const {
+        if(total == 0)
+            return 0;
+        std::uint64_t rank = std::min(total - 1, static_cast<std::uint64_t>(p / 100.0 * total));
+        std::uint64_t seen = 0;
+        for(std::size_t i = 0; i < buckets; ++i) {
+            seen += counts[i];
+            if(seen > rank)
+                return std::uint64_t(1) << i;
+        }
+        return std::uint64_t(1) << (buckets - 1);
+    }
+};
+
+// snapshot of one scheduling class
+struct QueueStats {
+    // number of queued tasks
+    std::size_t depth = 0;
+    // time between enqueue and the start of execution
+    WaitHistogram wait;
+};
+
+// Global queue of the pool with one sub-queue for every priority class.
+//
+// The classes share the workers by smooth weighted round robin, while all
+// of them are backlogged high gets 16, normal 4 and background 1 out of 21
+// dequeues, so a burst of background work can not delay latency sensitive
+// tasks, but background tasks never starve either. A class with no work
+// gives its share to the others.
+//
+// Inside a class tasks with a deadline are served earliest deadline first
+// and before the plain tasks, which are served in FIFO order. A task whose
+// deadline has already passed is served before everything else.
+//
+// Not thread safe, the pool guards it with its queue mutex.
+class PriorityTaskQueue {
+public:
+    static constexpr std::size_t classes = 3;
+
+    bool empty() const { return count == 0; }
+    std::size_t size() const { return count; }
+
+    void push(Task&& task, const TaskOptions& options = TaskOptions()) {
+        Class& c = queues[static_cast<std::size_t>(options.priority)];
+        auto now = TaskOptions::clock::now();
+        if(options.deadline == TaskOptions::clock::time_point::max()) {
+            c.plain.push(Entry{std::move(task), now, options.deadline, 0});
+        } else {
+            c.timed.push_back(Entry{std::move(task), now, options.deadline, sequence++});
+            std::push_heap(c.timed.begin(), c.timed.end(), later);
+        }
+        ++count;
+    }
+
+    // must not be called on an empty queue
+    Task pop() {
+        auto now = TaskOptions::clock::now();
+        std::size_t picked = pick(now);
+        Class& c = queues[picked];
+
+        Entry entry;
+        if(!c.timed.empty()) {
+            std::pop_heap(c.timed.begin(), c.timed.end(), later);
+            entry = std::move(c.timed.back());
+            c.timed.pop_back();
+        } else {
+            entry = std::move(c.plain.front());
+            c.plain.pop();
+        }
+        --count;
+
+        // an idle class must not hoard credit for its next burst
+        if(c.empty())
+            c.current = 0;
+
+        c.wait.record(now - entry.enqueued);
+        return std::move(entry.task);
+    }
+
+    QueueStats stats(Priority priority) const {
+        const Class& c = queues[static_cast<std::size_t>(priority)];
+        QueueStats s;
+        s.depth = c.plain.size() + c.timed.size();
+        s.wait = c.wait;
+        return s;
+    }
+
+private:
+    struct Entry {
+        Task task;
+        TaskOptions::clock::time_point enqueued;
+        TaskOptions::clock::time_point deadline;
+        // breaks ties between equal deadlines in FIFO order
+        std::uint64_t sequence;
+    };
+
+    // heap order, the earliest deadline on top
+    static bool later(const Entry& a, const Entry& b) {
+        if(a.deadline != b.deadline)
+            return a.deadline > b.deadline;
+        return a.sequence > b.sequence;
+    }
+
+    struct Class {
+        RingQueue<Entry> plain;
+        std::vector<Entry> timed;
+        WaitHistogram wait;
+        // smooth weighted round robin state
+        long current = 0;
+
+        bool empty() const { return plain.empty() && timed.empty(); }
+    };
+
+    std::size_t pick(TaskOptions::clock::time_point now) {
+        // an overdue task wins regardless of its class
+        std::size_t overdue = classes;
+        for(std::size_t i = 0; i < classes; ++i) {
+            const auto& timed = queues[i].timed;
+            if(!timed.empty() && timed.front().deadline <= now &&
+               (overdue == classes || timed.front().deadline < queues[overdue].timed.front().deadline))
+                overdue = i;
+        }
+        if(overdue != classes)
+            return overdue;
+
+        // every backlogged class earns its weight, the richest one is
+        // served and pays the sum of the weights back
+        std::size_t best = classes;
+        long total = 0;
+        for(std::size_t i = 0; i < classes; ++i) {
+            if(queues[i].empty())
+                continue;
+            queues[i].current += weights[i];
+            total += weights[i];
+            if(best == classes || queues[i].current > queues[best].current)
+                best = i;
+        }
+        queues[best].current -= total;
+        return best;
+    }
+
+    static constexpr std::array<long, classes> weights{16, 4, 1};
+
+    std::array<Class, classes> queues;
+    std::size_t count = 0;
+    std::uint64_t sequence = 0;
+};
+
+#endif
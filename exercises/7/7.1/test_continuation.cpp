@@ -0,0 +1,90 @@
+//
+// test_continuation.cpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// continuations that become due after the pool is stopped or destroyed
+// run on the thread that completes the future, instead of being submitted
+// to a pool that takes no more tasks. Exits with 1 if a check fails.
+//
+
+#include <iostream>  // std::cout, std::endl
+#include <stdexcept> // std::runtime_error
+#include <thread>    // std::this_thread::get_id, std::this_thread::sleep_for
+#include <chrono>    // std::chrono::milliseconds
+#include <cstdlib>   // std::exit
+
+#include "thread_pool.hpp"
+
+static void check(bool ok, const char* what) {
+    if(!ok) {
+        std::cout << "failed: " << what << std::endl;
+        std::exit(1);
+    }
+}
+
+static void run(ThreadPool::Scheduling scheduling) {
+    // then() on a ready future after stop()
+    {
+        ThreadPool pool(2, scheduling);
+        auto ready = pool.async([] { return 20; });
+        ready.wait();
+        pool.stop();
+
+        std::thread::id where;
+        auto next = ready.then([&where](int v) {
+            where = std::this_thread::get_id();
+            return v + 1;
+        });
+        check(next.is_ready() && next.get() == 21, "then() after stop()");
+        check(where == std::this_thread::get_id(), "then() after stop() runs on the caller");
+    }
+
+    // then() attached before stop(), the future completes while the
+    // workers finish the queue
+    {
+        ThreadPool pool(2, scheduling);
+        auto slow = pool.async([] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            return 1;
+        });
+        auto next = slow.then([](int v) { return v + 1; });
+        pool.stop();
+        check(next.get() == 2, "continuation due during stop()");
+    }
+
+    // then() after the pool is gone
+    {
+        Future<int> kept;
+        {
+            ThreadPool pool(2, scheduling);
+            kept = pool.async([] { return 40; });
+            kept.wait();
+        }
+        check(kept.then([](int v) { return v + 2; }).get() == 42, "then() after the pool is destroyed");
+    }
+
+    // new work from outside is still refused
+    {
+        ThreadPool pool(2, scheduling);
+        pool.stop();
+        bool refused = false;
+        try {
+            pool.async([] { return 0; });
+        } catch(const std::runtime_error&) {
+            refused = true;
+        }
+        check(refused, "async() after stop() throws");
+    }
+}
+
+int main() {
+    run(ThreadPool::Scheduling::shared_queue);
+    run(ThreadPool::Scheduling::work_stealing);
+    std::cout << "ok" << std::endl;
+    return 0;
+}
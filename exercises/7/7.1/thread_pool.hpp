@@ -12,123 +12,920 @@
 #define THREAD_POOL_H
 
 #include <vector>               // std::vector
-#include <queue>                // std::queue
-#include <memory>               // std::make_shared
+#include <memory>               // std::shared_ptr, std::unique_ptr
 
 #include <thread>               // std::thread
 #include <mutex>                // std::mutex, std::unique_lock
 #include <condition_variable>   // std::condition_variable
-#include <future>               // std::future, std::packaged_task
+#include <future>               // std::future, std::promise
+#include <atomic>               // std::atomic
+#include <chrono>               // std::chrono::milliseconds
 
-#include <functional>           // std::function, std::bind
+#include <functional>           // std::invoke
 #include <stdexcept>            // std::runtime_error
+#include <iterator>             // std::iterator_traits
+#include <exception>            // std::exception_ptr
+#include <type_traits>          // std::invoke_result_t
+#include <concepts>             // std::invocable
 #include <utility>              // std::move, std::forward
+#include <algorithm>            // std::min, std::max
+#include <cstdint>              // std::uint64_t
+
+#include "task.hpp"
+#include "task_queue.hpp"
+#include "future.hpp"
+#include "topology.hpp"
+#include "slab_allocator.hpp"
+#include "work_stealing_queue.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>          // _mm_pause
+#endif
 
 class ThreadPool {
 public:
-    
+
+    // how tasks are distributed to the workers
+    enum class Scheduling {
+        // all workers share one queue guarded by a mutex
+        shared_queue,
+        // every worker owns a deque, tasks enqueued by a worker stay local
+        // and idle workers steal from the others
+        work_stealing
+    };
+
+    // what an idle worker does before it blocks on the condition variable
+    enum class Idle {
+        // block right away, every wake up costs a futex call
+        park,
+        // spin and yield for a short, adaptive while first, a task that
+        // arrives in the meantime is picked up without being woken up
+        spin_then_park
+    };
+
+    // where the workers may run
+    enum class Affinity {
+        // let the operating system place and migrate the workers
+        none,
+        // pin every worker to one cpu
+        cpu,
+        // pin every worker to the cpus of its NUMA node
+        node
+    };
+
+    // scheduling classes and per task hints, see task_queue.hpp
+    using Priority = ::Priority;
+    using TaskOptions = ::TaskOptions;
+
+    struct Config {
+        // the pool never shrinks below min_threads workers
+        size_t min_threads = 1;
+        // and grows up to max_threads workers while tasks queue up
+        size_t max_threads = std::thread::hardware_concurrency();
+        Scheduling scheduling = Scheduling::shared_queue;
+        Idle idle = Idle::park;
+        // a worker above min_threads retires after being idle for this long
+        std::chrono::milliseconds idle_timeout{1000};
+        // pinned workers are spread over the NUMA nodes round robin and
+        // every node gets its own queue, TaskOptions::node selects it
+        Affinity affinity = Affinity::none;
+    };
+
     // initialize the number of concurrency threads
-    ThreadPool(size_t);
-    
+    ThreadPool(size_t, Scheduling = Scheduling::shared_queue);
+    // initialize a pool that resizes itself between the given bounds
+    explicit ThreadPool(const Config&);
+
     // enqueue new thread task
-    template<class F, class... Args>
+    template<class F, class... Args> requires std::invocable<F, Args...>
     decltype(auto) enqueue(F&& f, Args&&... args);
 
+    // enqueue new thread task with a priority class and an optional
+    // deadline, e.g. pool.enqueue(ThreadPool::Priority::high, f)
+    template<class F, class... Args> requires std::invocable<F, Args...>
+    decltype(auto) enqueue(const TaskOptions& options, F&& f, Args&&... args);
+
+    // enqueue a fire-and-forget task, no future is created,
+    // an exception escaping the task terminates the program
+    template<class F, class... Args> requires std::invocable<F, Args...>
+    void post(F&& f, Args&&... args);
+
+    template<class F, class... Args> requires std::invocable<F, Args...>
+    void post(const TaskOptions& options, F&& f, Args&&... args);
+
+    // like enqueue, but the returned Future runs continuations attached
+    // with then() on this pool instead of blocking a thread in get()
+    template<class F, class... Args> requires std::invocable<F, Args...>
+    auto async(F&& f, Args&&... args);
+
+    template<class F, class... Args> requires std::invocable<F, Args...>
+    auto async(const TaskOptions& options, F&& f, Args&&... args);
+
+    // enqueue a range of callables under a single lock acquisition,
+    // returns one future for each of them
+    template<class InputIt>
+    decltype(auto) enqueue_bulk(InputIt first, InputIt last);
+
+    // call fn(i) for every i in [begin, end), chunks of at least `grain`
+    // indices run in parallel. Blocks until all of them are done, the
+    // caller executes queued tasks in the meantime. The first exception
+    // thrown by fn is rethrown to the caller.
+    template<class Index, class F>
+    void parallel_for(Index begin, Index end, Index grain, F&& fn);
+
+    // combine(identity, map(i)) for every i in [begin, end), in parallel,
+    // combine must be associative and commutative
+    template<class Index, class T, class Map, class Combine>
+    T parallel_reduce(Index begin, Index end, Index grain, T identity,
+                      Map&& map, Combine&& combine);
+
+    // queue depth and queueing delay of a priority class, tasks kept in
+    // the local deques of the work stealing mode are not included
+    QueueStats stats(Priority priority);
+
+    // number of running workers
+    size_t size() const { return alive.load(); }
+    // number of NUMA nodes with their own queue, 1 unless workers are pinned
+    size_t nodes() const { return tasks.size(); }
+
+    // refuse new tasks from outside, let the workers finish the queued
+    // ones and join them. Continuations of futures from async() that
+    // become due afterwards run on the thread that completes the future.
+    // Must not be called from a task of the pool.
+    void stop();
+
     // destroy thread pool and all created threads
     ~ThreadPool();
 private:
-    
-    // thread list, stores all threads
+
+    struct Worker;
+
+    // a task in a local deque, the deque holds pointers to these
+    struct Node {
+        Task task;
+        // the worker whose free list the node belongs to
+        Worker* home = nullptr;
+        Node* next = nullptr;
+    };
+
+    // per worker state for work stealing
+    struct Worker {
+        explicit Worker(std::uint64_t seed): seed(seed) {}
+
+        // local deque, only the owning worker pushes and pops
+        WorkStealingQueue<Node> local;
+        // state of the random generator used to pick a victim
+        std::uint64_t seed;
+
+        // nodes of this worker, only the owner allocates from and frees
+        // to this list, so neither takes a lock
+        Node* free_nodes = nullptr;
+        std::vector< std::unique_ptr<Node[]> > chunks;
+        // nodes freed by thieves, pushed without a lock and taken back
+        // by the owner all at once when its own list runs dry
+        alignas(64) std::atomic<Node*> returned{nullptr};
+    };
+
+    // identifies the pool and worker index of the calling thread
+    struct Context {
+        ThreadPool* pool;
+        size_t index;
+    };
+    static inline thread_local Context current{nullptr, 0};
+
+    void worker_loop(size_t index);
+    // start a worker in a free slot, queue_mutex must be held
+    void spawn();
+    // wait for pending work without blocking, true if some showed up
+    bool spin(unsigned& budget);
+    // wake up a sleeping worker
+    void wake_one();
+    // try to fetch a task for the given worker without blocking
+    bool take(size_t index, Task& task);
+    // steal from a random victim, nullptr if all deques are empty
+    Node* steal(size_t index);
+    // push a task to the global queue or to the local deque of the caller,
+    // tasks with non-default options always go to the global queue
+    void submit(Task&& task, const TaskOptions& options = TaskOptions());
+    // like submit, but false instead of an exception if the pool is
+    // stopped, the task is left as it is then
+    bool try_submit(Task&& task, const TaskOptions& options = TaskOptions());
+    // push many tasks at once, the queue is locked only one time
+    void submit_bulk(Task* first, Task* last);
+    // run one queued task on the calling thread, false if there was none
+    bool run_pending();
+    // schedules the continuations of the futures returned by async()
+    Executor executor();
+
+    // what the executors of the futures point to instead of the pool,
+    // stop() clears `pool` and waits until no continuation is being
+    // submitted through it any more
+    struct Gate {
+        std::atomic<ThreadPool*> pool;
+        std::atomic<size_t> submitting{0};
+    };
+
+    // queue_mutex must be held for the functions below.
+    // queue a task for the hinted node, the node of the calling
+    // worker, or round robin for tasks from outside the pool
+    void push_task(Task&& task, const TaskOptions& options);
+    // dequeue from the caller's node first, then from the others
+    bool pop_task(Task& task);
+    // total number of tasks in the node queues
+    size_t queued() const;
+
+    // progress of a parallel_for, lives on the stack of the caller
+    struct RangeState {
+        std::atomic<size_t> remaining;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+    // execute body(b, e) for sub-ranges of [begin, end) in parallel and wait
+    template<class Index, class Body>
+    void parallel_range(Index begin, Index end, Index grain, Body& body);
+    // execute [b, e) and hand out the upper half while workers run dry
+    template<class Index, class Body>
+    void run_range(Index b, Index e, Index grain, Body& body, RangeState& state);
+
+    // tasks in the local deques are referenced by pointer, their nodes
+    // are recycled through the free lists of the workers, a node goes
+    // back to the worker that created it
+    Node* make_node(Task&& task);
+    void free_node(Node* node, size_t index);
+
+    Config config;
+    Scheduling scheduling;
+
+    // backs the shared state of the futures
+    std::shared_ptr<Slab> slab;
+    std::shared_ptr<Gate> gate;
+
+    // thread list, stores all threads, one slot for each potential worker
     std::vector< std::thread > workers;
+    // which slots hold a running worker, guarded by queue_mutex
+    std::vector< char > running;
+    // number of running workers, only changed with queue_mutex held
+    std::atomic<size_t> alive;
+    // work stealing deques, one for each worker
+    std::vector< std::unique_ptr<Worker> > locals;
     // queue task, the type of queue elements are functions with void return type
-    std::queue< std::function<void()> > tasks;
-    
+    // in work stealing mode it only receives tasks from outside the pool,
+    // one queue for every NUMA node
+    std::vector< PriorityTaskQueue > tasks;
+    // cpus and nodes of the worker slots
+    Topology topology;
+    std::vector< int > worker_cpu;
+    std::vector< size_t > worker_node;
+    // node that receives the next task from outside, guarded by queue_mutex
+    size_t next_node = 0;
+    // number of queued tasks, both global and local ones
+    std::atomic<size_t> pending;
+    // number of workers blocked on the condition variable
+    std::atomic<size_t> sleeping;
+    // number of workers looking for work without being blocked
+    std::atomic<size_t> spinning;
+
     // for synchonization
     std::mutex queue_mutex;
     // std::condition_variable is a new feature from c++11,
-    // it's a synchronization primitives. it can be used 
+    // it's a synchronization primitives. it can be used
     // to block a thread or threads at the same time until
     // all of them modified condition_variable.
     std::condition_variable condition;
-    bool stop;
+    bool stopped;
 };
- 
+
 // constructor initialize a fixed size of worker
-inline ThreadPool::ThreadPool(size_t threads): stop(false) {
+inline ThreadPool::ThreadPool(size_t threads, Scheduling scheduling):
+    ThreadPool(Config{threads, threads, scheduling}) {}
+
+inline ThreadPool::ThreadPool(const Config& cfg):
+    config(cfg), scheduling(cfg.scheduling), slab(std::make_shared<Slab>()),
+    gate(std::make_shared<Gate>()), alive(0), pending(0), sleeping(0), spinning(0), stopped(false) {
+    gate->pool.store(this);
+    config.max_threads = std::max<size_t>(1, config.max_threads);
+    config.min_threads = std::min(config.min_threads, config.max_threads);
+
+    // create the local deques before any worker may try to steal from them
+    if(scheduling == Scheduling::work_stealing)
+        for(size_t i = 0;i<config.max_threads;++i)
+            locals.emplace_back(new Worker(0x9E3779B97F4A7C15ull * (i + 1)));
+
+    workers.resize(config.max_threads);
+    running.assign(config.max_threads, 0);
+
+    // assign the slots to the cpus, alternating between the nodes so
+    // that even a small pool uses all of them
+    std::vector< std::pair<int, size_t> > order;
+    if(config.affinity != Affinity::none) {
+        topology = Topology::detect();
+        for(size_t k = 0; order.size() < topology.cpu_count(); ++k)
+            for(size_t node = 0; node < topology.nodes.size(); ++node)
+                if(k < topology.nodes[node].size())
+                    order.emplace_back(topology.nodes[node][k], node);
+        // no cpu to pin to, leave the workers to the operating system
+        if(order.empty())
+            config.affinity = Affinity::none;
+    }
+    if(config.affinity != Affinity::none) {
+        for(size_t i = 0; i < config.max_threads; ++i) {
+            worker_cpu.push_back(order[i % order.size()].first);
+            worker_node.push_back(order[i % order.size()].second);
+        }
+        tasks.resize(topology.nodes.size());
+    } else {
+        worker_cpu.assign(config.max_threads, -1);
+        worker_node.assign(config.max_threads, 0);
+        tasks.resize(1);
+    }
+
     // initialize worker
-    for(size_t i = 0;i<threads;++i)
-        // std::vector::emplace_back :
-        //    append to the end of vector container
-        //    this element will be constructed at the end of container, without copy and move behavior
-        workers.emplace_back([this] { // the lambda express capture this, i.e. the instance of thread pool
-                // avoid fake awake
-                for(;;) {
-                    // define function task container, return type is void
-                    std::function<void()> task;
-
-                    // critical section
-                    {
-                        // get mutex
-                        std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        
-                        // block current thread
-                        this->condition.wait(lock,
-                            [this]{ return this->stop || !this->tasks.empty(); });
-                        
-                        // return if queue empty and task finished
-                        if(this->stop && this->tasks.empty())
-                            return;
-                        
-                        // otherwise execute the first element of queue
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
-                    }
-                    
-                    // execution
-                    task();
-                }
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    for(size_t i = 0;i<config.min_threads;++i)
+        spawn();
+}
+
+inline void ThreadPool::spawn() {
+    if(stopped)
+        return;
+
+    for(size_t i = 0; i < running.size(); ++i) {
+        if(running[i])
+            continue;
+
+        // a retired worker has already left the critical section,
+        // joining it can not block on queue_mutex
+        if(workers[i].joinable())
+            workers[i].join();
+
+        running[i] = 1;
+        alive.fetch_add(1);
+        workers[i] = std::thread([this, i] { // the lambda express capture this, i.e. the instance of thread pool
+            worker_loop(i);
+        });
+        return;
+    }
+}
+
+inline void ThreadPool::worker_loop(size_t index) {
+    current = Context{this, index};
+
+    if(config.affinity == Affinity::cpu)
+        pin_current_thread({worker_cpu[index]});
+    else if(config.affinity == Affinity::node)
+        pin_current_thread(topology.nodes[worker_node[index]]);
+
+    // rounds to spin before parking, adapted to how often spinning pays off
+    unsigned budget = 64;
+
+    // avoid fake awake
+    for(;;) {
+        // define function task container, return type is void
+        Task task;
+
+        // fast path, no lock is needed to pick up local or stolen work
+        if(!take(index, task)) {
+            if(config.idle == Idle::spin_then_park && spin(budget))
+                continue;
+
+            // critical section
+            std::unique_lock<std::mutex> lock(queue_mutex);
+
+            // announce the sleep before checking the condition, the
+            // submitter checks `sleeping` after publishing the task,
+            // so one of the two always sees the other
+            sleeping.fetch_add(1);
+            // block current thread, workers above the minimum only
+            // wait for a limited time
+            auto ready = [this]{ return stopped || pending.load() > 0; };
+            bool woken = true;
+            if(alive.load() > config.min_threads)
+                woken = condition.wait_for(lock, config.idle_timeout, ready);
+            else
+                condition.wait(lock, ready);
+            sleeping.fetch_sub(1);
+
+            // return if queue empty and task finished,
+            // or retire if there was nothing to do for a while
+            bool retire = !woken && alive.load() > config.min_threads;
+            if((stopped && pending.load() == 0) || retire) {
+                running[index] = 0;
+                alive.fetch_sub(1);
+                return;
             }
-        );
+
+            // the task may sit in a local deque, go back and steal it
+            if(!pop_task(task))
+                continue;
+
+            // otherwise execute the first element of queue
+            pending.fetch_sub(1);
+        }
+
+        // a spinning worker does not get notified, if more work is
+        // waiting pass the wake up on to a sleeping worker
+        if(config.idle == Idle::spin_then_park && pending.load() > 0
+           && sleeping.load() > 0 && spinning.load() == 0)
+            wake_one();
+
+        // execution
+        task();
+    }
 }
 
-// Enqueue a new thread
-// use variadic templates and tail return type 
-template<class F, class... Args>
-decltype(auto) ThreadPool::enqueue(F&& f, Args&&... args) {
-    // deduce return type
-    using return_type = typename std::result_of<F(Args...)>::type;
+// a pause instruction tells the core that this is a spin-wait loop,
+// which saves power and frees resources for the sibling hyperthread
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+inline bool ThreadPool::spin(unsigned& budget) {
+    spinning.fetch_add(1);
+
+    // exponential backoff, pause first and yield the cpu later on
+    bool found = false;
+    unsigned pauses = 1;
+    for(unsigned round = 0; round < budget; ++round) {
+        if(pending.load(std::memory_order_relaxed) > 0) {
+            found = true;
+            break;
+        }
+        if(pauses < 1024) {
+            for(unsigned i = 0; i < pauses; ++i)
+                cpu_relax();
+            pauses *= 2;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    spinning.fetch_sub(1);
+
+    // spin longer next time if it paid off, shorter if not
+    budget = found ? std::min(budget * 2, 1024u) : std::max(budget / 2, 16u);
+    return found;
+}
+
+inline void ThreadPool::wake_one() {
+    // the lock orders the notification after the sleeper's wait
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    condition.notify_one();
+}
 
-    // fetch task
-    auto task = std::make_shared<std::packaged_task<return_type()>>(
-        std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-    );
+inline bool ThreadPool::take(size_t index, Task& task) {
+    // newest local task first (LIFO), its data is most likely still in cache
+    Node* found = nullptr;
+    if(scheduling == Scheduling::work_stealing)
+        found = locals[index]->local.pop();
+
+    // then tasks injected from outside the pool
+    if(!found && pending.load(std::memory_order_relaxed) > 0) {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        if(pop_task(task)) {
+            pending.fetch_sub(1);
+            return true;
+        }
+    }
 
-    std::future<return_type> res = task->get_future();
+    if(!found && scheduling == Scheduling::work_stealing)
+        found = steal(index);
+    if(!found)
+        return false;
 
+    pending.fetch_sub(1);
+    task = std::move(found->task);
+    free_node(found, index);
+    return true;
+}
+
+inline ThreadPool::Node* ThreadPool::steal(size_t index) {
+    size_t n = locals.size();
+    if(n < 2)
+        return nullptr;
+
+    // xorshift64, start at a random victim to spread the thieves
+    std::uint64_t& x = locals[index]->seed;
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    size_t start = x % n;
+
+    // oldest task of the victim first (FIFO)
+    for(size_t k = 0; k < n; ++k) {
+        size_t victim = (start + k) % n;
+        if(victim == index)
+            continue;
+        if(Node* node = locals[victim]->local.steal())
+            return node;
+    }
+    return nullptr;
+}
+
+inline void ThreadPool::submit(Task&& task, const TaskOptions& options) {
+    if(!try_submit(std::move(task), options))
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+}
+
+inline bool ThreadPool::try_submit(Task&& task, const TaskOptions& options) {
+    bool plain = options.priority == Priority::normal
+              && options.deadline == TaskOptions::clock::time_point::max()
+              && (options.node < 0 || current.pool != this
+                  || static_cast<size_t>(options.node) % tasks.size() == worker_node[current.index]);
+
+    // tasks spawned by a worker of this pool go to its own deque
+    if(scheduling == Scheduling::work_stealing && current.pool == this && plain) {
+        // count the task before it becomes visible to thieves
+        pending.fetch_add(1);
+        locals[current.index]->local.push(make_node(std::move(task)));
+
+        // only pay for the wake up if somebody is actually sleeping
+        if(sleeping.load() > 0 && spinning.load() == 0)
+            wake_one();
+        return true;
+    }
+
+    bool wake;
     // critical section
     {
         std::unique_lock<std::mutex> lock(queue_mutex);
 
-        // avoid add new thread if theadpool is destroyed
-        if(stop)
-            throw std::runtime_error("enqueue on stopped ThreadPool");
+        // avoid add new thread if theadpool is destroyed, the workers
+        // keep draining the queue, so running tasks may still add more
+        if(stopped && current.pool != this)
+            return false;
 
         // add thread to queue
-        tasks.emplace([task]{ (*task)(); });
+        push_task(std::move(task), options);
+        pending.fetch_add(1);
+
+        // a spinning worker will pick the task up by itself
+        wake = sleeping.load() > 0 && spinning.load() == 0;
+
+        // nobody is idle and the queue is longer than the pool, grow
+        if(sleeping.load() == 0 && spinning.load() == 0
+           && queued() > alive.load() && alive.load() < config.max_threads)
+            spawn();
     }
 
     // notify a wait thread
-    condition.notify_one();
+    if(wake)
+        condition.notify_one();
+    return true;
+}
+
+inline void ThreadPool::push_task(Task&& task, const TaskOptions& options) {
+    size_t node;
+    if(options.node >= 0)
+        node = static_cast<size_t>(options.node) % tasks.size();
+    else if(current.pool == this)
+        node = worker_node[current.index];
+    else
+        node = next_node++ % tasks.size();
+    tasks[node].push(std::move(task), options);
+}
+
+inline bool ThreadPool::pop_task(Task& task) {
+    size_t home = current.pool == this ? worker_node[current.index] : 0;
+    for(size_t k = 0; k < tasks.size(); ++k) {
+        PriorityTaskQueue& queue = tasks[(home + k) % tasks.size()];
+        if(!queue.empty()) {
+            task = queue.pop();
+            return true;
+        }
+    }
+    return false;
+}
+
+inline size_t ThreadPool::queued() const {
+    size_t n = 0;
+    for(auto& queue: tasks)
+        n += queue.size();
+    return n;
+}
+
+// only called by the worker that pushes the node to its deque
+inline ThreadPool::Node* ThreadPool::make_node(Task&& task) {
+    Worker& worker = *locals[current.index];
+
+    // take back what thieves returned, then carve a new chunk
+    if(!worker.free_nodes)
+        worker.free_nodes = worker.returned.exchange(nullptr, std::memory_order_acquire);
+    if(!worker.free_nodes) {
+        const size_t chunk_size = 256;
+        worker.chunks.emplace_back(new Node[chunk_size]);
+        Node* chunk = worker.chunks.back().get();
+        for(size_t i = 0; i < chunk_size; ++i) {
+            chunk[i].home = &worker;
+            chunk[i].next = worker.free_nodes;
+            worker.free_nodes = &chunk[i];
+        }
+    }
+
+    Node* node = worker.free_nodes;
+    worker.free_nodes = node->next;
+    node->task = std::move(task);
+    return node;
+}
+
+// the task has been moved out, `index` is the worker that took it
+inline void ThreadPool::free_node(Node* node, size_t index) {
+    Worker* home = node->home;
+    if(home == locals[index].get()) {
+        node->next = home->free_nodes;
+        home->free_nodes = node;
+        return;
+    }
+
+    // a stolen node, push it to the owner's return list. The owner only
+    // ever takes the whole list, so there is no ABA problem
+    Node* head = home->returned.load(std::memory_order_relaxed);
+    do {
+        node->next = head;
+    } while(!home->returned.compare_exchange_weak(head, node,
+                std::memory_order_release, std::memory_order_relaxed));
+}
+
+// Enqueue a new thread
+// use variadic templates and tail return type
+template<class F, class... Args> requires std::invocable<F, Args...>
+decltype(auto) ThreadPool::enqueue(F&& f, Args&&... args) {
+    return enqueue(TaskOptions(), std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+template<class F, class... Args> requires std::invocable<F, Args...>
+decltype(auto) ThreadPool::enqueue(const TaskOptions& options, F&& f, Args&&... args) {
+    // deduce return type
+    using return_type = std::invoke_result_t<F, Args...>;
+
+    // the shared state between promise and future comes from the slab
+    std::promise<return_type> promise(std::allocator_arg, SlabAllocator<char>(slab));
+    std::future<return_type> res = promise.get_future();
+
+    // fetch task, the promise and the arguments are moved into the
+    // closure, which is small enough to live inside the Task
+    submit([promise = std::move(promise),
+            f = std::forward<F>(f),
+            ...args = std::forward<Args>(args)]() mutable {
+        try {
+            if constexpr (std::is_void_v<return_type>) {
+                std::invoke(std::move(f), std::move(args)...);
+                promise.set_value();
+            } else {
+                promise.set_value(std::invoke(std::move(f), std::move(args)...));
+            }
+        } catch(...) {
+            promise.set_exception(std::current_exception());
+        }
+    }, options);
     return res;
 }
 
-// destroy everything
-inline ThreadPool::~ThreadPool()
-{
+template<class F, class... Args> requires std::invocable<F, Args...>
+void ThreadPool::post(F&& f, Args&&... args) {
+    post(TaskOptions(), std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+template<class F, class... Args> requires std::invocable<F, Args...>
+void ThreadPool::post(const TaskOptions& options, F&& f, Args&&... args) {
+    submit([f = std::forward<F>(f), ...args = std::forward<Args>(args)]() mutable {
+        std::invoke(std::move(f), std::move(args)...);
+    }, options);
+}
+
+template<class F, class... Args> requires std::invocable<F, Args...>
+auto ThreadPool::async(F&& f, Args&&... args) {
+    return async(TaskOptions(), std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+template<class F, class... Args> requires std::invocable<F, Args...>
+auto ThreadPool::async(const TaskOptions& options, F&& f, Args&&... args) {
+    using return_type = std::invoke_result_t<F, Args...>;
+
+    Promise<return_type> promise(executor());
+    Future<return_type> res = promise.get_future();
+
+    submit([promise = std::move(promise),
+            f = std::forward<F>(f),
+            ...args = std::forward<Args>(args)]() mutable {
+        promise.set_from(std::move(f), std::move(args)...);
+    }, options);
+    return res;
+}
+
+inline Executor ThreadPool::executor() {
+    return Executor{gate, [](void* context, Task&& task) {
+        Gate& gate = *static_cast<Gate*>(context);
+        // announce the submission before looking at the pool, stop()
+        // clears the pool before it waits for the announcements
+        gate.submitting.fetch_add(1);
+        ThreadPool* pool = gate.pool.load();
+        bool submitted = pool && pool->try_submit(std::move(task));
+        gate.submitting.fetch_sub(1);
+
+        // the pool is stopped or gone, run it here
+        if(!submitted)
+            task();
+    }};
+}
+
+inline QueueStats ThreadPool::stats(Priority priority) {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    QueueStats total;
+    for(auto& queue: tasks) {
+        QueueStats s = queue.stats(priority);
+        total.depth += s.depth;
+        total.wait.merge(s.wait);
+    }
+    return total;
+}
+
+template<class InputIt>
+decltype(auto) ThreadPool::enqueue_bulk(InputIt first, InputIt last) {
+    using F = typename std::iterator_traits<InputIt>::value_type;
+    using return_type = std::invoke_result_t<F>;
+
+    std::vector< std::future<return_type> > results;
+    std::vector< Task > batch;
+
+    // build all tasks outside of the critical section
+    for(; first != last; ++first) {
+        std::promise<return_type> promise(std::allocator_arg, SlabAllocator<char>(slab));
+        results.emplace_back(promise.get_future());
+        batch.emplace_back([promise = std::move(promise), f = F(*first)]() mutable {
+            try {
+                if constexpr (std::is_void_v<return_type>) {
+                    std::invoke(std::move(f));
+                    promise.set_value();
+                } else {
+                    promise.set_value(std::invoke(std::move(f)));
+                }
+            } catch(...) {
+                promise.set_exception(std::current_exception());
+            }
+        });
+    }
+
+    submit_bulk(batch.data(), batch.data() + batch.size());
+    return results;
+}
+
+inline void ThreadPool::submit_bulk(Task* first, Task* last) {
+    size_t n = last - first;
+    if(n == 0)
+        return;
+
+    if(scheduling == Scheduling::work_stealing && current.pool == this) {
+        pending.fetch_add(n);
+        for(; first != last; ++first)
+            locals[current.index]->local.push(make_node(std::move(*first)));
+
+        if(sleeping.load() > 0) {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            condition.notify_all();
+        }
+        return;
+    }
+
+    // critical section, entered once for the whole batch
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+
+        if(stopped && current.pool != this)
+            throw std::runtime_error("enqueue on stopped ThreadPool");
+
+        for(; first != last; ++first)
+            push_task(std::move(*first), TaskOptions());
+        pending.fetch_add(n);
+
+        // grow towards the size of the batch if nobody is idle
+        if(sleeping.load() == 0 && spinning.load() == 0)
+            while(queued() > alive.load() && alive.load() < config.max_threads)
+                spawn();
+    }
+
+    // there is work for everybody
+    condition.notify_all();
+}
+
+inline bool ThreadPool::run_pending() {
+    Task task;
+
+    if(scheduling == Scheduling::work_stealing && current.pool == this) {
+        if(!take(current.index, task))
+            return false;
+    } else {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        if(!pop_task(task))
+            return false;
+        pending.fetch_sub(1);
+    }
+
+    task();
+    return true;
+}
+
+template<class Index, class Body>
+void ThreadPool::run_range(Index b, Index e, Index grain, Body& body, RangeState& state) {
+    // lazy binary splitting: only create more parallel slack while
+    // there are fewer queued tasks than workers, otherwise the others
+    // are busy anyway and splitting would be pure overhead
+    while(e - b > grain && pending.load(std::memory_order_relaxed) < alive.load(std::memory_order_relaxed)) {
+        Index mid = b + (e - b) / 2;
+        submit([this, mid, e, grain, &body, &state] {
+            run_range(mid, e, grain, body, state);
+        });
+        e = mid;
+    }
+
+    try {
+        body(b, e);
+    } catch(...) {
+        std::lock_guard<std::mutex> lock(state.error_mutex);
+        if(!state.error)
+            state.error = std::current_exception();
+    }
+
+    // the caller may return as soon as this reaches zero,
+    // so it must be the last access to the state
+    state.remaining.fetch_sub(static_cast<size_t>(e - b), std::memory_order_acq_rel);
+}
+
+template<class Index, class Body>
+void ThreadPool::parallel_range(Index begin, Index end, Index grain, Body& body) {
+    if(end <= begin)
+        return;
+    if(grain < 1)
+        grain = 1;
+
+    RangeState state;
+    state.remaining.store(static_cast<size_t>(end - begin));
+
+    // initial partition, a few chunks per worker pushed in one go
+    Index n = end - begin;
+    Index chunks = std::max<Index>(1, std::min<Index>(
+        (n + grain - 1) / grain, static_cast<Index>(std::max<size_t>(1, alive.load()) * 4)));
+    Index size = (n + chunks - 1) / chunks;
+
+    std::vector< Task > batch;
+    for(Index b = begin; b < end; b += size) {
+        Index e = end - b > size ? b + size : end;
+        batch.emplace_back([this, b, e, grain, &body, &state] {
+            run_range(b, e, grain, body, state);
+        });
+    }
+    submit_bulk(batch.data(), batch.data() + batch.size());
+
+    // help until every index is processed
+    while(state.remaining.load(std::memory_order_acquire) > 0)
+        if(!run_pending())
+            std::this_thread::yield();
+
+    if(state.error)
+        std::rethrow_exception(state.error);
+}
+
+template<class Index, class F>
+void ThreadPool::parallel_for(Index begin, Index end, Index grain, F&& fn) {
+    auto body = [&fn](Index b, Index e) {
+        for(Index i = b; i < e; ++i)
+            fn(i);
+    };
+    parallel_range(begin, end, grain, body);
+}
+
+template<class Index, class T, class Map, class Combine>
+T ThreadPool::parallel_reduce(Index begin, Index end, Index grain, T identity,
+                              Map&& map, Combine&& combine) {
+    T result = identity;
+    std::mutex result_mutex;
+
+    // every chunk reduces into a local partial result first,
+    // the shared result is only locked once per chunk
+    auto body = [&](Index b, Index e) {
+        T partial = identity;
+        for(Index i = b; i < e; ++i)
+            partial = combine(std::move(partial), map(i));
+
+        std::lock_guard<std::mutex> lock(result_mutex);
+        result = combine(std::move(result), std::move(partial));
+    };
+    parallel_range(begin, end, grain, body);
+    return result;
+}
+
+inline void ThreadPool::stop() {
+    // continuations become due on the completing thread from now on,
+    // wait for those being submitted right now
+    gate->pool.store(nullptr);
+    while(gate->submitting.load() > 0)
+        std::this_thread::yield();
+
     // critical section
     {
         std::unique_lock<std::mutex> lock(queue_mutex);
-        stop = true;
+        stopped = true;
     }
 
     // wake up all threads
@@ -136,7 +933,14 @@ inline ThreadPool::~ThreadPool()
 
     // let all processes into synchronous execution, use c++11 new for-loop: for(value:values)
     for(std::thread &worker: workers)
-        worker.join();
+        if(worker.joinable())
+            worker.join();
+}
+
+// destroy everything
+inline ThreadPool::~ThreadPool()
+{
+    stop();
 }
 
 #endif
@@ -0,0 +1,114 @@
+//
+// topology.hpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <vector>               // std::vector
+#include <string>               // std::string, std::stoi
+#include <fstream>              // std::ifstream
+#include <sstream>              // std::stringstream
+#include <filesystem>           // std::filesystem::directory_iterator
+#include <algorithm>            // std::sort, std::find
+#include <thread>               // std::thread::hardware_concurrency
+
+#if defined(__linux__)
+#include <pthread.h>            // pthread_setaffinity_np
+#include <sched.h>              // sched_getaffinity, cpu_set_t
+#endif
+
+// CPUs grouped by NUMA node, as far as this process may use them.
+// Read from /sys/devices/system/node on Linux; everywhere else, or if
+// sysfs is not available, all CPUs form a single node.
+struct Topology {
+    // the cpus of every node
+    std::vector< std::vector<int> > nodes;
+
+    size_t cpu_count() const {
+        size_t n = 0;
+        for(auto& cpus: nodes)
+            n += cpus.size();
+        return n;
+    }
+
+    // parse a kernel cpu list such as "0-3,8-11"
+    static std::vector<int> parse_cpulist(const std::string& list) {
+        std::vector<int> cpus;
+        std::stringstream ss(list);
+        std::string range;
+        while(std::getline(ss, range, ',')) {
+            if(range.empty() || range == "\n")
+                continue;
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for(int cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    static Topology detect() {
+        Topology topology;
+#if defined(__linux__)
+        // only cpus in our affinity mask can be used, e.g. inside a container
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool masked = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+        std::vector< std::pair<int, std::vector<int>> > found;
+        std::error_code ec;
+        for(auto& entry: std::filesystem::directory_iterator("/sys/devices/system/node", ec)) {
+            std::string name = entry.path().filename().string();
+            if(name.size() < 5 || name.compare(0, 4, "node") != 0
+               || name.find_first_not_of("0123456789", 4) != std::string::npos)
+                continue;
+
+            std::ifstream file(entry.path() / "cpulist");
+            std::string list;
+            std::getline(file, list);
+
+            std::vector<int> cpus;
+            for(int cpu: parse_cpulist(list))
+                if(!masked || CPU_ISSET(cpu, &allowed))
+                    cpus.push_back(cpu);
+            // memory only nodes have no cpus
+            if(!cpus.empty())
+                found.emplace_back(std::stoi(name.substr(4)), std::move(cpus));
+        }
+        std::sort(found.begin(), found.end());
+        for(auto& node: found)
+            topology.nodes.push_back(std::move(node.second));
+#endif
+        if(topology.nodes.empty()) {
+            std::vector<int> cpus;
+            for(unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+                cpus.push_back(static_cast<int>(cpu));
+            topology.nodes.push_back(std::move(cpus));
+        }
+        return topology;
+    }
+};
+
+// restrict the calling thread to the given cpus, false if not supported
+inline bool pin_current_thread(const std::vector<int>& cpus) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int cpu: cpus)
+        CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+#endif
@@ -0,0 +1,167 @@
+//
+// work_stealing_queue.hpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef WORK_STEALING_QUEUE_H
+#define WORK_STEALING_QUEUE_H
+
+#include <atomic>               // std::atomic, std::atomic_thread_fence
+#include <vector>               // std::vector
+#include <memory>               // std::unique_ptr
+#include <cstdint>              // std::int64_t
+
+// Chase-Lev work stealing deque, following the C11 formulation of
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al.)
+//
+// Exactly one thread (the owner) may call push() and pop(), they work on
+// the bottom end of the deque in LIFO order, so recently spawned (and
+// cache-hot) work is executed first. Any other thread may call steal(),
+// which takes from the top end in FIFO order, i.e. the oldest and usually
+// biggest pieces of work.
+//
+// Elements are stored as raw pointers, a thief may read a slot that is being
+// overwritten concurrently and only finds out later (by a failed CAS) that
+// the value is stale, so the slots must be atomic and trivially copyable.
+template<class T>
+class WorkStealingQueue {
+public:
+    explicit WorkStealingQueue(std::int64_t capacity = 256);
+
+    WorkStealingQueue(const WorkStealingQueue&) = delete;
+    WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+
+    // owner only: push an element to the bottom
+    void push(T* item);
+    // owner only: pop an element from the bottom, nullptr if empty
+    T* pop();
+    // any thread: steal an element from the top, nullptr if empty or lost a race
+    T* steal();
+
+    // approximated number of elements, only useful as a hint
+    std::int64_t size() const {
+        std::int64_t b = bottom.load(std::memory_order_relaxed);
+        std::int64_t t = top.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+    bool empty() const { return size() == 0; }
+
+private:
+    // circular array whose capacity is always a power of two
+    struct Array {
+        std::int64_t capacity;
+        std::int64_t mask;
+        std::unique_ptr<std::atomic<T*>[]> slots;
+
+        explicit Array(std::int64_t c):
+            capacity(c), mask(c - 1), slots(new std::atomic<T*>[c]) {}
+
+        T* get(std::int64_t i) const {
+            return slots[i & mask].load(std::memory_order_relaxed);
+        }
+        void put(std::int64_t i, T* item) {
+            slots[i & mask].store(item, std::memory_order_relaxed);
+        }
+    };
+
+    Array* grow(Array* a, std::int64_t b, std::int64_t t);
+
+    // keep top and bottom in different cache lines, top is written by thieves
+    // and bottom by the owner
+    alignas(64) std::atomic<std::int64_t> top;
+    alignas(64) std::atomic<std::int64_t> bottom;
+    alignas(64) std::atomic<Array*> array;
+
+    // a thief may still read from an array that has been replaced,
+    // so old arrays are only released with the deque itself
+    std::vector< std::unique_ptr<Array> > arrays;
+};
+
+template<class T>
+WorkStealingQueue<T>::WorkStealingQueue(std::int64_t capacity): top(0), bottom(0) {
+    // round capacity up to a power of two so that index masking works
+    std::int64_t c = 1;
+    while(c < capacity)
+        c <<= 1;
+    arrays.emplace_back(new Array(c));
+    array.store(arrays.back().get(), std::memory_order_relaxed);
+}
+
+template<class T>
+void WorkStealingQueue<T>::push(T* item) {
+    std::int64_t b = bottom.load(std::memory_order_relaxed);
+    std::int64_t t = top.load(std::memory_order_acquire);
+    Array* a = array.load(std::memory_order_relaxed);
+
+    // full, double the capacity
+    if(b - t > a->capacity - 1)
+        a = grow(a, b, t);
+
+    a->put(b, item);
+    // publish the element before making it visible to the thieves
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+template<class T>
+T* WorkStealingQueue<T>::pop() {
+    std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Array* a = array.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    // the store to bottom must be visible before reading top, otherwise
+    // the owner and a thief could both take the last element
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t t = top.load(std::memory_order_relaxed);
+
+    // empty, restore bottom
+    if(t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    T* item = a->get(b);
+    if(t == b) {
+        // the last element, race against thieves for it
+        if(!top.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed))
+            item = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+}
+
+template<class T>
+T* WorkStealingQueue<T>::steal() {
+    std::int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t b = bottom.load(std::memory_order_acquire);
+
+    if(t >= b)
+        return nullptr;
+
+    Array* a = array.load(std::memory_order_acquire);
+    T* item = a->get(t);
+    // another thief or the owner was faster
+    if(!top.compare_exchange_strong(t, t + 1,
+            std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return item;
+}
+
+template<class T>
+typename WorkStealingQueue<T>::Array*
+WorkStealingQueue<T>::grow(Array* a, std::int64_t b, std::int64_t t) {
+    arrays.emplace_back(new Array(a->capacity * 2));
+    Array* bigger = arrays.back().get();
+    for(std::int64_t i = t; i < b; ++i)
+        bigger->put(i, a->get(i));
+    array.store(bigger, std::memory_order_release);
+    return bigger;
+}
+
+#endif
@@ -0,0 +1,181 @@
+//
+// bench_contention.cpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+// lock throughput under contention: 1 to N threads take a lock in a loop,
+// update shared state inside the critical section for a given number of
+// steps and do a little private work outside. Every lock of spinlock.hpp
+// is compared against the exchange spinlock of 7.2.mutex.cpp and
+// std::mutex. Fairness is the fewest acquisitions of a thread divided by
+// the most, 1 is perfectly fair.
+//
+// usage: bench_contention.out [max threads, default: hardware threads, at least 2]
+//
+
+#include <iostream>  // std::cout, std::cerr, std::endl
+#include <iomanip>   // std::setw, std::setprecision
+#include <atomic>    // std::atomic
+#include <chrono>    // std::chrono::steady_clock
+#include <thread>    // std::thread, std::this_thread::sleep_for
+#include <mutex>     // std::mutex
+#include <vector>    // std::vector
+#include <string>    // std::string
+#include <algorithm> // std::min_element, std::max_element, std::max
+#include <cstdint>   // std::uint64_t
+#include <cstdlib>   // std::strtoull, std::exit
+#include <cerrno>    // errno, ERANGE
+#include <limits>    // std::numeric_limits
+
+#include "spinlock.hpp"
+
+// the mutex of 7.2.mutex.cpp, for comparison
+class ExchangeLock {
+    std::atomic<bool> flag{false};
+
+public:
+    void lock() {
+        while(flag.exchange(true, std::memory_order_relaxed));
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    void unlock() {
+        std::atomic_thread_fence(std::memory_order_release);
+        flag.store(false, std::memory_order_relaxed);
+    }
+};
+
+// state behind the lock, a step is one round of a linear congruential generator
+struct alignas(cache_line_size) Shared {
+    std::uint64_t value = 1;
+    std::uint64_t count = 0;
+};
+
+static std::uint64_t steps(std::uint64_t value, unsigned n) {
+    for(unsigned i = 0; i < n; ++i)
+        value = value * 6364136223846793005ULL + 1442695040888963407ULL;
+    return value;
+}
+
+struct alignas(cache_line_size) PerThread {
+    std::uint64_t acquisitions = 0;
+    std::uint64_t value = 1;
+};
+
+struct Result {
+    double rate;      // acquisitions per second
+    double fairness;
+};
+
+template<class Lock>
+static Result run(size_t threads, unsigned critical, unsigned outside, std::chrono::milliseconds duration) {
+    Lock lock;
+    Shared shared;
+    std::vector<PerThread> per_thread(threads);
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> go{false}, stop{false};
+
+    std::vector<std::thread> workers;
+    for(size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&, t] {
+            PerThread& mine = per_thread[t];
+            ready.fetch_add(1);
+            while(!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            while(!stop.load(std::memory_order_relaxed)) {
+                lock.lock();
+                shared.value = steps(shared.value, critical);
+                ++shared.count;
+                lock.unlock();
+                ++mine.acquisitions;
+                mine.value = steps(mine.value, outside);
+            }
+        });
+
+    // the clock starts when every thread is up, and stops before the joins
+    while(ready.load() < threads)
+        std::this_thread::yield();
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(duration);
+    stop.store(true);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    for(auto& worker: workers)
+        worker.join();
+
+    std::uint64_t total = 0, fewest = per_thread[0].acquisitions, most = fewest;
+    for(auto& p: per_thread) {
+        total += p.acquisitions;
+        fewest = std::min(fewest, p.acquisitions);
+        most = std::max(most, p.acquisitions);
+    }
+    if(total != shared.count) {
+        std::cout << "mutual exclusion failed: " << shared.count << " updates, " << total << " acquisitions" << std::endl;
+        std::exit(1);
+    }
+    return {total / elapsed.count(), most ? double(fewest) / most : 0};
+}
+
+template<class Lock>
+static void row(const char* name, const std::vector<size_t>& thread_counts, unsigned critical,
+                unsigned outside, std::chrono::milliseconds duration) {
+    std::cout << std::setw(12) << name;
+    Result result{};
+    for(size_t threads: thread_counts) {
+        result = run<Lock>(threads, critical, outside, duration);
+        std::cout << std::setw(10) << std::setprecision(2) << result.rate / 1e6;
+    }
+    std::cout << std::setw(10) << result.fairness << std::endl;
+}
+
+// a whole number of at least 1 and nothing else, or exit with the usage
+static size_t parse_threads(const char* program, const char* text) {
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long n = std::strtoull(text, &end, 10);
+    if(text[0] < '0' || text[0] > '9' || *end != '\0' || errno == ERANGE || n < 1
+       || n > std::numeric_limits<size_t>::max()) {
+        std::cerr << "max threads: expected a whole number of at least 1, got " << text << std::endl
+                  << "usage: " << program << " [max threads, default: hardware threads, at least 2]" << std::endl;
+        std::exit(2);
+    }
+    return static_cast<size_t>(n);
+}
+
+int main(int argc, char* argv[]) {
+    size_t max_threads = argc > 1 ? parse_threads(argv[0], argv[1])
+                                  : std::max(2u, std::thread::hardware_concurrency());
+    std::vector<size_t> thread_counts;
+    for(size_t threads = 1; threads < max_threads; threads *= 2)
+        thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+
+    const auto duration = std::chrono::milliseconds(200);
+    const unsigned outside = 50;
+    std::cout << "million acquisitions per second, " << std::thread::hardware_concurrency()
+              << " hardware threads, " << outside << " steps outside the lock" << std::endl
+              << std::fixed;
+    if(max_threads > std::thread::hardware_concurrency())
+        std::cout << "more threads than hardware threads: the fair locks hand the lock to waiters that may not be running"
+                  << std::endl;
+
+    for(unsigned critical: {0u, 20u, 200u}) {
+        std::cout << std::endl << critical << " steps in the critical section" << std::endl
+                  << std::setw(12) << "threads";
+        for(size_t threads: thread_counts)
+            std::cout << std::setw(10) << threads;
+        std::cout << std::setw(10) << "fairness" << std::endl;
+
+        row<ExchangeLock>("exchange", thread_counts, critical, outside, duration);
+        row<TTASLock>("TTAS", thread_counts, critical, outside, duration);
+        row<TicketLock>("ticket", thread_counts, critical, outside, duration);
+        row<MCSLock>("MCS", thread_counts, critical, outside, duration);
+        row<FutexLock>("futex", thread_counts, critical, outside, duration);
+        row<std::mutex>("std::mutex", thread_counts, critical, outside, duration);
+    }
+    return 0;
+}
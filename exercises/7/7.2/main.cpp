@@ -0,0 +1,43 @@
+//
+// main.cpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#include <iostream> // std::cout, std::endl
+#include <thread>   // std::thread
+#include <mutex>    // std::lock_guard
+
+#include "spinlock.hpp"
+
+// the example of 7.2.mutex.cpp, with each of the locks
+template<class Lock>
+int add_twice() {
+    Lock lock;
+    int a = 0;
+
+    std::thread t1([&]() {
+        std::lock_guard<Lock> guard(lock);
+        a += 1;
+    });
+    std::thread t2([&]() {
+        std::lock_guard<Lock> guard(lock);
+        a += 2;
+    });
+
+    t1.join();
+    t2.join();
+    return a;
+}
+
+int main() {
+    std::cout << "TTASLock:   " << add_twice<TTASLock>() << std::endl;
+    std::cout << "TicketLock: " << add_twice<TicketLock>() << std::endl;
+    std::cout << "MCSLock:    " << add_twice<MCSLock>() << std::endl;
+    std::cout << "FutexLock:  " << add_twice<FutexLock>() << std::endl;
+    return 0;
+}
@@ -0,0 +1,293 @@
+//
+// spinlock.hpp
+//
+// exercise solution - chapter 7
+// modern cpp tutorial
+//
+// created by changkun at changkun.de
+// https://github.com/changkun/modern-cpp-tutorial/
+//
+
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <atomic>               // std::atomic, std::memory_order
+#include <thread>               // std::this_thread::yield
+#include <memory>               // std::unique_ptr
+#include <vector>               // std::vector
+#include <cstdint>              // std::uint32_t
+#include <cstddef>              // std::size_t
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>          // _mm_pause
+#endif
+
+// The locks below grew out of the mutex of 7.2.mutex.cpp, which spins on
+// flag.exchange(true): every iteration is a read-modify-write that takes
+// the cache line exclusive, so the waiters keep moving the line between
+// their cores and the owner pays for it when it unlocks. All of them have
+// lock(), try_lock() and unlock(), they work with std::lock_guard,
+// std::unique_lock and std::scoped_lock, and sit on cache lines of their
+// own, so a lock does not share a line with the data next to it.
+//
+//   TTASLock    test-and-test-and-set, waiters read a shared copy of the
+//               line and back off exponentially. Smallest and fastest
+//               while contention is low, unfair.
+//   TicketLock  first come, first served. Waiters still spin on one line,
+//               every unlock invalidates all of them.
+//   MCSLock     queue lock, every waiter spins on a node of its own and
+//               the owner hands the lock to its successor, so an unlock
+//               touches one other core. Fair, for many cores.
+//   FutexLock   spins briefly, then sleeps in atomic::wait, a futex on
+//               Linux. The choice when critical sections are long or
+//               there are more threads than cores.
+//
+// Spinning waiters yield their CPU after a while. Without that a waiter
+// whose turn it is may sit in the run queue behind spinners that cannot
+// make progress, once there are more threads than cores.
+
+constexpr std::size_t cache_line_size = 64;
+
+// Exponential backoff for spin loops: a pause instruction tells the core
+// that this is a spin-wait loop, which saves power and frees resources
+// for the sibling hyperthread. Past `max_pauses` the CPU is yielded.
+class Backoff {
+public:
+    static constexpr unsigned max_pauses = 1024;
+
+    static void pause() {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    void operator()() {
+        if(pauses <= max_pauses) {
+            for(unsigned i = 0; i < pauses; ++i)
+                pause();
+            pauses *= 2;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    unsigned pauses = 1;
+};
+
+class alignas(cache_line_size) TTASLock {
+public:
+    void lock() {
+        // the exchange is only tried when the lock looked free, waiting
+        // is done with plain loads that hit the local cache
+        while(locked.exchange(true, std::memory_order_acquire)) {
+            Backoff backoff;
+            while(locked.load(std::memory_order_relaxed))
+                backoff();
+        }
+    }
+
+    bool try_lock() {
+        return !locked.load(std::memory_order_relaxed)
+            && !locked.exchange(true, std::memory_order_acquire);
+    }
+
+    void unlock() {
+        locked.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> locked{false};
+};
+
+class alignas(cache_line_size) TicketLock {
+public:
+    void lock() {
+        std::uint32_t ticket = next.fetch_add(1, std::memory_order_relaxed);
+        unsigned spins = 0;
+        for(;;) {
+            std::uint32_t current = serving.load(std::memory_order_acquire);
+            if(current == ticket)
+                return;
+            // the waiters ahead tell how long it will take at least,
+            // without that they would all poll the line at once
+            if(++spins < spin_limit) {
+                for(std::uint32_t i = (ticket - current) * pauses_per_waiter; i > 0; --i)
+                    Backoff::pause();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    bool try_lock() {
+        std::uint32_t current = serving.load(std::memory_order_relaxed);
+        std::uint32_t expected = current;
+        return next.compare_exchange_strong(expected, current + 1, std::memory_order_acquire,
+                                            std::memory_order_relaxed);
+    }
+
+    void unlock() {
+        // only the owner writes serving
+        serving.store(serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    static constexpr unsigned spin_limit = 1024;
+    static constexpr std::uint32_t pauses_per_waiter = 32;
+
+    // tickets wrap around, the difference stays right
+    std::atomic<std::uint32_t> next{0};
+    std::atomic<std::uint32_t> serving{0};
+};
+
+// The lock of Mellor-Crummey and Scott. A waiter appends its node to the
+// queue with one exchange on the tail and spins on the flag of its node,
+// until its predecessor clears it. lock() takes no node as an argument,
+// so nodes come from a free list of the calling thread, and the owner's
+// node is kept in the lock for unlock(), which has to be called by the
+// same thread. A thread may hold several MCS locks, and release them in
+// any order.
+class alignas(cache_line_size) MCSLock {
+public:
+    void lock() {
+        Node* node = Node::acquire();
+        node->next.store(nullptr, std::memory_order_relaxed);
+        node->waiting.store(true, std::memory_order_relaxed);
+
+        Node* predecessor = tail.exchange(node, std::memory_order_acq_rel);
+        if(predecessor) {
+            predecessor->next.store(node, std::memory_order_release);
+            Backoff backoff;
+            while(node->waiting.load(std::memory_order_acquire))
+                backoff();
+        }
+        owner = node;
+    }
+
+    bool try_lock() {
+        Node* node = Node::acquire();
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node* expected = nullptr;
+        if(!tail.compare_exchange_strong(expected, node, std::memory_order_acquire,
+                                         std::memory_order_relaxed)) {
+            Node::release(node);
+            return false;
+        }
+        owner = node;
+        return true;
+    }
+
+    void unlock() {
+        Node* node = owner;
+        Node* successor = node->next.load(std::memory_order_acquire);
+        if(!successor) {
+            // nobody queued, the lock becomes free
+            Node* expected = node;
+            if(tail.compare_exchange_strong(expected, nullptr, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+                Node::release(node);
+                return;
+            }
+            // a waiter swapped the tail already, but has not linked itself yet
+            Backoff backoff;
+            while(!(successor = node->next.load(std::memory_order_acquire)))
+                backoff();
+        }
+        successor->waiting.store(false, std::memory_order_release);
+        Node::release(node);
+    }
+
+private:
+    struct alignas(cache_line_size) Node {
+        std::atomic<Node*> next{nullptr};
+        std::atomic<bool> waiting{false};
+        // link of the free list, only touched by the owning thread
+        Node* free = nullptr;
+
+        // Nodes of a thread live as long as the thread. A node is not
+        // touched by others once it was released: the successor was
+        // handed the lock through it before.
+        struct Pool {
+            std::vector< std::unique_ptr<Node> > nodes;
+            Node* free = nullptr;
+        };
+
+        static Pool& pool() {
+            thread_local Pool pool;
+            return pool;
+        }
+
+        static Node* acquire() {
+            Pool& p = pool();
+            if(!p.free) {
+                p.nodes.push_back(std::make_unique<Node>());
+                return p.nodes.back().get();
+            }
+            Node* node = p.free;
+            p.free = node->free;
+            return node;
+        }
+
+        static void release(Node* node) {
+            Pool& p = pool();
+            node->free = p.free;
+            p.free = node;
+        }
+    };
+
+    std::atomic<Node*> tail{nullptr};
+    // written and read by the owner only
+    Node* owner = nullptr;
+};
+
+// Spin, then sleep, in the manner of Drepper's "Futexes Are Tricky":
+// 0 is unlocked, 1 locked, 2 locked and somebody may be sleeping. An
+// unlock only calls into the kernel if the state was 2.
+class alignas(cache_line_size) FutexLock {
+public:
+    void lock() {
+        int expected = unlocked;
+        if(state.compare_exchange_strong(expected, locked, std::memory_order_acquire,
+                                         std::memory_order_relaxed))
+            return;
+
+        // the owner may be about to unlock, a short spin saves two system calls
+        Backoff backoff;
+        for(unsigned i = 0; i < spin_rounds; ++i) {
+            backoff();
+            expected = state.load(std::memory_order_relaxed);
+            if(expected == unlocked
+               && state.compare_exchange_weak(expected, locked, std::memory_order_acquire,
+                                              std::memory_order_relaxed))
+                return;
+        }
+
+        // marked as contended, even if it is taken now, since other
+        // sleepers cannot be told apart from none
+        while(state.exchange(contended, std::memory_order_acquire) != unlocked)
+            state.wait(contended, std::memory_order_relaxed);
+    }
+
+    bool try_lock() {
+        int expected = unlocked;
+        return state.compare_exchange_strong(expected, locked, std::memory_order_acquire,
+                                             std::memory_order_relaxed);
+    }
+
+    void unlock() {
+        if(state.exchange(unlocked, std::memory_order_release) == contended)
+            state.notify_one();
+    }
+
+private:
+    static constexpr int unlocked = 0, locked = 1, contended = 2;
+    // 1 + 2 + ... + 64 pauses, a few microseconds
+    static constexpr unsigned spin_rounds = 7;
+
+    std::atomic<int> state{unlocked};
+};
+
+#endif